@@ -0,0 +1,789 @@
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fluid_logic.h"
+#include "fluid_ensemble.h"
+#include "fluid_sparse.h"
+#include "fluid_render.h"
+#include "fluid_slabs.h"
+#include "fluid_checkpoint.h"
+
+
+#define MAX_SWEEP_VALUES 16
+#define NUM_PHASES 5
+
+// speed of the scripted jet of the dense scenes
+#define JET_SPEED 2.0f
+
+// cell size of the sparse plume, so its speed in cells per step doesn't depend on the domain size
+#define SPARSE_CELL_SIZE (1.0f / 128.0f)
+
+// side of the window of the sparse grid that is rendered and compared between thread counts
+#define SPARSE_RENDER_SIZE 256
+
+static const char* PHASE_NAMES[NUM_PHASES] = { "prepare", "solve", "tiles", "advect-u", "advect-s" };
+
+/**
+ * Benchmark settings, filled from the command line.
+ */
+typedef struct {
+    int gridSizes[MAX_SWEEP_VALUES];
+    int numGridSizes;
+    int threadCounts[MAX_SWEEP_VALUES];
+    int numThreadCounts;
+
+    int numSteps;
+    int numWarmupSteps;
+    int numIterations;
+    PressureSolverType solver;
+    int temporalBlock;
+    float activityThreshold;
+    AdvectionScheme advectionScheme;
+    SmokeStorage smokeStorage;
+    float deltaTime;
+    int ensembleSize;
+    int sparse;
+    int slabCounts[MAX_SWEEP_VALUES];
+    int numSlabCounts;
+    const char* checkpointPath;
+} BenchConfig;
+
+/**
+ * Timings of one grid size and thread count.
+ */
+typedef struct {
+    double stepSeconds;
+    double phaseSeconds[NUM_PHASES];
+
+    // smoke difference to the same steps with fp32 smoke, when smoke is stored in 16 bits
+    double smokeErrorMax;
+    double smokeErrorRms;
+
+    // arena bytes of the fluid and of the fp32 run
+    double arenaBytes;
+    double referenceArenaBytes;
+} BenchResult;
+
+static double seconds_since(Uint64 start) {
+    return (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+}
+
+/**
+ * Parses a comma separated list of positive integers. Returns the number of values or -1 on error.
+ */
+static int parse_list(const char* text, int* values) {
+    int count = 0;
+    const char* cursor = text;
+
+    while (*cursor != '\0') {
+        char* end;
+        long value = strtol(cursor, &end, 10);
+        if (end == cursor || value <= 0 || count == MAX_SWEEP_VALUES) return -1;
+
+        values[count++] = (int)value;
+        cursor = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return -1;
+    }
+    return count;
+}
+
+static int parse_solver(const char* name, PressureSolverType* solver) {
+    if (strcmp(name, "gs") == 0) *solver = PRESSURE_SOLVER_GAUSS_SEIDEL;
+    else if (strcmp(name, "rb") == 0) *solver = PRESSURE_SOLVER_RED_BLACK_SOR;
+    else if (strcmp(name, "pcg") == 0) *solver = PRESSURE_SOLVER_PCG;
+    else if (strcmp(name, "mg") == 0) *solver = PRESSURE_SOLVER_MULTIGRID;
+    else return 0;
+    return 1;
+}
+
+static int parse_advection(const char* name, AdvectionScheme* scheme) {
+    if (strcmp(name, "sl") == 0) *scheme = ADVECTION_SEMI_LAGRANGIAN;
+    else if (strcmp(name, "mc") == 0) *scheme = ADVECTION_MACCORMACK;
+    else return 0;
+    return 1;
+}
+
+static int parse_storage(const char* name, SmokeStorage* storage) {
+    if (strcmp(name, "fp32") == 0) *storage = SMOKE_STORAGE_FLOAT32;
+    else if (strcmp(name, "fp16") == 0) *storage = SMOKE_STORAGE_FLOAT16;
+    else if (strcmp(name, "bf16") == 0) *storage = SMOKE_STORAGE_BFLOAT16;
+    else return 0;
+    return 1;
+}
+
+static const char* storage_name(SmokeStorage storage) {
+    switch (storage) {
+        case SMOKE_STORAGE_FLOAT32: return "fp32";
+        case SMOKE_STORAGE_FLOAT16: return "fp16";
+        case SMOKE_STORAGE_BFLOAT16: return "bf16";
+    }
+    return "unknown";
+}
+
+static const char* solver_name(PressureSolverType solver) {
+    switch (solver) {
+        case PRESSURE_SOLVER_GAUSS_SEIDEL: return "gauss-seidel";
+        case PRESSURE_SOLVER_RED_BLACK_SOR: return "red-black";
+        case PRESSURE_SOLVER_PCG: return "pcg";
+        case PRESSURE_SOLVER_MULTIGRID: return "multigrid";
+    }
+    return "unknown";
+}
+
+static void print_usage(void) {
+    printf("usage: fluid_bench [options]\n");
+    printf("  -s 128,256,512   grid sizes (interior cells per side)\n");
+    printf("  -t 1,2,4         thread counts (default: powers of two up to the CPU count)\n");
+    printf("  -n 100           timed steps per run\n");
+    printf("  -w 10            warmup steps per run\n");
+    printf("  -i 40            pressure iterations per step (no early exit)\n");
+    printf("  -p rb            pressure solver: gs, rb, pcg or mg\n");
+    printf("  -b 0             red-black iterations per temporal block (0 disables)\n");
+    printf("  -a 0             activity threshold of the tiles the passes skip (0 disables)\n");
+    printf("  -m sl            advection scheme: sl (semi-Lagrangian) or mc (MacCormack)\n");
+    printf("  -f fp32          smoke storage: fp32, fp16 or bf16 (16 bits also reports the error and memory against fp32)\n");
+    printf("  -e 0             ensemble members with swept parameters stepped together (0 benchmarks single fluids)\n");
+    printf("  -l 2,4           run the grid split into that many slab processes instead, against one fluid (POSIX)\n");
+    printf("  -c file          save a checkpoint to the file halfway, resume it twice and compare the smoke checksums\n");
+    printf("  -S               run a plume on the sparse tiled grid instead, and compare every thread count to the first\n");
+}
+
+static int parse_args(int argc, char* argv[], BenchConfig* config) {
+    config->gridSizes[0] = 128;
+    config->gridSizes[1] = 256;
+    config->gridSizes[2] = 512;
+    config->numGridSizes = 3;
+
+    config->numThreadCounts = 0;
+    int numCpus = SDL_GetCPUCount();
+    if (numCpus < 1) numCpus = 1;
+    for (int threads = 1; threads <= numCpus && config->numThreadCounts < MAX_SWEEP_VALUES; threads *= 2) {
+        config->threadCounts[config->numThreadCounts++] = threads;
+    }
+    if (config->threadCounts[config->numThreadCounts - 1] != numCpus && config->numThreadCounts < MAX_SWEEP_VALUES) {
+        config->threadCounts[config->numThreadCounts++] = numCpus;
+    }
+
+    config->numSteps = 100;
+    config->numWarmupSteps = 10;
+    config->numIterations = 40;
+    config->solver = PRESSURE_SOLVER_RED_BLACK_SOR;
+    config->temporalBlock = 0;
+    config->activityThreshold = 0.0f;
+    config->advectionScheme = ADVECTION_SEMI_LAGRANGIAN;
+    config->smokeStorage = SMOKE_STORAGE_FLOAT32;
+    config->deltaTime = 1.0f / 60.0f;
+    config->ensembleSize = 0;
+    config->sparse = 0;
+    config->numSlabCounts = 0;
+    config->checkpointPath = NULL;
+
+    for (int arg = 1; arg < argc; ++arg) {
+        const char* option = argv[arg];
+        if (strcmp(option, "-h") == 0) {
+            print_usage();
+            return 0;
+        }
+        if (strcmp(option, "-S") == 0) {
+            config->sparse = 1;
+            continue;
+        }
+
+        const char* value = (arg + 1 < argc) ? argv[arg + 1] : NULL;
+        int ok = value != NULL;
+
+        if (ok && strcmp(option, "-s") == 0) ok = (config->numGridSizes = parse_list(value, config->gridSizes)) > 0;
+        else if (ok && strcmp(option, "-t") == 0) ok = (config->numThreadCounts = parse_list(value, config->threadCounts)) > 0;
+        else if (ok && strcmp(option, "-n") == 0) ok = (config->numSteps = atoi(value)) > 0;
+        else if (ok && strcmp(option, "-w") == 0) ok = (config->numWarmupSteps = atoi(value)) >= 0;
+        else if (ok && strcmp(option, "-i") == 0) ok = (config->numIterations = atoi(value)) > 0;
+        else if (ok && strcmp(option, "-p") == 0) ok = parse_solver(value, &config->solver);
+        else if (ok && strcmp(option, "-b") == 0) ok = (config->temporalBlock = atoi(value)) >= 0;
+        else if (ok && strcmp(option, "-a") == 0) ok = (config->activityThreshold = (float)atof(value)) >= 0.0f;
+        else if (ok && strcmp(option, "-m") == 0) ok = parse_advection(value, &config->advectionScheme);
+        else if (ok && strcmp(option, "-f") == 0) ok = parse_storage(value, &config->smokeStorage);
+        else if (ok && strcmp(option, "-e") == 0) ok = (config->ensembleSize = atoi(value)) >= 0;
+        else if (ok && strcmp(option, "-c") == 0) config->checkpointPath = value;
+        else if (ok && strcmp(option, "-l") == 0) ok = (config->numSlabCounts = parse_list(value, config->slabCounts)) > 0;
+        else ok = 0;
+
+        if (!ok) {
+            printf("ERROR: invalid option %s\n", option);
+            print_usage();
+            return 0;
+        }
+        ++arg;
+    }
+    return 1;
+}
+
+/**
+ * The scene is a closed box with a round obstacle in the middle, like the interactive demo.
+ */
+static int is_scene_solid(int i, int j, int numCellsX, int numCellsY, int gridSize) {
+    float dx = (float)i - 0.5f * numCellsX;
+    float dy = (float)j - 0.5f * numCellsY;
+    float radius = 0.1f * gridSize;
+
+    int isBorder = i == 0 || i == numCellsX - 1 || j == 0 || j == numCellsY - 1;
+    return isBorder || dx * dx + dy * dy < radius * radius;
+}
+
+/**
+ * Applies the settings to a fluid and builds the scene.
+ */
+static void setup_scene(const BenchConfig* config, Fluid* fluid, int gridSize, SmokeStorage smokeStorage) {
+    fluid_set_temporal_blocking(fluid, config->temporalBlock);
+    fluid_set_active_tiles(fluid, config->activityThreshold > 0.0f, config->activityThreshold);
+    fluid_set_advection_scheme(fluid, config->advectionScheme);
+    fluid_set_smoke_storage(fluid, smokeStorage);
+
+    for (int i = 0; i < fluid->numCellsX; ++i) {
+        for (int j = 0; j < fluid->numCellsY; ++j) {
+            int isSolid = is_scene_solid(i, j, fluid->numCellsX, fluid->numCellsY, gridSize);
+            fluid_set_obstacle(fluid, i, j, isSolid ? 0.0f : 1.0f);
+        }
+    }
+}
+
+static Fluid* create_scene(const BenchConfig* config, int gridSize, int numThreads, SmokeStorage smokeStorage) {
+    Fluid* fluid = fluid_init(1.0f, gridSize, gridSize, 1.0f / gridSize, config->solver);
+    if (fluid == NULL) return NULL;
+
+    fluid_set_num_threads(fluid, numThreads);
+    setup_scene(config, fluid, gridSize, smokeStorage);
+    return fluid;
+}
+
+/**
+ * Scripted emitter: a jet of smoke entering from the left wall whose height sweeps up and down.
+ * Writes rows [firstRow, lastRow] of columns 1 and 2.
+ */
+static void jet_rows(int numCellsY, int step, int* firstRow, int* lastRow) {
+    int numInteriorY = numCellsY - 2;
+    int halfWidth = numInteriorY / 20 + 1;
+    int center = 1 + numInteriorY / 2 + (int)(0.25f * numInteriorY * sinf(0.02f * (float)step));
+
+    *firstRow = center - halfWidth < 1 ? 1 : center - halfWidth;
+    *lastRow = center + halfWidth > numInteriorY ? numInteriorY : center + halfWidth;
+}
+
+static void emit(Fluid* fluid, int step) {
+    int firstRow, lastRow;
+    jet_rows(fluid->numCellsY, step, &firstRow, &lastRow);
+
+    for (int j = firstRow; j <= lastRow; ++j) {
+        for (int i = 1; i <= 2; ++i) {
+            fluid_set_smoke(fluid, i, j, 1.0f);
+            fluid->velocityX[(size_t)i * fluid->rowStride + j] = JET_SPEED;
+        }
+    }
+}
+
+/**
+ * Runs the steps of fluid_simulate_step one phase at a time and adds the time of each phase.
+ */
+static void run_phases(Fluid* fluid, const BenchConfig* config, int firstStep, int numSteps, double* phaseSeconds) {
+    float overRelaxation = 1.9f;
+
+    for (int step = firstStep; step < firstStep + numSteps; ++step) {
+        emit(fluid, step);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        fluid_prepare_projection(fluid, config->deltaTime, 0.0f, 0.99f, 0.999f);
+        phaseSeconds[0] += seconds_since(start);
+
+        start = SDL_GetPerformanceCounter();
+        fluid_solve_incompressibility(fluid, config->numIterations, overRelaxation);
+        phaseSeconds[1] += seconds_since(start);
+
+        start = SDL_GetPerformanceCounter();
+        fluid_update_active_tiles(fluid);
+        phaseSeconds[2] += seconds_since(start);
+
+        start = SDL_GetPerformanceCounter();
+        fluid_advect_velocity(fluid, config->deltaTime);
+        phaseSeconds[3] += seconds_since(start);
+
+        start = SDL_GetPerformanceCounter();
+        fluid_advect_smoke(fluid, config->deltaTime);
+        phaseSeconds[4] += seconds_since(start);
+    }
+}
+
+/**
+ * Runs the warmup and timed steps of a run with fp32 smoke and stores the largest and RMS difference of the
+ * fluid's smoke to it, and the arena sizes of both.
+ */
+static int measure_smoke_error(const BenchConfig* config, const Fluid* fluid, int gridSize, int numThreads, BenchResult* result) {
+    Fluid* reference = create_scene(config, gridSize, numThreads, SMOKE_STORAGE_FLOAT32);
+    if (reference == NULL) return 0;
+
+    for (int step = 0; step < config->numWarmupSteps + config->numSteps; ++step) {
+        emit(reference, step);
+        fluid_simulate_step(reference, config->numIterations, config->deltaTime, 0.0f, 1.9f, 0.99f, 0.999f);
+    }
+
+    double errorMax = 0.0;
+    double errorSquares = 0.0;
+    for (int i = 1; i < fluid->numCellsX - 1; ++i) {
+        for (int j = 1; j < fluid->numCellsY - 1; ++j) {
+            double error = fabs((double)fluid_get_smoke(fluid, i, j) - (double)fluid_get_smoke(reference, i, j));
+            errorMax = error > errorMax ? error : errorMax;
+            errorSquares += error * error;
+        }
+    }
+    result->smokeErrorMax = errorMax;
+    result->smokeErrorRms = sqrt(errorSquares / ((double)(fluid->numCellsX - 2) * (fluid->numCellsY - 2)));
+    result->arenaBytes = (double)fluid->arenaSize;
+    result->referenceArenaBytes = (double)reference->arenaSize;
+
+    fluid_free(reference);
+    return 1;
+}
+
+static void emit_member(void* userData, int memberIndex, Fluid* member, int step) {
+    (void)userData;
+    (void)memberIndex;
+    emit(member, step);
+}
+
+/**
+ * Steps an ensemble whose members sweep over-relaxation, dissipation and gravity, and stores its throughput.
+ */
+static int run_ensemble_benchmark(const BenchConfig* config, int gridSize, int numThreads, FluidEnsembleStatistics* statistics) {
+    FluidEnsemble* ensemble = fluid_ensemble_create(config->ensembleSize, 1.0f, gridSize, gridSize, 1.0f / gridSize,
+                                                    config->solver, config->smokeStorage, numThreads);
+    if (ensemble == NULL) return 0;
+
+    for (int member = 0; member < config->ensembleSize; ++member) {
+        setup_scene(config, fluid_ensemble_member(ensemble, member), gridSize, config->smokeStorage);
+        float overRelaxation = 1.5f + 0.45f * (float)(member % 10) / 9.0f;
+        float dissipation = 1.0f - 0.002f * (float)(member / 10 % 10);
+        float gravityForce = (member / 100) % 2 ? -9.81f : 0.0f;
+        fluid_ensemble_set_parameters(ensemble, member, gravityForce, overRelaxation, dissipation, 0.999f);
+    }
+
+    if (config->numWarmupSteps > 0) {
+        fluid_ensemble_simulate(ensemble, config->numWarmupSteps, config->numIterations, config->deltaTime, emit_member, NULL);
+    }
+    fluid_ensemble_simulate(ensemble, config->numSteps, config->numIterations, config->deltaTime, emit_member, NULL);
+    fluid_ensemble_statistics(ensemble, statistics);
+
+    fluid_ensemble_free(ensemble);
+    return 1;
+}
+
+/**
+ * Prints the throughput of an ensemble for every grid size and thread count.
+ */
+static int run_ensemble_sweep(const BenchConfig* config) {
+    printf("ensemble of %d members\n", config->ensembleSize);
+    printf("%6s %7s %14s %9s %7s\n", "grid", "threads", "sims*steps/s", "ns/cell", "steals");
+
+    for (int s = 0; s < config->numGridSizes; ++s) {
+        int gridSize = config->gridSizes[s];
+
+        for (int t = 0; t < config->numThreadCounts; ++t) {
+            FluidEnsembleStatistics statistics;
+            if (!run_ensemble_benchmark(config, gridSize, config->threadCounts[t], &statistics)) {
+                printf("ERROR: failed to create an ensemble of %dx%d fluids\n", gridSize, gridSize);
+                return 0;
+            }
+
+            double cellSteps = (double)gridSize * gridSize * (double)statistics.memberSteps;
+            printf("%6d %7d %14.1f %9.2f %7d\n", gridSize, config->threadCounts[t], statistics.memberStepsPerSecond,
+                   statistics.seconds * 1e9 / cellSteps, statistics.numSteals);
+            fflush(stdout);
+        }
+    }
+    return 1;
+}
+
+/**
+ * Scripted plume of the sparse grid: smoke and an upward jet near the bottom of the domain whose position sways
+ * left and right, so tiles are allocated above it and released again.
+ */
+static void emit_sparse(FluidSparse* sparse, int step) {
+    int centerX = sparse->numCellsX / 2 + (int)(16.0f * sinf(0.03f * (float)step));
+    int baseY = sparse->numCellsY / 8;
+    float jetSpeed = 1.0f;
+
+    for (int i = centerX - 4; i <= centerX + 4; ++i) {
+        for (int j = baseY; j < baseY + 4; ++j) {
+            fluid_sparse_add_smoke(sparse, i, j, 1.0f);
+            fluid_sparse_add_velocity(sparse, i, j, 0.0f, jetSpeed - fluid_sparse_value(sparse, SPARSE_VELOCITY_Y, i, j));
+        }
+    }
+}
+
+/**
+ * Largest difference of the front fields of two sparse grids over the tiles allocated in either of them.
+ */
+static double sparse_difference(const FluidSparse* sparse, const FluidSparse* reference) {
+    static const FluidSparseField fields[] = { SPARSE_VELOCITY_X, SPARSE_VELOCITY_Y, SPARSE_SMOKE };
+    const FluidSparse* grids[2] = { sparse, reference };
+    double differenceMax = 0.0;
+
+    for (int grid = 0; grid < 2; ++grid) {
+        for (int t = 0; t < grids[grid]->numTiles; ++t) {
+            int firstX = grids[grid]->tiles[t]->tileX * FLUID_SPARSE_TILE_SIZE;
+            int firstY = grids[grid]->tiles[t]->tileY * FLUID_SPARSE_TILE_SIZE;
+
+            for (int i = firstX; i < firstX + FLUID_SPARSE_TILE_SIZE; ++i) {
+                for (int j = firstY; j < firstY + FLUID_SPARSE_TILE_SIZE; ++j) {
+                    for (int f = 0; f < 3; ++f) {
+                        double difference = fabs((double)fluid_sparse_value(sparse, fields[f], i, j) -
+                                                 (double)fluid_sparse_value(reference, fields[f], i, j));
+                        differenceMax = difference > differenceMax ? difference : differenceMax;
+                    }
+                }
+            }
+        }
+    }
+    return differenceMax;
+}
+
+/**
+ * Renders the window around the plume source.
+ */
+static void render_sparse(const FluidSparse* sparse, uint32_t* pixels) {
+    int firstX = sparse->numCellsX / 2 - SPARSE_RENDER_SIZE / 2;
+    int firstY = sparse->numCellsY / 8 - SPARSE_RENDER_SIZE / 8;
+    fluid_sparse_render_smoke(sparse, pixels, SPARSE_RENDER_SIZE, firstX, firstY, SPARSE_RENDER_SIZE, SPARSE_RENDER_SIZE);
+}
+
+/**
+ * Runs the sparse plume for every grid size and thread count. Each run is compared to the run with the first
+ * thread count: the fields of every allocated tile and a rendered window must match.
+ */
+static int run_sparse_sweep(const BenchConfig* config) {
+    size_t numPixels = (size_t)SPARSE_RENDER_SIZE * SPARSE_RENDER_SIZE;
+    uint32_t* pixels = (uint32_t*)malloc(numPixels * sizeof(uint32_t));
+    uint32_t* referencePixels = (uint32_t*)malloc(numPixels * sizeof(uint32_t));
+    if (pixels == NULL || referencePixels == NULL) {
+        free(pixels);
+        free(referencePixels);
+        printf("ERROR: failed to allocate the render window\n");
+        return 0;
+    }
+
+    printf("sparse plume, %d x %d window rendered\n", SPARSE_RENDER_SIZE, SPARSE_RENDER_SIZE);
+    printf("%6s %7s %10s %9s %7s %9s %12s %8s\n", "grid", "threads", "steps/s", "ns/cell", "tiles", "MB", "max diff", "render");
+
+    int ok = 1;
+    for (int s = 0; s < config->numGridSizes && ok; ++s) {
+        int gridSize = config->gridSizes[s];
+        FluidSparse* reference = NULL;
+
+        for (int t = 0; t < config->numThreadCounts; ++t) {
+            FluidSparse* sparse = fluid_sparse_create(gridSize, gridSize, SPARSE_CELL_SIZE, 0, 1e-4f);
+            if (sparse == NULL) {
+                printf("ERROR: failed to create a %dx%d sparse grid\n", gridSize, gridSize);
+                ok = 0;
+                break;
+            }
+            fluid_sparse_set_num_threads(sparse, config->threadCounts[t]);
+
+            for (int step = 0; step < config->numWarmupSteps; ++step) {
+                emit_sparse(sparse, step);
+                fluid_sparse_simulate_step(sparse, config->numIterations, config->deltaTime, 1.9f, 0.99f, 0.999f);
+            }
+
+            // allocated cells summed over the timed steps
+            double cellSteps = 0.0;
+            Uint64 start = SDL_GetPerformanceCounter();
+            for (int step = config->numWarmupSteps; step < config->numWarmupSteps + config->numSteps; ++step) {
+                emit_sparse(sparse, step);
+                fluid_sparse_simulate_step(sparse, config->numIterations, config->deltaTime, 1.9f, 0.99f, 0.999f);
+                cellSteps += (double)sparse->numTiles * FLUID_SPARSE_TILE_CELLS;
+            }
+            double seconds = seconds_since(start);
+
+            render_sparse(sparse, pixels);
+            printf("%6d %7d %10.1f %9.2f %7d %9.1f", gridSize, config->threadCounts[t], config->numSteps / seconds,
+                   seconds * 1e9 / cellSteps, sparse->numTiles, (double)fluid_sparse_memory_bytes(sparse) / (1024.0 * 1024.0));
+
+            if (reference == NULL) {
+                printf(" %12s %8s\n", "-", "-");
+                reference = sparse;
+                memcpy(referencePixels, pixels, numPixels * sizeof(uint32_t));
+            } else {
+                int sameImage = memcmp(pixels, referencePixels, numPixels * sizeof(uint32_t)) == 0;
+                printf(" %12.2e %8s\n", sparse_difference(sparse, reference), sameImage ? "same" : "DIFFERS");
+                fluid_sparse_free(sparse);
+            }
+            fflush(stdout);
+        }
+        fluid_sparse_free(reference);
+    }
+
+    free(pixels);
+    free(referencePixels);
+    return ok;
+}
+
+static void emit_slabs(FluidSlabs* slabs, int numCellsY, int step) {
+    int firstRow, lastRow;
+    jet_rows(numCellsY, step, &firstRow, &lastRow);
+
+    for (int j = firstRow; j <= lastRow; ++j) {
+        for (int i = 1; i <= 2; ++i) {
+            *fluid_slabs_cell(slabs, SMOKE_FIELD, i, j) = 1.0f;
+            *fluid_slabs_cell(slabs, U_FIELD, i, j) = JET_SPEED;
+        }
+    }
+}
+
+/**
+ * Largest difference of the velocities and smoke of a slab grid to a fluid of the same size.
+ */
+static double slab_difference(FluidSlabs* slabs, const Fluid* fluid, float* values) {
+    static const FieldType fields[] = { U_FIELD, V_FIELD, SMOKE_FIELD };
+    double differenceMax = 0.0;
+
+    for (int f = 0; f < 3; ++f) {
+        const float* fluidField = fields[f] == U_FIELD ? fluid->velocityX : fields[f] == V_FIELD ? fluid->velocityY : fluid->smokeDensity;
+        fluid_slabs_gather(slabs, fields[f], values);
+
+        for (int i = 0; i < fluid->numCellsX; ++i) {
+            for (int j = 0; j < fluid->numCellsY; ++j) {
+                double difference = fabs((double)values[(size_t)i * fluid->numCellsY + j] - (double)fluidField[(size_t)i * fluid->rowStride + j]);
+                differenceMax = difference > differenceMax ? difference : differenceMax;
+            }
+        }
+    }
+    return differenceMax;
+}
+
+/**
+ * Runs the scene split into slab processes for every slab count and compares it to one single-threaded fluid.
+ * Slabs solve red-black and advect semi-Lagrangian, and only read one column beyond their edge, so the step is
+ * shortened until the jet moves at most half a cell per step.
+ */
+static int run_slab_sweep(const BenchConfig* config) {
+    BenchConfig slabConfig = *config;
+    slabConfig.solver = PRESSURE_SOLVER_RED_BLACK_SOR;
+    slabConfig.temporalBlock = 0;
+    slabConfig.activityThreshold = 0.0f;
+    slabConfig.advectionScheme = ADVECTION_SEMI_LAGRANGIAN;
+
+    printf("slabs against one fluid on 1 thread, red-black, semi-lagrangian\n");
+    printf("%6s %6s %9s %10s %10s %9s %12s\n", "grid", "slabs", "dt", "steps/s", "1 fluid", "speedup", "max diff");
+
+    for (int s = 0; s < config->numGridSizes; ++s) {
+        int gridSize = config->gridSizes[s];
+        float deltaTime = fminf(config->deltaTime, 0.5f / (JET_SPEED * gridSize));
+
+        Fluid* reference = create_scene(&slabConfig, gridSize, 1, SMOKE_STORAGE_FLOAT32);
+        float* values = (float*)malloc((size_t)(gridSize + 2) * (gridSize + 2) * sizeof(float));
+        if (reference == NULL || values == NULL) {
+            fluid_free(reference);
+            free(values);
+            printf("ERROR: failed to create a %dx%d fluid\n", gridSize, gridSize);
+            return 0;
+        }
+
+        Uint64 start = 0;
+        for (int step = 0; step < config->numWarmupSteps + config->numSteps; ++step) {
+            if (step == config->numWarmupSteps) start = SDL_GetPerformanceCounter();
+            emit(reference, step);
+            fluid_simulate_step(reference, config->numIterations, deltaTime, 0.0f, 1.9f, 0.99f, 0.999f);
+        }
+        double referenceSeconds = seconds_since(start);
+
+        for (int c = 0; c < config->numSlabCounts; ++c) {
+            int numSlabs = config->slabCounts[c];
+            FluidSlabs* slabs = fluid_slabs_create(1.0f, gridSize, gridSize, 1.0f / gridSize, numSlabs);
+            if (slabs == NULL) {
+                fluid_free(reference);
+                free(values);
+                return 0;
+            }
+            for (int i = 0; i < reference->numCellsX; ++i) {
+                for (int j = 0; j < reference->numCellsY; ++j) {
+                    int isSolid = is_scene_solid(i, j, reference->numCellsX, reference->numCellsY, gridSize);
+                    fluid_slabs_set_obstacle(slabs, i, j, isSolid ? 0.0f : 1.0f);
+                }
+            }
+
+            int ok = 1;
+            for (int step = 0; step < config->numWarmupSteps + config->numSteps && ok; ++step) {
+                if (step == config->numWarmupSteps) start = SDL_GetPerformanceCounter();
+                emit_slabs(slabs, reference->numCellsY, step);
+                ok = fluid_slabs_simulate_step(slabs, config->numIterations, deltaTime, 0.0f, 1.9f, 0.99f, 0.999f);
+            }
+            double seconds = seconds_since(start);
+
+            if (ok) {
+                printf("%6d %6d %9.6f %10.1f %10.1f %9.2f %12.2e\n", gridSize, numSlabs, deltaTime, config->numSteps / seconds,
+                       config->numSteps / referenceSeconds, referenceSeconds / seconds, slab_difference(slabs, reference, values));
+                fflush(stdout);
+            }
+            fluid_slabs_free(slabs);
+            if (!ok) {
+                fluid_free(reference);
+                free(values);
+                return 0;
+            }
+        }
+
+        fluid_free(reference);
+        free(values);
+    }
+    return 1;
+}
+
+static void run_steps(Fluid* fluid, const BenchConfig* config, int firstStep, int endStep) {
+    for (int step = firstStep; step < endStep; ++step) {
+        emit(fluid, step);
+        fluid_simulate_step(fluid, config->numIterations, config->deltaTime, 0.0f, 1.9f, 0.99f, 0.999f);
+    }
+}
+
+/**
+ * Saves a checkpoint halfway through the run and finishes it, then resumes the checkpoint twice and finishes
+ * those runs too. All three must end with the same smoke checksum; the second resume also shows that the
+ * first one only changed its private copy-on-write pages, not the file.
+ */
+static int run_checkpoint_sweep(const BenchConfig* config) {
+    printf("checkpoint %s saved after step %d\n", config->checkpointPath, config->numWarmupSteps + config->numSteps / 2);
+    printf("%6s %7s %9s %9s %10s %18s %8s\n", "grid", "threads", "MB", "save ms", "resume ms", "checksum", "resumed");
+
+    int endStep = config->numWarmupSteps + config->numSteps;
+    int saveStep = config->numWarmupSteps + config->numSteps / 2;
+
+    for (int s = 0; s < config->numGridSizes; ++s) {
+        int gridSize = config->gridSizes[s];
+
+        for (int t = 0; t < config->numThreadCounts; ++t) {
+            int numThreads = config->threadCounts[t];
+            Fluid* fluid = create_scene(config, gridSize, numThreads, config->smokeStorage);
+            if (fluid == NULL) {
+                printf("ERROR: failed to create a %dx%d fluid\n", gridSize, gridSize);
+                return 0;
+            }
+
+            run_steps(fluid, config, 0, saveStep);
+            Uint64 start = SDL_GetPerformanceCounter();
+            int saved = fluid_save_checkpoint(fluid, config->checkpointPath);
+            double saveSeconds = seconds_since(start);
+            double megabytes = (double)fluid->arenaSize / (1024.0 * 1024.0);
+            run_steps(fluid, config, saveStep, endStep);
+            uint64_t checksum = fluid_smoke_checksum(fluid);
+            fluid_free(fluid);
+            if (!saved) return 0;
+
+            double resumeSeconds = 0.0;
+            int numMatching = 0;
+            for (int resume = 0; resume < 2; ++resume) {
+                start = SDL_GetPerformanceCounter();
+                Fluid* resumed = fluid_load_checkpoint(config->checkpointPath);
+                if (resume == 0) resumeSeconds = seconds_since(start);
+                if (resumed == NULL) return 0;
+
+                fluid_set_num_threads(resumed, numThreads);
+                run_steps(resumed, config, saveStep, endStep);
+                if (fluid_smoke_checksum(resumed) == checksum) ++numMatching;
+                fluid_free(resumed);
+            }
+
+            printf("%6d %7d %9.1f %9.2f %10.3f   %016llx %8s\n", gridSize, numThreads, megabytes, saveSeconds * 1e3,
+                   resumeSeconds * 1e3, (unsigned long long)checksum, numMatching == 2 ? "match" : "DIFFER");
+            fflush(stdout);
+            if (numMatching != 2) return 0;
+        }
+    }
+    return 1;
+}
+
+static int run_benchmark(const BenchConfig* config, int gridSize, int numThreads, BenchResult* result) {
+    memset(result, 0, sizeof(BenchResult));
+
+    // whole steps
+    Fluid* fluid = create_scene(config, gridSize, numThreads, config->smokeStorage);
+    if (fluid == NULL) return 0;
+
+    for (int step = 0; step < config->numWarmupSteps; ++step) {
+        emit(fluid, step);
+        fluid_simulate_step(fluid, config->numIterations, config->deltaTime, 0.0f, 1.9f, 0.99f, 0.999f);
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int step = config->numWarmupSteps; step < config->numWarmupSteps + config->numSteps; ++step) {
+        emit(fluid, step);
+        fluid_simulate_step(fluid, config->numIterations, config->deltaTime, 0.0f, 1.9f, 0.99f, 0.999f);
+    }
+    result->stepSeconds = seconds_since(start);
+
+    int ok = config->smokeStorage == SMOKE_STORAGE_FLOAT32 || measure_smoke_error(config, fluid, gridSize, numThreads, result);
+    fluid_free(fluid);
+    if (!ok) return 0;
+
+    // the same steps phase by phase
+    fluid = create_scene(config, gridSize, numThreads, config->smokeStorage);
+    if (fluid == NULL) return 0;
+
+    double warmupSeconds[NUM_PHASES] = { 0 };
+    run_phases(fluid, config, 0, config->numWarmupSteps, warmupSeconds);
+    run_phases(fluid, config, config->numWarmupSteps, config->numSteps, result->phaseSeconds);
+    fluid_free(fluid);
+
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+
+    BenchConfig config;
+    if (!parse_args(argc, argv, &config)) return 1;
+
+    Fluid* probe = fluid_init(1.0f, 8, 8, 1.0f / 8, PRESSURE_SOLVER_GAUSS_SEIDEL);
+    if (probe == NULL) return 1;
+    printf("solver %s, %d iterations, %d steps (+%d warmup), dt %.4f, kernels %s, advection %s, smoke %s\n",
+           solver_name(config.solver), config.numIterations, config.numSteps, config.numWarmupSteps,
+           config.deltaTime, probe->kernels->name,
+           config.advectionScheme == ADVECTION_MACCORMACK ? "maccormack" : "semi-lagrangian", storage_name(config.smokeStorage));
+    fluid_free(probe);
+
+    if (config.checkpointPath != NULL) return run_checkpoint_sweep(&config) ? 0 : 1;
+    if (config.sparse) return run_sparse_sweep(&config) ? 0 : 1;
+    if (config.numSlabCounts > 0) return run_slab_sweep(&config) ? 0 : 1;
+    if (config.ensembleSize > 0) return run_ensemble_sweep(&config) ? 0 : 1;
+
+    printf("%6s %7s %10s %9s |", "grid", "threads", "steps/s", "ns/cell");
+    for (int phase = 0; phase < NUM_PHASES; ++phase) {
+        printf(" %11s", PHASE_NAMES[phase]);
+    }
+    if (config.smokeStorage != SMOKE_STORAGE_FLOAT32) printf(" | %10s %10s %9s %6s", "err max", "err rms", "arena MB", "saved");
+    printf("   (phases in ns/cell)\n");
+
+    for (int s = 0; s < config.numGridSizes; ++s) {
+        int gridSize = config.gridSizes[s];
+        double cellSteps = (double)gridSize * gridSize * config.numSteps;
+
+        for (int t = 0; t < config.numThreadCounts; ++t) {
+            BenchResult result;
+            if (!run_benchmark(&config, gridSize, config.threadCounts[t], &result)) {
+                printf("ERROR: failed to create a %dx%d fluid\n", gridSize, gridSize);
+                return 1;
+            }
+
+            printf("%6d %7d %10.1f %9.2f |", gridSize, config.threadCounts[t],
+                   config.numSteps / result.stepSeconds, result.stepSeconds * 1e9 / cellSteps);
+            for (int phase = 0; phase < NUM_PHASES; ++phase) {
+                printf(" %11.2f", result.phaseSeconds[phase] * 1e9 / cellSteps);
+            }
+            if (config.smokeStorage != SMOKE_STORAGE_FLOAT32) {
+                printf(" | %10.2e %10.2e %9.1f %5.1f%%", result.smokeErrorMax, result.smokeErrorRms, result.arenaBytes / (1024.0 * 1024.0),
+                       100.0 * (1.0 - result.arenaBytes / result.referenceArenaBytes));
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef FLUID_CHECKPOINT_H
+#define FLUID_CHECKPOINT_H
+
+#include <stddef.h>
+#include "fluid_logic.h"
+
+// bytes of the header page in front of the arena, a multiple of every common page size
+#define FLUID_CHECKPOINT_HEADER_BYTES 4096
+
+
+/**
+ * Checkpoints store a Fluid as one header page followed by its arena byte for byte, so loading maps the
+ * file instead of parsing it. The header holds the grid size, the settings and the position of every field
+ * in the arena (advection swaps the front and back buffers). Values are in the byte order of the machine
+ * that saved them; loading a checkpoint from a machine with the other byte order or another layout version fails.
+ */
+
+/**
+ * Writes the fluid's state to path. Returns 0 on failure.
+ */
+int fluid_save_checkpoint(const Fluid* fluidPtr, const char* path);
+
+/**
+ * Creates a fluid from a checkpoint. The file is mapped copy-on-write and used directly as the arena:
+ * fields are read from the file as they are touched, and changes stay private to the process.
+ * The fluid runs on one thread with the best kernels for this CPU, like a new one from fluid_init.
+ */
+Fluid* fluid_load_checkpoint(const char* path);
+
+/**
+ * Unmaps an arena mapped by fluid_load_checkpoint. Called by fluid_free.
+ */
+void fluid_checkpoint_unmap(void* mapping, size_t mappingSize);
+
+#endif
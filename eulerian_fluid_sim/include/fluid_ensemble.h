@@ -0,0 +1,67 @@
+#ifndef FLUID_ENSEMBLE_H
+#define FLUID_ENSEMBLE_H
+
+#include "fluid_logic.h"
+
+
+/**
+ * Many small fluids of the same size stepped together, for parameter sweeps.
+ * The members' arenas lie back to back in one allocation and their step parameters are kept as one array per
+ * parameter. Each member runs on one thread; fluid_ensemble_simulate hands the members to the worker threads
+ * through per-thread queues, and a thread that runs out of members steals half of the members left in another
+ * thread's queue, so members that converge slowly don't leave cores idle.
+ * A member's result doesn't depend on the number of threads or the order the members ran in.
+ */
+typedef struct FluidEnsemble FluidEnsemble;
+
+/**
+ * Called before every step of a member, e.g. to add smoke. Runs on the worker thread stepping the member.
+ */
+typedef void (*FluidEnsembleStepFunction)(void* userData, int memberIndex, Fluid* member, int step);
+
+/**
+ * Throughput of the last fluid_ensemble_simulate.
+ */
+typedef struct {
+    double seconds;
+    long long memberSteps;          // steps summed over all members
+    double memberStepsPerSecond;    // sims * steps / sec
+    int numSteals;
+} FluidEnsembleStatistics;
+
+/**
+ * Creates numMembers fluids like fluid_init and numThreads worker threads (the calling thread counts as one).
+ * Every member starts with gravity -9.81, over-relaxation 1.9, dissipation 1 and smoke dissipation 1.
+ * The members store smoke as smokeStorage, which has to be set before their arenas are gathered into one block.
+ */
+FluidEnsemble* fluid_ensemble_create(int numMembers, float density, int numX, int numY, float cellSize,
+                                     PressureSolverType pressureSolver, SmokeStorage smokeStorage, int numThreads);
+
+/**
+ * Stops the worker threads and frees every member.
+ */
+void fluid_ensemble_free(FluidEnsemble* ensemble);
+
+int fluid_ensemble_num_members(const FluidEnsemble* ensemble);
+
+/**
+ * Returns a member to set up or read between steps. Its settings (solver tolerance, advection scheme, ...)
+ * can be changed like any Fluid's, but it stays on one thread and must not be freed.
+ */
+Fluid* fluid_ensemble_member(FluidEnsemble* ensemble, int memberIndex);
+
+/**
+ * Sets the parameters fluid_simulate_step is called with for a member.
+ */
+void fluid_ensemble_set_parameters(FluidEnsemble* ensemble, int memberIndex, float gravityForce,
+                                   float overRelaxation, float dissipation, float smokeDissipation);
+
+/**
+ * Runs numSteps steps of every member with its own parameters. stepFunction may be NULL.
+ */
+void fluid_ensemble_simulate(FluidEnsemble* ensemble, int numSteps, int numIterations, float deltaTime,
+                             FluidEnsembleStepFunction stepFunction, void* userData);
+
+void fluid_ensemble_statistics(const FluidEnsemble* ensemble, FluidEnsembleStatistics* statistics);
+
+#endif
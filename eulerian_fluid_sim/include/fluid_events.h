@@ -0,0 +1,71 @@
+#ifndef FLUID_EVENTS_H
+#define FLUID_EVENTS_H
+
+#include "fluid_logic.h"
+
+
+/**
+ * Enum for the input commands applied to a fluid between steps.
+ */
+typedef enum {
+    FLUID_COMMAND_ADD_SMOKE,
+    FLUID_COMMAND_ADD_FORCE
+} FluidCommandType;
+
+/**
+ * Input for one fluid cell. ADD_SMOKE adds amount to the smoke (capped at 1),
+ * ADD_FORCE adds (forceX, forceY) to the cell's velocities. The cell is clamped to the interior
+ * and solid cells are skipped.
+ */
+typedef struct {
+    FluidCommandType type;
+    int cellX;
+    int cellY;
+    float amount;
+    float forceX;
+    float forceY;
+} FluidCommand;
+
+/**
+ * A command stamped with the number of steps that ran before it was applied.
+ */
+typedef struct {
+    long long step;
+    FluidCommand command;
+} FluidEvent;
+
+/**
+ * Commands in the order they were applied, with non-decreasing steps. Replaying a log into a fluid that
+ * starts from the same state gives the same fluid after every step, independent of timing.
+ *
+ * File layout (text, one event per line, values exact):
+ *   "fluid-events 1"
+ *   <step> smoke <cellX> <cellY> <amount>
+ *   <step> force <cellX> <cellY> <forceX> <forceY>
+ */
+typedef struct FluidEventLog FluidEventLog;
+
+void fluid_apply_command(Fluid* fluidPtr, const FluidCommand* command);
+
+FluidEventLog* fluid_event_log_create(void);
+void fluid_event_log_free(FluidEventLog* log);
+
+/**
+ * Adds an event at the end of the log. Returns 0 when out of memory or step is before the last event's.
+ */
+int fluid_event_log_append(FluidEventLog* log, long long step, const FluidCommand* command);
+
+int fluid_event_log_num_events(const FluidEventLog* log);
+const FluidEvent* fluid_event_log_events(const FluidEventLog* log);
+
+/**
+ * Writes the log to path. Returns 0 on failure.
+ */
+int fluid_event_log_save(const FluidEventLog* log, const char* path);
+
+/**
+ * Reads a log written by fluid_event_log_save. Returns NULL on failure.
+ */
+FluidEventLog* fluid_event_log_load(const char* path);
+
+#endif
@@ -2,6 +2,18 @@
 #define FLUID_LOGIC_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "fluid_threads.h"
+#include "fluid_simd.h"
+
+// alignment of the field arena and of every column in it (one cache line)
+#define FLUID_ARENA_ALIGNMENT 64
+
+// max red-black iterations done per pass over the grid in temporally blocked mode
+#define FLUID_MAX_TEMPORAL_BLOCK 32
+
+// side length in cells of the tiles used for active-region tracking
+#define FLUID_TILE_SIZE 16
 
 
 /**
@@ -13,16 +25,67 @@ typedef enum {
     SMOKE_FIELD
 } FieldType;
 
+/**
+ * Enum for the pressure solver used by fluid_solve_incompressibility.
+ */
+typedef enum {
+    PRESSURE_SOLVER_GAUSS_SEIDEL,
+    PRESSURE_SOLVER_RED_BLACK_SOR,
+    PRESSURE_SOLVER_PCG,
+    PRESSURE_SOLVER_MULTIGRID
+} PressureSolverType;
+
+/**
+ * Enum for the advection scheme used by fluid_advect_velocity and fluid_advect_smoke.
+ * MacCormack adds a backward trace and an error correction to the semi-Lagrangian pass, clamped to the
+ * values the semi-Lagrangian sample interpolated between. It is second order where the field is smooth
+ * but costs 3 to 4 times as much per pass, so it pays off by keeping more detail on a coarser grid.
+ */
+typedef enum {
+    ADVECTION_SEMI_LAGRANGIAN,
+    ADVECTION_MACCORMACK
+} AdvectionScheme;
+
+/**
+ * Enum for the number format smoke is stored in (see fluid_set_smoke_storage).
+ */
+typedef enum {
+    SMOKE_STORAGE_FLOAT32,
+    SMOKE_STORAGE_FLOAT16,
+    SMOKE_STORAGE_BFLOAT16
+} SmokeStorage;
+
+/**
+ * Assembled Poisson system for the PCG and multigrid solvers (see fluid_solver.h).
+ */
+typedef struct FluidPressureSystem FluidPressureSystem;
+
+/**
+ * Phase timings of fluid_simulate_step (see fluid_profile.h), NULL unless built with FLUID_ENABLE_PROFILING.
+ */
+typedef struct FluidProfile FluidProfile;
+
 /**
  * struct that holds grid-based data for simulation.
+ * Cell (i, j) of every field is at index i * rowStride + j. Columns are padded to rowStride,
+ * so totalNumCells counts the padding too. The new* fields are back buffers swapped with the
+ * front fields by the advection passes, so don't keep pointers to fields across steps.
  */
 typedef struct {
     
     int numCellsX;
     int numCellsY;
+    int rowStride;
     size_t totalNumCells;
     float cellSize;
 
+    // single 64-byte aligned allocation holding every field
+    void* arenaAllocation;
+    unsigned char* arena;
+    size_t arenaSize;
+    void* arenaMapping;         // checkpoint file mapped as the arena instead of arenaAllocation, see fluid_checkpoint.h
+    size_t arenaMappingSize;
+
     float* velocityX;
     float* velocityY;
     float* newVelocityX;
@@ -31,23 +94,157 @@ typedef struct {
     float* pressure;
 
     float density;
-    float* smokeDensity;
-    float* newSmokeDensity;
+
+    // the two smoke buffers are the last blocks of the arena, sized for smokeStorage: smokeHalf and newSmokeHalf
+    // are the same pointers read as 16-bit values, so swapping the float pointers also swaps them
+    SmokeStorage smokeStorage;
+    union { float* smokeDensity; uint16_t* smokeHalf; };
+    union { float* newSmokeDensity; uint16_t* newSmokeHalf; };
 
     float* solidFlags;
 
+    // MacCormack advection writes the corrected velocities here and swaps them in. Smoke advection uses correctionX
+    // (or correctionHalf) as scratch for its first pass, see fluid_advect_smoke
+    AdvectionScheme advectionScheme;
+    union { float* correctionX; uint16_t* correctionHalf; };
+    float* correctionY;
+
+    // obstacle cache derived from solidFlags, rebuilt before the next pass when fluid_set_obstacle changes a cell
+    uint64_t* fluidCellMask;    // bit (i * rowStride + j) is set for fluid cells
+    float* neighborScale;       // 1 / number of fluid neighbors of an interior fluid cell, 0 when it is not relaxed
+    int obstaclesDirty;
+
+    PressureSolverType pressureSolver;
+    FluidPressureSystem* pressureSystem;
+    FluidWorkerPool* workerPool;
+    const FluidKernels* kernels;
+    FluidProfile* profile;
+
+    // solver convergence settings and statistics of the last solve
+    float solverTolerance;
+    int warmStartPressure;
+    int lastSolverIterations;
+    float lastResidualMax;
+    float lastResidualL2;
+
+    // red-black iterations per pass over the grid (0 or 1 sweeps the grid once per iteration)
+    int temporalBlockIterations;
+
+    /* FLUID_TILE_SIZE x FLUID_TILE_SIZE tiles of cells, starting at cell (0, 0) so every tile column is one
+       cache line, stored column by column. Every tile stays active unless tracking is enabled. */
+    int numTilesX;
+    int numTilesY;
+    uint8_t* tileActive;        // tiles the passes work on: occupied tiles grown by one tile for advection reach
+    uint8_t* tileOccupied;      // tiles holding a velocity or smoke value above activityThreshold
+    int numActiveTiles;
+    int activeTilesEnabled;
+    float activityThreshold;
+
+    // per-column residual partials so parallel sweeps reduce in a fixed order
+    float* columnResidualMax;
+    double* columnResidualSquares;
+
+    // pressure change of the current red-black half-sweep
+    float* pressureDelta;
+
 } Fluid;
 
 /**
- * Initializes a new Fluid simulation.
+ * Initializes a new Fluid simulation that projects with the given pressure solver.
  */
-Fluid* fluid_init(float density, int numX, int numY, float cellSize);
+Fluid* fluid_init(float density, int numX, int numY, float cellSize, PressureSolverType pressureSolver);
 
 /**
  * Frees memory for Fluid struct.
  */
 void fluid_free(Fluid* fluidPtr);
 
+/**
+ * Copies every field into another FLUID_ARENA_ALIGNMENT aligned block of arenaSize bytes, such as shared memory,
+ * and releases the current one. The block stays owned by the caller, fluid_free doesn't free it.
+ */
+void fluid_move_arena(Fluid* fluidPtr, unsigned char* arena);
+
+/**
+ * Sets the number of threads used by the parallel passes (1 runs everything on the calling thread).
+ * The results are bitwise the same for any number of threads: the passes split the grid into whole columns
+ * (or tiles) that don't depend on each other within a pass, and the residuals are reduced per column and
+ * then summed in column order on the calling thread.
+ */
+void fluid_set_num_threads(Fluid* fluidPtr, int numThreads);
+
+
+/**
+ * Forces the instruction set of the grid kernels (chosen from the CPU by fluid_init).
+ * Returns 0 and keeps the current kernels when the CPU does not support the level.
+ */
+int fluid_set_simd_level(Fluid* fluidPtr, FluidSimdLevel level);
+
+/**
+ * Sets the max divergence at which the pressure solve stops early (0 always runs numIterations),
+ * and whether the previous step's pressure is used as the starting guess.
+ */
+void fluid_set_solver_tolerance(Fluid* fluidPtr, float tolerance, int warmStartPressure);
+
+/**
+ * Makes the red-black solver run numIterations iterations per pass over the grid, so the columns it
+ * works on stay in cache (clamped to FLUID_MAX_TEMPORAL_BLOCK, 0 or 1 disables it).
+ * Blocked passes run on the calling thread. The result is identical to the full sweeps,
+ * but the tolerance is only checked after each block.
+ */
+void fluid_set_temporal_blocking(Fluid* fluidPtr, int numIterations);
+
+/**
+ * Turns tracking of active tiles on or off. Tiles whose velocities and smoke, and those of their 8 neighbor
+ * tiles, are all within threshold of zero are skipped by dissipation, advection and fluid_render_smoke,
+ * and their values are dropped to zero. Tracking pauses while fluid_simulate_step runs with gravity.
+ */
+void fluid_set_active_tiles(Fluid* fluidPtr, int enabled, float threshold);
+
+/**
+ * Selects the advection scheme (semi-Lagrangian by default).
+ */
+void fluid_set_advection_scheme(Fluid* fluidPtr, AdvectionScheme scheme);
+
+/**
+ * Stores smoke as fp32 (the default), fp16 or bf16 and converts the current smoke. The 16-bit formats halve
+ * the bytes the smoke passes read and write; the passes still compute in fp32 and round once per stored value.
+ * fp16 keeps about 3 decimal digits of the usual [0, 1] densities, bf16 about 2.
+ * The arena is reallocated with smoke buffers of 2 bytes per cell, which saves 4 of the about 48 bytes it takes
+ * per cell, so call this before fluid_move_arena. While smoke is 16-bit, smokeDensity points at the 16-bit values:
+ * use fluid_get_smoke and fluid_set_smoke. The storage is left unchanged when the new arena can't be allocated.
+ */
+void fluid_set_smoke_storage(Fluid* fluidPtr, SmokeStorage storage);
+
+/**
+ * Bytes each of the two smoke buffers at the end of the arena takes with smoke stored as storage.
+ */
+size_t fluid_smoke_buffer_bytes(const Fluid* fluidPtr, SmokeStorage storage);
+
+/**
+ * Reads or writes the smoke of cell (x, y) in any storage format. Cells outside the grid read as 0.
+ */
+float fluid_get_smoke(const Fluid* fluidPtr, int x, int y);
+void fluid_set_smoke(Fluid* fluidPtr, int x, int y, float amount);
+
+/**
+ * 16-bit format of smokeHalf, for callers that decode it with the kernels.
+ */
+static inline FluidHalfFormat fluid_smoke_half_format(const Fluid* fluidPtr) {
+    return fluidPtr->smokeStorage == SMOKE_STORAGE_BFLOAT16 ? FLUID_HALF_BFLOAT16 : FLUID_HALF_FLOAT16;
+}
+
+/**
+ * Recomputes the active tiles from the current fields (all tiles when tracking is off).
+ * Called by fluid_simulate_step after the pressure solve.
+ */
+void fluid_update_active_tiles(Fluid* fluidPtr);
+
+/**
+ * Scales velocities and smoke by their dissipation, applies gravity and zeroes the velocities of solid cells,
+ * all in one sweep over the active tiles. fluid_simulate_step runs this before the pressure solve.
+ */
+void fluid_prepare_projection(Fluid* fluidPtr, float deltaTime, float gravityForce, float dissipation, float smokeDissipation);
 
 /**
  * Applies gravity to fluid's velocity field.
@@ -56,11 +253,27 @@ void fluid_integrate(Fluid* fluid, float deltaTime, float gravityForce);
 
 /**
  * Adjusts variables to account for incompressibility.
+ * The red-black solver relaxes all cells of one checkerboard color in parallel, then the other.
+ * For the PCG and multigrid solvers numIterations caps the CG iterations or V-cycles.
+ * Returns the number of iterations used; the final residual is stored in lastResidualMax/L2.
+ */
+int fluid_solve_incompressibility(Fluid* fluidPtr, int numIterations, float overRelaxation);
+
+/**
+ * The steps of a red-black solve, for callers that run the iterations themselves (see fluid_slabs.h).
+ * fluid_begin_pressure_solve rebuilds the obstacle cache and sets up the starting pressure. Each iteration then
+ * runs, for color 0 and then 1, fluid_relax_color, which stores the pressure change of every interior cell of that
+ * color in pressureDelta, and fluid_apply_pressure_delta, which pushes it into the faces of columns [1, numCellsX).
+ * After color 1, fluid_sweep_residual returns the max divergence of the iteration and adds its squares to residualSquares.
  */
-void fluid_solve_incompressibility(Fluid* fluidPtr, int numIterations, float overRelaxation);
+void fluid_begin_pressure_solve(Fluid* fluidPtr);
+void fluid_relax_color(Fluid* fluidPtr, int color, float overRelaxation);
+void fluid_apply_pressure_delta(Fluid* fluidPtr);
+float fluid_sweep_residual(const Fluid* fluidPtr, double* residualSquares);
 
 /**
  * Extrapolates velocities to the edge of the fluid grid.
+ * fluid_prepare_projection already does this, so it's only needed after writing velocities of solid cells.
  */
 void fluid_extrapolate(Fluid* fluidPtr);
 
@@ -70,17 +283,20 @@ void fluid_extrapolate(Fluid* fluidPtr);
 float fluid_sample_field(Fluid* fluidPtr, float xPos, float yPos, FieldType fieldType);
 
 /**
- * Advects the fluid's velocity field.
+ * Advects the fluid's velocity field, split into column strips across the worker pool.
+ * Inactive tiles are set to zero.
  */
 void fluid_advect_velocity(Fluid* fluidPtr, float deltaTime);
 
 /**
- * Advects the smoke density field.
+ * Advects the smoke density field, split into column strips across the worker pool.
+ * Inactive tiles are set to zero.
  */
 void fluid_advect_smoke(Fluid* fluidPtr, float deltaTime);
 
 /**
  * Sets a cell as an obstacle (solid) or fluid.
+ * The obstacle cache is only rebuilt when a flag actually changes.
  */
 void fluid_set_obstacle(Fluid* fluidPtr, int x, int y, float isSolidFlag);
 
@@ -89,4 +305,22 @@ void fluid_set_obstacle(Fluid* fluidPtr, int x, int y, float isSolidFlag);
  */
 void fluid_simulate_step(Fluid* fluid, int numIterations, float deltaTime, float gravityForce, float overRelaxation, float dissipation, float smokeDissipation);
 
+/**
+ * 64-bit FNV-1a hash of the smoke of every cell as stored (fp32 or 16-bit bits), column by column.
+ * Equal fluids give equal checksums, so a per-step checksum shows at which step two runs diverge.
+ */
+uint64_t fluid_smoke_checksum(const Fluid* fluidPtr);
+
+/**
+ * Returns the largest velocity component magnitude on the grid.
+ */
+float fluid_max_velocity(const Fluid* fluidPtr);
+
+/**
+ * Returns how many equal substeps deltaTime has to be split into so that no velocity moves
+ * more than maxCflNumber cells per substep, clamped to [1, maxSubsteps].
+ * A maxCflNumber of 0 or less always gives 1.
+ */
+int fluid_cfl_substeps(const Fluid* fluidPtr, float deltaTime, float maxCflNumber, int maxSubsteps);
+
 #endif
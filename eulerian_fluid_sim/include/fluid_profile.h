@@ -0,0 +1,103 @@
+#ifndef FLUID_PROFILE_H
+#define FLUID_PROFILE_H
+
+#include "fluid_logic.h"
+
+// number of recent samples per phase kept for the percentiles
+#define FLUID_PROFILE_HISTORY 512
+
+
+/**
+ * Phases of fluid_simulate_step that are timed.
+ */
+typedef enum {
+    FLUID_PHASE_PREPARE,
+    FLUID_PHASE_SOLVE,
+    FLUID_PHASE_ACTIVE_TILES,
+    FLUID_PHASE_ADVECT_VELOCITY,
+    FLUID_PHASE_ADVECT_SMOKE,
+    FLUID_NUM_PHASES
+} FluidPhase;
+
+/**
+ * Summary of one phase since the last reset. Times are in milliseconds,
+ * the percentiles cover the last FLUID_PROFILE_HISTORY calls.
+ */
+typedef struct {
+    const char* name;
+    long long numCalls;
+    double totalMilliseconds;
+    double p50Milliseconds;
+    double p99Milliseconds;
+    long long cellsTouched;
+    double nanosecondsPerCell;
+} FluidPhaseStats;
+
+/**
+ * Allocates the profile of a fluid. Called by fluid_init when FLUID_ENABLE_PROFILING is defined.
+ */
+FluidProfile* fluid_profile_create(void);
+
+/**
+ * Frees a profile.
+ */
+void fluid_profile_free(FluidProfile* profile);
+
+/**
+ * Returns the current value of the profiling clock.
+ */
+uint64_t fluid_profile_now(void);
+
+/**
+ * Adds one call of a phase that started at startTicks and touched numCells cells.
+ */
+void fluid_profile_record(FluidProfile* profile, FluidPhase phase, uint64_t startTicks, size_t numCells);
+
+/**
+ * Adds the iterations of one pressure solve.
+ */
+void fluid_profile_record_solve(FluidProfile* profile, int numIterations);
+
+/**
+ * Clears all samples and counters.
+ */
+void fluid_profile_reset(Fluid* fluidPtr);
+
+/**
+ * Fills the summary of a phase. Returns 0 when profiling is not compiled in.
+ */
+int fluid_profile_phase_stats(const Fluid* fluidPtr, FluidPhase phase, FluidPhaseStats* stats);
+
+/**
+ * Returns the number of simulation steps recorded since the last reset.
+ */
+long long fluid_profile_num_steps(const Fluid* fluidPtr);
+
+/**
+ * Returns the number of pressure solver iterations recorded since the last reset.
+ */
+long long fluid_profile_solver_iterations(const Fluid* fluidPtr);
+
+/**
+ * Writes every phase summary to a CSV file. Returns 0 on failure.
+ */
+int fluid_profile_write_csv(const Fluid* fluidPtr, const char* path);
+
+/**
+ * Writes every phase summary to a JSON file. Returns 0 on failure.
+ */
+int fluid_profile_write_json(const Fluid* fluidPtr, const char* path);
+
+/* Timers around the hot phases. They compile to nothing unless FLUID_ENABLE_PROFILING is defined,
+   so the default build pays nothing for them. */
+#ifdef FLUID_ENABLE_PROFILING
+#define FLUID_PROFILE_START(startVar) uint64_t startVar = fluid_profile_now()
+#define FLUID_PROFILE_STOP(fluidPtr, phase, startVar, numCells) fluid_profile_record((fluidPtr)->profile, (phase), (startVar), (numCells))
+#define FLUID_PROFILE_SOLVE(fluidPtr, numIterations) fluid_profile_record_solve((fluidPtr)->profile, (numIterations))
+#else
+#define FLUID_PROFILE_START(startVar) ((void)0)
+#define FLUID_PROFILE_STOP(fluidPtr, phase, startVar, numCells) ((void)(numCells))
+#define FLUID_PROFILE_SOLVE(fluidPtr, numIterations) ((void)(numIterations))
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef FLUID_RECORDER_H
+#define FLUID_RECORDER_H
+
+#include <stdint.h>
+#include "fluid_logic.h"
+
+// capture buffers allocated when the settings leave numBuffers at 0
+#define FLUID_RECORDER_DEFAULT_BUFFERS 4
+
+
+/**
+ * Records fluid states to a file without holding up the simulation.
+ * fluid_recorder_capture copies the fields into one of a fixed set of preallocated buffers and returns,
+ * a writer thread encodes and writes them. When every buffer is still waiting for the writer the frame is
+ * dropped and counted instead of blocking.
+ *
+ * File layout (little-endian):
+ *   header:  "FLUIDREC", version, numCellsX, numCellsY, cellSize, fields, precision, keyframeInterval, reserved
+ *   frames:  "FRME", flags (1 = keyframe), step, payload bytes, then per field its encoded bytes and the encoding
+ *   index:   per frame its step, file offset and flags
+ *   trailer: index offset, number of frames, "FLUIDIDX"
+ * Each field holds numCellsX * numCellsY values, cell (i, j) at i * numCellsY + j, quantized to fp32 or fp16 bits.
+ * Frames between keyframes store the difference to the bits of the previous frame, and every field is
+ * encoded as runs of (zero words, literal words) so unchanged and empty regions take almost no space.
+ */
+typedef struct FluidRecorder FluidRecorder;
+
+/**
+ * Fields a recording holds, combined as bit flags.
+ */
+typedef enum {
+    FLUID_RECORD_SMOKE = 1,
+    FLUID_RECORD_VELOCITY = 2       // velocityX and velocityY
+} FluidRecordFields;
+
+/**
+ * Precision of the stored values. FLOAT32 is lossless, FLOAT16 halves the data.
+ */
+typedef enum {
+    FLUID_RECORD_FLOAT32,
+    FLUID_RECORD_FLOAT16
+} FluidRecordPrecision;
+
+/**
+ * What a recorder writes. Every keyframeInterval-th frame is stored whole, the others as differences
+ * (0 or 1 stores every frame whole). numBuffers is the number of frames that can wait for the writer.
+ */
+typedef struct {
+    int fields;
+    FluidRecordPrecision precision;
+    int keyframeInterval;
+    int numBuffers;
+} FluidRecorderSettings;
+
+/**
+ * Frame counters of a recorder.
+ */
+typedef struct {
+    long long framesCaptured;
+    long long framesDropped;
+    long long framesWritten;
+    long long bytesWritten;
+} FluidRecorderStats;
+
+/**
+ * Creates the file and starts the writer thread for a fluid of this size.
+ */
+FluidRecorder* fluid_recorder_create(const char* path, const Fluid* fluidPtr, const FluidRecorderSettings* settings);
+
+/**
+ * Queues the current fields of the fluid as a frame of the given step. Must be called from a single thread.
+ * Returns 0 when the frame was dropped because no buffer was free.
+ */
+int fluid_recorder_capture(FluidRecorder* recorder, const Fluid* fluidPtr, long long step);
+
+/**
+ * Returns the counters so far. framesWritten and bytesWritten lag behind while the writer is busy.
+ */
+void fluid_recorder_stats(const FluidRecorder* recorder, FluidRecorderStats* stats);
+
+/**
+ * Writes the queued frames and the index, closes the file and frees the recorder.
+ * Returns 0 when anything failed to write.
+ */
+int fluid_recorder_close(FluidRecorder* recorder);
+
+
+/**
+ * A recording opened for reading.
+ */
+typedef struct FluidRecording FluidRecording;
+
+/**
+ * Header of a recording.
+ */
+typedef struct {
+    int numCellsX;
+    int numCellsY;
+    float cellSize;
+    int fields;
+    FluidRecordPrecision precision;
+    int keyframeInterval;
+    long long numFrames;
+} FluidRecordingInfo;
+
+/**
+ * Opens a recording and reads its index.
+ */
+FluidRecording* fluid_recording_open(const char* path);
+
+/**
+ * Closes the recording.
+ */
+void fluid_recording_close(FluidRecording* recording);
+
+/**
+ * Returns the header of the recording.
+ */
+const FluidRecordingInfo* fluid_recording_info(const FluidRecording* recording);
+
+/**
+ * Returns the simulation step a frame was captured at, -1 when the frame does not exist.
+ */
+long long fluid_recording_frame_step(const FluidRecording* recording, long long frame);
+
+/**
+ * Decodes a frame into arrays of numCellsX * numCellsY values (cell (i, j) at i * numCellsY + j).
+ * Fields passed as NULL or not recorded are skipped. Frames read in order decode from the previous one,
+ * others from the nearest keyframe before them. Returns 0 on a read error.
+ */
+int fluid_recording_read_frame(FluidRecording* recording, long long frame, float* smoke, float* velocityX, float* velocityY);
+
+#endif
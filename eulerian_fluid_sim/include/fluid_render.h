@@ -0,0 +1,22 @@
+#ifndef FLUID_RENDER_H
+#define FLUID_RENDER_H
+
+#include <stdint.h>
+#include "fluid_logic.h"
+#include "fluid_sparse.h"
+
+
+/**
+ * Converts the smoke density of the interior cells into 0x00RRGGBB gray pixels, one pixel per cell.
+ * The image is (numCellsX - 2) x (numCellsY - 2) with the top row first, pitch is the row length in pixels.
+ * Runs across the fluid's worker pool; inactive tiles are drawn black without reading the grid.
+ */
+void fluid_render_smoke(const Fluid* fluidPtr, uint32_t* pixels, int pitch);
+
+/**
+ * Converts the smoke of a width x height window of a sparse grid, whose bottom left cell is (firstX, firstY),
+ * into pixels like fluid_render_smoke. Cells outside the allocated tiles are black.
+ */
+void fluid_sparse_render_smoke(const FluidSparse* sparse, uint32_t* pixels, int pitch, int firstX, int firstY, int width, int height);
+
+#endif
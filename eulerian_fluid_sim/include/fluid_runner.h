@@ -0,0 +1,101 @@
+#ifndef FLUID_RUNNER_H
+#define FLUID_RUNNER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "fluid_logic.h"
+#include "fluid_events.h"
+#include "fluid_recorder.h"
+
+// number of commands the input queue holds (power of two)
+#define FLUID_COMMAND_QUEUE_SIZE 1024
+
+
+/**
+ * Runs a fluid simulation on its own thread at a fixed rate.
+ * Elapsed wall-clock time is accumulated and consumed in steps of exactly 1 / stepsPerSecond, each split
+ * into CFL-limited substeps, so a stall never turns into one huge step.
+ * Input goes to the simulation through a single-producer command queue and the state after each batch
+ * of steps is published as a snapshot through a lock-free triple buffer, so neither side ever waits for the other.
+ *
+ * Wall-clock time only decides when steps run, not what they compute: a step depends on the fluid, the settings
+ * and the commands applied before it. Recording the applied commands to an event log and replaying it, on the
+ * runner thread or with fluid_runner_run_steps, reproduces every step bit for bit on any number of threads.
+ */
+typedef struct FluidRunner FluidRunner;
+
+/**
+ * Parameters passed to fluid_simulate_step, plus the scheduling limits.
+ * A step is split into substeps so that velocities move at most maxCflNumber cells per substep (0 disables this),
+ * but never into more than maxSubsteps. After a stall at most maxCatchUpSteps steps are run back to back,
+ * the rest of the missed time is dropped. Dissipation factors are per step and spread over the substeps.
+ * When recorder is not NULL every step is captured to it; it must outlive the runner.
+ * With replayEvents the commands come from the log at their step and pushed commands are dropped; otherwise
+ * every applied command is appended to recordEvents when it is not NULL. When checksumFile is not NULL,
+ * "<step> <fluid_smoke_checksum>" is written to it after every step. All of them must outlive the runner.
+ */
+typedef struct {
+    float stepsPerSecond;
+    float maxCflNumber;
+    int maxSubsteps;
+    int maxCatchUpSteps;
+
+    int numIterations;
+    float gravityForce;
+    float overRelaxation;
+    float dissipation;
+    float smokeDissipation;
+
+    FluidRecorder* recorder;
+    FluidEventLog* recordEvents;
+    const FluidEventLog* replayEvents;
+    FILE* checksumFile;
+} FluidRunnerSettings;
+
+/**
+ * State of the simulation after a batch of steps. pixels holds the smoke as drawn by fluid_render_smoke,
+ * the counters are totals since the runner started.
+ */
+typedef struct {
+    uint32_t* pixels;
+    int width;
+    int height;
+
+    long long step;
+    long long totalSubsteps;
+    long long totalSolverIterations;
+    long long droppedSteps;
+    float residualMax;
+    uint64_t smokeChecksum;
+} FluidSnapshot;
+
+/**
+ * Starts stepping the fluid on a new thread. The fluid must not be touched by the caller until
+ * fluid_runner_free returns, and is not freed by the runner.
+ */
+FluidRunner* fluid_runner_create(Fluid* fluidPtr, const FluidRunnerSettings* settings);
+
+/**
+ * Stops the simulation thread and frees the runner.
+ */
+void fluid_runner_free(FluidRunner* runner);
+
+/**
+ * Runs numSteps steps like the runner thread, but back to back on the calling thread without looking at the clock.
+ * Commands come from settings->replayEvents, if any. Returns the number of steps run (0 when out of memory).
+ */
+long long fluid_runner_run_steps(Fluid* fluidPtr, const FluidRunnerSettings* settings, long long numSteps);
+
+/**
+ * Queues a command for the next step. Must be called from a single thread.
+ * Returns 0 when the command was dropped because the queue is full or the runner replays events.
+ */
+int fluid_runner_push_command(FluidRunner* runner, const FluidCommand* command);
+
+/**
+ * Returns the newest published snapshot. Must be called from a single thread; the snapshot
+ * stays valid until the next call.
+ */
+const FluidSnapshot* fluid_runner_latest_snapshot(FluidRunner* runner);
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef FLUID_SIMD_H
+#define FLUID_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+/**
+ * Instruction sets the grid kernels can run on.
+ */
+typedef enum {
+    FLUID_SIMD_SCALAR,
+    FLUID_SIMD_SSE4,
+    FLUID_SIMD_AVX2,
+    FLUID_SIMD_NEON
+} FluidSimdLevel;
+
+/**
+ * 16-bit float formats of fields stored at reduced precision.
+ * fp16 keeps 11 significant bits over a range of about 6e-8 to 65504, bf16 keeps 8 bits over the whole fp32 range.
+ */
+typedef enum {
+    FLUID_HALF_FLOAT16,
+    FLUID_HALF_BFLOAT16
+} FluidHalfFormat;
+
+/**
+ * One column of a red-black relaxation half-sweep.
+ * Rows [firstRow, lastRow) are visited; a row is relaxed when (row & 1) == rowParity.
+ * Every visited row of pressureDelta is written (0 for rows that were not relaxed).
+ * neighborScale holds 1 / (number of fluid neighbors) of each cell, 0 for cells that are not relaxed.
+ */
+typedef struct {
+    const float* neighborScale;
+    const float* velocityX;
+    const float* velocityXRight;
+    const float* velocityY;
+    float* pressure;
+    float* pressureDelta;
+
+    int firstRow;
+    int lastRow;
+    int rowParity;
+    float overRelaxation;
+
+    // outputs: residual of the relaxed cells
+    float residualMax;
+    double residualSquares;
+} FluidRelaxColumn;
+
+/**
+ * Table of grid kernels for one instruction set.
+ */
+typedef struct {
+    FluidSimdLevel level;
+    const char* name;
+
+    // values[k] += amount where solidFlags[k] == 1
+    void (*add_where_fluid)(float* values, const float* solidFlags, size_t count, float amount);
+
+    // valuesX[k] = valuesY[k] = 0 where solidFlags[k] == 0
+    void (*zero_where_solid)(float* valuesX, float* valuesY, const float* solidFlags, size_t count);
+
+    /* fused pre-projection pass: velocities and smoke are scaled by their dissipation, gravity is added to
+       velocityY[k] where solidFlags[k] == 1 and both velocities are zeroed where solidFlags[k] == 0.
+       smoke may be NULL when it is stored at reduced precision */
+    void (*prepare_cells)(float* velocityX, float* velocityY, float* smoke, const float* solidFlags, size_t count,
+                          float dissipation, float smokeDissipation, float gravity);
+
+    // returns the largest |values[column * columnStride + k]| of columns [0, numColumns), rows [0, count)
+    float (*max_abs)(const float* values, size_t count, int numColumns, size_t columnStride);
+
+    // computes the pressure change of one column of a red-black half-sweep
+    void (*relax_column)(FluidRelaxColumn* column);
+
+    // pushes the pressure changes of column i and i - 1 into the faces stored in column i (rows [firstRow, lastRow))
+    void (*apply_column)(float* velocityX, float* velocityY, const float* solid, const float* solidLeft,
+                         const float* pressureDelta, const float* pressureDeltaLeft, int firstRow, int lastRow);
+
+    // values[k] = halves[k] converted to fp32
+    void (*decode_half)(const uint16_t* halves, float* values, size_t count, FluidHalfFormat format);
+
+    // halves[k] = values[k] rounded to the nearest 16-bit value (ties to even)
+    void (*encode_half)(const float* values, uint16_t* halves, size_t count, FluidHalfFormat format);
+
+    // halves[k] *= factor, computed in fp32
+    void (*scale_half)(uint16_t* halves, size_t count, float factor, FluidHalfFormat format);
+} FluidKernels;
+
+/**
+ * Rounds a float to the nearest fp16 value (ties to even), with subnormals, infinities and NaN.
+ */
+static inline uint16_t fluid_float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t exponent = (bits >> 23) & 0xffu;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (exponent == 0xffu) return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+
+    int halfExponent = (int)exponent - 127 + 15;
+    if (halfExponent >= 0x1f) return (uint16_t)(sign | 0x7c00u);
+
+    if (halfExponent <= 0) {
+        // subnormal half: the implicit bit moves into the mantissa
+        if (halfExponent < -10) return (uint16_t)sign;
+        mantissa |= 0x800000u;
+        int shift = 14 - halfExponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1u))) half++;
+        return (uint16_t)(sign | half);
+    }
+
+    // a carry out of the mantissa rounds up into the exponent, which is still the right value
+    uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fffu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) half++;
+    return (uint16_t)(sign | half);
+}
+
+static inline float fluid_half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+
+    // both cases are computed and one is selected, zeros and normal values mix too often to branch on
+    uint32_t normalBits = ((exponent == 0x1f ? 0xffu : exponent + 112) << 23) | (mantissa << 13);
+    float normal;
+    memcpy(&normal, &normalBits, sizeof(normal));
+    // zero or subnormal: mantissa * 2^-24
+    float subnormal = (float)mantissa * 5.9604644775390625e-8f;
+    float magnitude = exponent == 0 ? subnormal : normal;
+
+    uint32_t bits;
+    memcpy(&bits, &magnitude, sizeof(bits));
+    bits |= sign;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Rounds a float to the nearest bf16 value (ties to even). NaN stays NaN.
+ */
+static inline uint16_t fluid_float_to_bfloat16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) return (uint16_t)((bits >> 16) | 0x40u);
+
+    // adding 0x7fff plus the lowest kept bit carries into the kept bits exactly when rounding up
+    bits += 0x7fffu + ((bits >> 16) & 1u);
+    return (uint16_t)(bits >> 16);
+}
+
+static inline float fluid_bfloat16_to_float(uint16_t half) {
+    uint32_t bits = (uint32_t)half << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline float fluid_decode_half(uint16_t half, FluidHalfFormat format) {
+    return format == FLUID_HALF_BFLOAT16 ? fluid_bfloat16_to_float(half) : fluid_half_to_float(half);
+}
+
+static inline uint16_t fluid_encode_half(float value, FluidHalfFormat format) {
+    return format == FLUID_HALF_BFLOAT16 ? fluid_float_to_bfloat16(value) : fluid_float_to_half(value);
+}
+
+/**
+ * Decodes the pairs low[0], low[1] and high[0], high[1] into values[0..3], the 4 corners a bilinear sample of a
+ * 16-bit field reads. Samples land anywhere, so the corners are converted together instead of with a kernel call.
+ * SSE2 and NEON are part of the x86-64 and AArch64 baselines, so this needs no runtime dispatch.
+ */
+static inline void fluid_decode_half_corners(const uint16_t* low, const uint16_t* high, FluidHalfFormat format, float values[4]) {
+#if defined(__SSE2__)
+    int32_t lowPair, highPair;
+    memcpy(&lowPair, low, sizeof(lowPair));
+    memcpy(&highPair, high, sizeof(highPair));
+    __m128i halves = _mm_unpacklo_epi16(_mm_unpacklo_epi32(_mm_cvtsi32_si128(lowPair), _mm_cvtsi32_si128(highPair)),
+                                        _mm_setzero_si128());
+
+    if (format == FLUID_HALF_BFLOAT16) {
+        _mm_storeu_ps(values, _mm_castsi128_ps(_mm_slli_epi32(halves, 16)));
+        return;
+    }
+
+    // rebias the exponent; infinities and NaN get the fp32 maximum exponent, zeros and subnormals are renormalized
+    // by subtracting 2^-14 in fp32, which is exact and never produces an fp32 subnormal
+    const __m128i exponentMask = _mm_set1_epi32(0x7c00 << 13);
+    __m128i bits = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x7fff)), 13);
+    __m128i exponent = _mm_and_si128(bits, exponentMask);
+    bits = _mm_add_epi32(bits, _mm_set1_epi32((127 - 15) << 23));
+    bits = _mm_add_epi32(bits, _mm_and_si128(_mm_cmpeq_epi32(exponent, exponentMask), _mm_set1_epi32((128 - 16) << 23)));
+
+    __m128i isSmall = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+    __m128 renormalized = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(1 << 23))),
+                                     _mm_castsi128_ps(_mm_set1_epi32(113 << 23)));
+    bits = _mm_or_si128(_mm_and_si128(isSmall, _mm_castps_si128(renormalized)), _mm_andnot_si128(isSmall, bits));
+
+    bits = _mm_or_si128(bits, _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x8000)), 16));
+    _mm_storeu_ps(values, _mm_castsi128_ps(bits));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    uint32_t lowPair, highPair;
+    memcpy(&lowPair, low, sizeof(lowPair));
+    memcpy(&highPair, high, sizeof(highPair));
+    uint16x4_t halves = vcreate_u16((uint64_t)lowPair | ((uint64_t)highPair << 32));
+
+    if (format == FLUID_HALF_BFLOAT16) {
+        vst1q_f32(values, vreinterpretq_f32_u32(vshll_n_u16(halves, 16)));
+    } else {
+        vst1q_f32(values, vcvt_f32_f16(vreinterpret_f16_u16(halves)));
+    }
+#else
+    values[0] = fluid_decode_half(low[0], format);
+    values[1] = fluid_decode_half(low[1], format);
+    values[2] = fluid_decode_half(high[0], format);
+    values[3] = fluid_decode_half(high[1], format);
+#endif
+}
+
+/**
+ * Returns the kernels for the best instruction set supported by this CPU.
+ */
+const FluidKernels* fluid_kernels_best(void);
+
+/**
+ * Returns the kernels for the given instruction set, or NULL when this CPU or build does not support it.
+ */
+const FluidKernels* fluid_kernels_get(FluidSimdLevel level);
+
+#endif
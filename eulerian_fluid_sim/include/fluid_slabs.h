@@ -0,0 +1,67 @@
+#ifndef FLUID_SLABS_H
+#define FLUID_SLABS_H
+
+#include "fluid_logic.h"
+
+
+/**
+ * One grid split into slabs of columns, each simulated by its own worker process on the same machine.
+ * Slab k is a Fluid of its columns plus one halo column on each side that mirrors the neighbor slab's edge column.
+ * Every step runs the usual passes on each slab and exchanges the halos through shared memory:
+ *   - velocities, pressure and smoke before the step,
+ *   - the pressure change of every red-black half-sweep, so the slabs solve one system together,
+ *   - velocities after the solve and again after velocity advection.
+ * The processes wait for each other in a barrier after publishing each exchange, and the residuals are reduced
+ * over all slabs every iteration, so they agree on when the solve stops.
+ *
+ * The fields of every slab live in the shared memory too, so the creating process can read and edit them between steps.
+ * The pressure solve is red-black SOR and advection semi-Lagrangian. Advection only reads one column beyond a slab,
+ * so keep the steps at a CFL number of at most 1 (see fluid_cfl_substeps). POSIX only.
+ */
+typedef struct FluidSlabs FluidSlabs;
+
+/**
+ * Creates a numX x numY grid (plus the border, like fluid_init) split into numSlabs slabs of at least
+ * 2 interior columns, and starts one worker process per slab.
+ */
+FluidSlabs* fluid_slabs_create(float density, int numX, int numY, float cellSize, int numSlabs);
+
+/**
+ * Stops the worker processes and frees the grid.
+ */
+void fluid_slabs_free(FluidSlabs* slabs);
+
+/**
+ * Same as fluid_set_solver_tolerance, for every slab. Takes effect at the next step.
+ */
+void fluid_slabs_set_solver_tolerance(FluidSlabs* slabs, float tolerance, int warmStartPressure);
+
+/**
+ * Same as fluid_set_obstacle on the whole grid: updates the owning slab and the halo of its neighbor.
+ */
+void fluid_slabs_set_obstacle(FluidSlabs* slabs, int x, int y, float isSolidFlag);
+
+/**
+ * Returns a field value of cell (x, y) of the whole grid in the slab that owns it, to read or change between steps.
+ * NULL outside the grid.
+ */
+float* fluid_slabs_cell(FluidSlabs* slabs, FieldType field, int x, int y);
+
+/**
+ * Copies a field of the whole grid into (numX + 2) * (numY + 2) values, cell (i, j) at i * (numY + 2) + j.
+ */
+void fluid_slabs_gather(FluidSlabs* slabs, FieldType field, float* values);
+
+/**
+ * Performs one step like fluid_simulate_step on every slab and waits for all of them.
+ * Returns 0 when a worker process died; the other workers are stopped and the grid can only be freed.
+ */
+int fluid_slabs_simulate_step(FluidSlabs* slabs, int numIterations, float deltaTime, float gravityForce,
+                              float overRelaxation, float dissipation, float smokeDissipation);
+
+/**
+ * Iterations and residual of the last solve, over all slabs.
+ */
+void fluid_slabs_solver_statistics(const FluidSlabs* slabs, int* iterations, float* residualMax, float* residualL2);
+
+#endif
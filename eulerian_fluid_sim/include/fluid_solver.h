@@ -0,0 +1,27 @@
+#ifndef FLUID_SOLVER_H
+#define FLUID_SOLVER_H
+
+#include "fluid_logic.h"
+
+
+/**
+ * Allocates the Poisson system used by the PCG and multigrid pressure solvers.
+ * The fine level is indexed with rowStride so it lines up with the fluid fields.
+ */
+FluidPressureSystem* fluid_pressure_system_create(int numCellsX, int numCellsY, int rowStride, PressureSolverType solverType);
+
+/**
+ * Frees a pressure system.
+ */
+void fluid_pressure_system_free(FluidPressureSystem* system);
+
+/**
+ * Assembles the Poisson system from solidFlags and the current velocity divergence,
+ * solves it with the system's backend, then projects the velocities.
+ * Stops at a max residual of tolerance, or 1e-4 of the initial residual when tolerance is 0.
+ * Returns the number of CG iterations or V-cycles used and the final max/L2 residual.
+ */
+int fluid_pressure_system_solve(FluidPressureSystem* system, Fluid* fluidPtr, int maxIterations, float tolerance,
+                                float* residualMax, float* residualL2);
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef FLUID_SPARSE_H
+#define FLUID_SPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fluid_threads.h"
+
+// side length in cells of a sparse tile is 1 << FLUID_SPARSE_TILE_SHIFT
+#define FLUID_SPARSE_TILE_SHIFT 4
+#define FLUID_SPARSE_TILE_SIZE (1 << FLUID_SPARSE_TILE_SHIFT)
+#define FLUID_SPARSE_TILE_CELLS (FLUID_SPARSE_TILE_SIZE * FLUID_SPARSE_TILE_SIZE)
+
+// tiles the pool allocates at once
+#define FLUID_SPARSE_TILES_PER_CHUNK 64
+
+
+/**
+ * Fields stored in every tile. The NEW_* fields are back buffers swapped with the front fields by advection.
+ */
+typedef enum {
+    SPARSE_VELOCITY_X,
+    SPARSE_VELOCITY_Y,
+    SPARSE_SMOKE,
+    SPARSE_NEW_VELOCITY_X,
+    SPARSE_NEW_VELOCITY_Y,
+    SPARSE_NEW_SMOKE,
+    SPARSE_NUM_FIELDS
+} FluidSparseField;
+
+/**
+ * One FLUID_SPARSE_TILE_SIZE x FLUID_SPARSE_TILE_SIZE block of cells, stored column by column like the dense grid:
+ * cell (i, j) of the tile is at (i << FLUID_SPARSE_TILE_SHIFT) + j of every field.
+ */
+typedef struct FluidSparseTile {
+    float storage[SPARSE_NUM_FIELDS * FLUID_SPARSE_TILE_CELLS];
+    float* fields[SPARSE_NUM_FIELDS];
+
+    int tileX;
+    int tileY;
+    int listIndex;                              // position in FluidSparse.tiles
+    struct FluidSparseTile* neighbors[4];       // left, right, bottom, top tile, NULL when not allocated
+    int occupied;                               // holds a value above the activity threshold
+    float residualMax;                          // of the last red-black half-sweep
+
+    struct FluidSparseTile* nextFree;
+} FluidSparseTile;
+
+/**
+ * Smoke simulation on a sparse grid of tiles, for domains too large for the dense Fluid arrays.
+ * Only tiles around smoke or motion are allocated: the tiles above the activity threshold plus a ring of one
+ * tile for advection reach. Everything else is fluid at rest without smoke, and the edge of the allocated region
+ * acts as a wall. Tiles come from a pool that grows in chunks and reuses freed tiles.
+ * The domain is a closed box with no obstacles and no gravity, its size is rounded up to whole tiles.
+ */
+typedef struct {
+    int numCellsX;
+    int numCellsY;
+    float cellSize;
+
+    // tile table: entry tileX * numTilesY + tileY, NULL where nothing is allocated
+    int numTilesX;
+    int numTilesY;
+    FluidSparseTile** tileTable;
+
+    // allocated tiles in no particular order
+    FluidSparseTile** tiles;
+    int numTiles;
+    int tileCapacity;
+    int maxTiles;
+
+    // tile pool
+    FluidSparseTile** chunks;
+    int numChunks;
+    int chunkCapacity;
+    FluidSparseTile* freeTiles;
+    int poolExhausted;
+
+    float activityThreshold;
+    FluidWorkerPool* workerPool;
+
+    // statistics of the last solve
+    int lastSolverIterations;
+    float lastResidualMax;
+} FluidSparse;
+
+/**
+ * Creates an empty numX x numY domain. At most maxTiles tiles are allocated (0 allows the whole domain).
+ */
+FluidSparse* fluid_sparse_create(int numX, int numY, float cellSize, int maxTiles, float activityThreshold);
+
+/**
+ * Frees the sparse grid and all of its tiles.
+ */
+void fluid_sparse_free(FluidSparse* sparse);
+
+/**
+ * Sets the number of threads used by the passes (1 runs everything on the calling thread).
+ */
+void fluid_sparse_set_num_threads(FluidSparse* sparse, int numThreads);
+
+/**
+ * Adds smoke (capped at 1) to a cell, allocating its tile. The cell is clamped to the domain.
+ */
+void fluid_sparse_add_smoke(FluidSparse* sparse, int x, int y, float amount);
+
+/**
+ * Adds to the x- and y-velocities stored at a cell (its left and bottom face), allocating its tile.
+ * The cell is clamped to the domain.
+ */
+void fluid_sparse_add_velocity(FluidSparse* sparse, int x, int y, float velocityX, float velocityY);
+
+/**
+ * Returns a field value of a cell, 0 outside the allocated tiles.
+ */
+float fluid_sparse_value(const FluidSparse* sparse, FluidSparseField field, int x, int y);
+
+/**
+ * Performs one step: dissipation, red-black pressure solve, tile allocation, advection.
+ */
+void fluid_sparse_simulate_step(FluidSparse* sparse, int numIterations, float deltaTime, float overRelaxation,
+                                float dissipation, float smokeDissipation);
+
+/**
+ * Returns the bytes held by the grid: the tile table, the tile list and every pooled tile.
+ */
+size_t fluid_sparse_memory_bytes(const FluidSparse* sparse);
+
+#endif
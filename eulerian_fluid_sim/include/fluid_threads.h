@@ -0,0 +1,36 @@
+#ifndef FLUID_THREADS_H
+#define FLUID_THREADS_H
+
+
+/**
+ * Task run by the worker pool over a contiguous part of a range.
+ */
+typedef void (*FluidTaskFunction)(void* taskData, int rangeStart, int rangeEnd);
+
+/**
+ * Persistent pool of worker threads used by the fluid passes.
+ */
+typedef struct FluidWorkerPool FluidWorkerPool;
+
+/**
+ * Creates a worker pool. The calling thread counts as one of numThreads.
+ */
+FluidWorkerPool* fluid_pool_create(int numThreads);
+
+/**
+ * Stops the worker threads and frees the pool.
+ */
+void fluid_pool_free(FluidWorkerPool* pool);
+
+/**
+ * Returns the number of threads (including the caller) that share the work.
+ */
+int fluid_pool_num_threads(const FluidWorkerPool* pool);
+
+/**
+ * Splits [rangeStart, rangeEnd) into one contiguous chunk per thread and runs the task on every chunk.
+ * Returns once all chunks are finished. A NULL pool runs the whole range on the calling thread.
+ */
+void fluid_pool_run(FluidWorkerPool* pool, FluidTaskFunction task, void* taskData, int rangeStart, int rangeEnd);
+
+#endif
@@ -0,0 +1,318 @@
+#include "fluid_checkpoint.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define CHECKPOINT_VERSION 4
+
+// written in native byte order, reads back differently on a machine with the other order
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+
+// arena pointers of a Fluid, see get_field_offsets
+#define CHECKPOINT_NUM_FIELDS 17
+
+static const char CHECKPOINT_MAGIC[8] = { 'F', 'L', 'U', 'I', 'D', 'C', 'K', 'P' };
+
+/**
+ * Start of the header page.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerBytes;
+    int32_t numCellsX;
+    int32_t numCellsY;
+    int32_t rowStride;
+    uint64_t arenaSize;
+    uint64_t fieldOffsets[CHECKPOINT_NUM_FIELDS];
+
+    float cellSize;
+    float density;
+    int32_t pressureSolver;
+    int32_t advectionScheme;
+    int32_t smokeStorage;
+    float solverTolerance;
+    int32_t warmStartPressure;
+    int32_t temporalBlockIterations;
+    int32_t activeTilesEnabled;
+    float activityThreshold;
+    int32_t numActiveTiles;
+    int32_t lastSolverIterations;
+    float lastResidualMax;
+    float lastResidualL2;
+} CheckpointHeader;
+
+_Static_assert(sizeof(CheckpointHeader) <= FLUID_CHECKPOINT_HEADER_BYTES, "checkpoint header must fit its page");
+
+// the order of the offsets in the header, which get_field_sizes and set_field_pointers follow
+static void get_field_offsets(const Fluid* fluidPtr, uint64_t offsets[CHECKPOINT_NUM_FIELDS]) {
+    const unsigned char* arena = fluidPtr->arena;
+    offsets[0] = (uint64_t)((const unsigned char*)fluidPtr->velocityX - arena);
+    offsets[1] = (uint64_t)((const unsigned char*)fluidPtr->velocityY - arena);
+    offsets[2] = (uint64_t)((const unsigned char*)fluidPtr->newVelocityX - arena);
+    offsets[3] = (uint64_t)((const unsigned char*)fluidPtr->newVelocityY - arena);
+    offsets[4] = (uint64_t)((const unsigned char*)fluidPtr->pressure - arena);
+    offsets[5] = (uint64_t)((const unsigned char*)fluidPtr->smokeDensity - arena);
+    offsets[6] = (uint64_t)((const unsigned char*)fluidPtr->newSmokeDensity - arena);
+    offsets[7] = (uint64_t)((const unsigned char*)fluidPtr->solidFlags - arena);
+    offsets[8] = (uint64_t)((const unsigned char*)fluidPtr->correctionX - arena);
+    offsets[9] = (uint64_t)((const unsigned char*)fluidPtr->correctionY - arena);
+    offsets[10] = (uint64_t)((const unsigned char*)fluidPtr->neighborScale - arena);
+    offsets[11] = (uint64_t)((const unsigned char*)fluidPtr->pressureDelta - arena);
+    offsets[12] = (uint64_t)((const unsigned char*)fluidPtr->fluidCellMask - arena);
+    offsets[13] = (uint64_t)((const unsigned char*)fluidPtr->columnResidualMax - arena);
+    offsets[14] = (uint64_t)((const unsigned char*)fluidPtr->columnResidualSquares - arena);
+    offsets[15] = (uint64_t)(fluidPtr->tileActive - arena);
+    offsets[16] = (uint64_t)(fluidPtr->tileOccupied - arena);
+}
+
+static void get_field_sizes(const Fluid* fluidPtr, uint64_t sizes[CHECKPOINT_NUM_FIELDS]) {
+    uint64_t fieldBytes = (uint64_t)fluidPtr->totalNumCells * sizeof(float);
+    uint64_t smokeBytes = (uint64_t)fluidPtr->totalNumCells * (fluidPtr->smokeStorage == SMOKE_STORAGE_FLOAT32 ? sizeof(float) : sizeof(uint16_t));
+    for (int field = 0; field < 12; ++field) sizes[field] = fieldBytes;
+    sizes[5] = smokeBytes;
+    sizes[6] = smokeBytes;
+    sizes[12] = (uint64_t)(fluidPtr->totalNumCells + 63) / 64 * sizeof(uint64_t);
+    sizes[13] = (uint64_t)fluidPtr->numCellsX * sizeof(float);
+    sizes[14] = (uint64_t)fluidPtr->numCellsX * sizeof(double);
+    sizes[15] = (uint64_t)fluidPtr->numTilesX * fluidPtr->numTilesY;
+    sizes[16] = sizes[15];
+}
+
+static void set_field_pointers(Fluid* fluidPtr, const uint64_t offsets[CHECKPOINT_NUM_FIELDS]) {
+    unsigned char* arena = fluidPtr->arena;
+    fluidPtr->velocityX = (float*)(arena + offsets[0]);
+    fluidPtr->velocityY = (float*)(arena + offsets[1]);
+    fluidPtr->newVelocityX = (float*)(arena + offsets[2]);
+    fluidPtr->newVelocityY = (float*)(arena + offsets[3]);
+    fluidPtr->pressure = (float*)(arena + offsets[4]);
+    fluidPtr->smokeDensity = (float*)(arena + offsets[5]);
+    fluidPtr->newSmokeDensity = (float*)(arena + offsets[6]);
+    fluidPtr->solidFlags = (float*)(arena + offsets[7]);
+    fluidPtr->correctionX = (float*)(arena + offsets[8]);
+    fluidPtr->correctionY = (float*)(arena + offsets[9]);
+    fluidPtr->neighborScale = (float*)(arena + offsets[10]);
+    fluidPtr->pressureDelta = (float*)(arena + offsets[11]);
+    fluidPtr->fluidCellMask = (uint64_t*)(arena + offsets[12]);
+    fluidPtr->columnResidualMax = (float*)(arena + offsets[13]);
+    fluidPtr->columnResidualSquares = (double*)(arena + offsets[14]);
+    fluidPtr->tileActive = arena + offsets[15];
+    fluidPtr->tileOccupied = arena + offsets[16];
+}
+
+int fluid_save_checkpoint(const Fluid* fluidPtr, const char* path) {
+
+    unsigned char* headerPage = (unsigned char*)calloc(1, FLUID_CHECKPOINT_HEADER_BYTES);
+    if (headerPage == NULL) {
+        printf("ERROR: fluid_save_checkpoint failed to allocate the header\n");
+        return 0;
+    }
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.byteOrder = CHECKPOINT_BYTE_ORDER;
+    header.headerBytes = FLUID_CHECKPOINT_HEADER_BYTES;
+    header.numCellsX = fluidPtr->numCellsX;
+    header.numCellsY = fluidPtr->numCellsY;
+    header.rowStride = fluidPtr->rowStride;
+    header.arenaSize = fluidPtr->arenaSize;
+    get_field_offsets(fluidPtr, header.fieldOffsets);
+
+    header.cellSize = fluidPtr->cellSize;
+    header.density = fluidPtr->density;
+    header.pressureSolver = (int32_t)fluidPtr->pressureSolver;
+    header.advectionScheme = (int32_t)fluidPtr->advectionScheme;
+    header.smokeStorage = (int32_t)fluidPtr->smokeStorage;
+    header.solverTolerance = fluidPtr->solverTolerance;
+    header.warmStartPressure = fluidPtr->warmStartPressure;
+    header.temporalBlockIterations = fluidPtr->temporalBlockIterations;
+    header.activeTilesEnabled = fluidPtr->activeTilesEnabled;
+    header.activityThreshold = fluidPtr->activityThreshold;
+    header.numActiveTiles = fluidPtr->numActiveTiles;
+    header.lastSolverIterations = fluidPtr->lastSolverIterations;
+    header.lastResidualMax = fluidPtr->lastResidualMax;
+    header.lastResidualL2 = fluidPtr->lastResidualL2;
+    memcpy(headerPage, &header, sizeof(header));
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        free(headerPage);
+        printf("ERROR: fluid_save_checkpoint could not open %s\n", path);
+        return 0;
+    }
+
+    int ok = fwrite(headerPage, 1, FLUID_CHECKPOINT_HEADER_BYTES, file) == FLUID_CHECKPOINT_HEADER_BYTES &&
+             fwrite(fluidPtr->arena, 1, fluidPtr->arenaSize, file) == fluidPtr->arenaSize;
+    if (fclose(file) != 0) ok = 0;
+    free(headerPage);
+
+    if (!ok) printf("ERROR: fluid_save_checkpoint failed to write %s\n", path);
+    return ok;
+}
+
+/**
+ * Maps a whole file copy-on-write. Returns NULL on failure.
+ */
+static void* map_file(const char* path, size_t* mappingSize) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    // the view keeps the mapping alive once the handles are closed
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == NULL) return NULL;
+
+    *mappingSize = (size_t)fileSize.QuadPart;
+    return view;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0) return NULL;
+
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+        close(file);
+        return NULL;
+    }
+
+    void* view = mmap(NULL, (size_t)fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (view == MAP_FAILED) return NULL;
+
+    *mappingSize = (size_t)fileStat.st_size;
+    return view;
+#endif
+}
+
+void fluid_checkpoint_unmap(void* mapping, size_t mappingSize) {
+    if (mapping == NULL) return;
+#ifdef _WIN32
+    (void)mappingSize;
+    UnmapViewOfFile(mapping);
+#else
+    munmap(mapping, mappingSize);
+#endif
+}
+
+/**
+ * Checks that the header describes a layout this build can read.
+ */
+static int validate_header(const CheckpointHeader* header) {
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) return 0;
+    if (header->version != CHECKPOINT_VERSION || header->byteOrder != CHECKPOINT_BYTE_ORDER) return 0;
+    if (header->headerBytes != FLUID_CHECKPOINT_HEADER_BYTES) return 0;
+    if (header->pressureSolver < PRESSURE_SOLVER_GAUSS_SEIDEL || header->pressureSolver > PRESSURE_SOLVER_MULTIGRID) return 0;
+    if (header->advectionScheme < ADVECTION_SEMI_LAGRANGIAN || header->advectionScheme > ADVECTION_MACCORMACK) return 0;
+    if (header->smokeStorage < SMOKE_STORAGE_FLOAT32 || header->smokeStorage > SMOKE_STORAGE_BFLOAT16) return 0;
+    return header->numCellsX >= 3 && header->numCellsY >= 3;
+}
+
+Fluid* fluid_load_checkpoint(const char* path) {
+
+    size_t mappingSize = 0;
+    void* mapping = map_file(path, &mappingSize);
+    if (mapping == NULL) {
+        printf("ERROR: fluid_load_checkpoint could not map %s\n", path);
+        return NULL;
+    }
+
+    CheckpointHeader header;
+    if (mappingSize < FLUID_CHECKPOINT_HEADER_BYTES) {
+        fluid_checkpoint_unmap(mapping, mappingSize);
+        printf("ERROR: fluid_load_checkpoint: %s is too short\n", path);
+        return NULL;
+    }
+    memcpy(&header, mapping, sizeof(header));
+    if (!validate_header(&header)) {
+        fluid_checkpoint_unmap(mapping, mappingSize);
+        printf("ERROR: fluid_load_checkpoint: %s is not a checkpoint of this version and byte order\n", path);
+        return NULL;
+    }
+    if (header.arenaSize > (uint64_t)(mappingSize - FLUID_CHECKPOINT_HEADER_BYTES)) {
+        fluid_checkpoint_unmap(mapping, mappingSize);
+        printf("ERROR: fluid_load_checkpoint: %s is truncated\n", path);
+        return NULL;
+    }
+
+    Fluid* fluid = fluid_init(header.density, header.numCellsX - 2, header.numCellsY - 2, header.cellSize,
+                              (PressureSolverType)header.pressureSolver);
+    if (fluid == NULL) {
+        fluid_checkpoint_unmap(mapping, mappingSize);
+        return NULL;
+    }
+
+    // the smoke buffers end the arena, sized for the smoke storage (fluid_init lays them out for fp32)
+    uint64_t smokeOffset = (uint64_t)((unsigned char*)fluid->smokeDensity - fluid->arena);
+    fluid->smokeStorage = (SmokeStorage)header.smokeStorage;
+    if (fluid->rowStride != header.rowStride ||
+        smokeOffset + 2 * fluid_smoke_buffer_bytes(fluid, fluid->smokeStorage) != header.arenaSize) {
+        fluid_free(fluid);
+        fluid_checkpoint_unmap(mapping, mappingSize);
+        printf("ERROR: fluid_load_checkpoint: the arena layout of %s differs from this build\n", path);
+        return NULL;
+    }
+
+    /* every field must lie inside the arena on a cache line boundary, and the smoke buffers (fields 5 and 6) at its
+       end, where fluid_set_smoke_storage expects them */
+    uint64_t sizes[CHECKPOINT_NUM_FIELDS];
+    get_field_sizes(fluid, sizes);
+    for (int field = 0; field < CHECKPOINT_NUM_FIELDS; ++field) {
+        uint64_t offset = header.fieldOffsets[field];
+        int isSmoke = field == 5 || field == 6;
+        if (offset % FLUID_ARENA_ALIGNMENT != 0 || offset > header.arenaSize || sizes[field] > header.arenaSize - offset ||
+            (isSmoke && offset < smokeOffset)) {
+            fluid_free(fluid);
+            fluid_checkpoint_unmap(mapping, mappingSize);
+            printf("ERROR: fluid_load_checkpoint: field %d of %s is outside the arena\n", field, path);
+            return NULL;
+        }
+    }
+
+    // the mapped file replaces the arena fluid_init allocated, which was never touched apart from the tile flags
+    free(fluid->arenaAllocation);
+    fluid->arenaAllocation = NULL;
+    fluid->arenaMapping = mapping;
+    fluid->arenaMappingSize = mappingSize;
+    fluid->arena = (unsigned char*)mapping + FLUID_CHECKPOINT_HEADER_BYTES;
+    fluid->arenaSize = header.arenaSize;
+    set_field_pointers(fluid, header.fieldOffsets);
+
+    fluid->advectionScheme = (AdvectionScheme)header.advectionScheme;
+    fluid->solverTolerance = header.solverTolerance;
+    fluid->warmStartPressure = header.warmStartPressure;
+    fluid->temporalBlockIterations = header.temporalBlockIterations;
+    fluid->activeTilesEnabled = header.activeTilesEnabled;
+    fluid->activityThreshold = header.activityThreshold;
+    fluid->numActiveTiles = header.numActiveTiles;
+    fluid->lastSolverIterations = header.lastSolverIterations;
+    fluid->lastResidualMax = header.lastResidualMax;
+    fluid->lastResidualL2 = header.lastResidualL2;
+
+    // the obstacle cache in the file is valid, rebuilding it also covers a checkpoint saved while it was stale
+    fluid->obstaclesDirty = 1;
+
+    return fluid;
+}
@@ -0,0 +1,264 @@
+#include "fluid_ensemble.h"
+#include "fluid_threads.h"
+#include <SDL.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * Members [first, end) a thread still has to step, packed as first << 32 | end so the owner and the
+ * thieves update both ends with one compare-and-swap. On its own cache line, the owner changes it per member.
+ */
+typedef struct {
+    _Alignas(FLUID_ARENA_ALIGNMENT) atomic_ullong range;
+} MemberQueue;
+
+struct FluidEnsemble {
+    int numMembers;
+    Fluid** members;
+
+    // every member's arena, back to back
+    void* arenaAllocation;
+
+    // step parameters, one array per parameter indexed by member
+    float* gravityForce;
+    float* overRelaxation;
+    float* dissipation;
+    float* smokeDissipation;
+
+    FluidWorkerPool* workerPool;
+    int numThreads;
+    MemberQueue* queues;
+    void* queueAllocation;
+
+    // the current fluid_ensemble_simulate
+    int numSteps;
+    int numIterations;
+    float deltaTime;
+    FluidEnsembleStepFunction stepFunction;
+    void* userData;
+    atomic_int numSteals;
+
+    int stepCount;
+    FluidEnsembleStatistics statistics;
+};
+
+static inline unsigned long long pack_range(unsigned int first, unsigned int end) {
+    return ((unsigned long long)first << 32) | end;
+}
+
+/**
+ * Takes the first member of a thread's own queue. Returns -1 when it is empty.
+ */
+static int pop_member(MemberQueue* queue) {
+    unsigned long long range = atomic_load(&queue->range);
+
+    while (1) {
+        unsigned int first = (unsigned int)(range >> 32);
+        unsigned int end = (unsigned int)range;
+        if (first >= end) return -1;
+
+        if (atomic_compare_exchange_weak(&queue->range, &range, pack_range(first + 1, end))) {
+            return (int)first;
+        }
+    }
+}
+
+/**
+ * Moves the last half (rounded up) of another thread's queue into the empty queue of the thief.
+ * Returns 0 when every other queue is empty.
+ */
+static int steal_members(FluidEnsemble* ensemble, int thief) {
+
+    // start with the next thread so the thieves spread over the victims
+    for (int offset = 1; offset < ensemble->numThreads; ++offset) {
+        MemberQueue* victim = &ensemble->queues[(thief + offset) % ensemble->numThreads];
+        unsigned long long range = atomic_load(&victim->range);
+
+        while (1) {
+            unsigned int first = (unsigned int)(range >> 32);
+            unsigned int end = (unsigned int)range;
+            if (first >= end) break;
+
+            unsigned int numStolen = (end - first + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &range, pack_range(first, end - numStolen))) {
+
+                // other thieves only swap a queue they saw non-empty, so a plain store can't lose their update
+                atomic_store(&ensemble->queues[thief].range, pack_range(end - numStolen, end));
+                atomic_fetch_add(&ensemble->numSteals, 1);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void step_member(FluidEnsemble* ensemble, int memberIndex) {
+    Fluid* member = ensemble->members[memberIndex];
+
+    for (int step = 0; step < ensemble->numSteps; ++step) {
+        if (ensemble->stepFunction) {
+            ensemble->stepFunction(ensemble->userData, memberIndex, member, ensemble->stepCount + step);
+        }
+        fluid_simulate_step(member, ensemble->numIterations, ensemble->deltaTime, ensemble->gravityForce[memberIndex],
+                            ensemble->overRelaxation[memberIndex], ensemble->dissipation[memberIndex],
+                            ensemble->smokeDissipation[memberIndex]);
+    }
+}
+
+/**
+ * Runs on every thread of the pool, the range is the thread's index.
+ */
+static void ensemble_worker_task(void* taskData, int rangeStart, int rangeEnd) {
+    FluidEnsemble* ensemble = (FluidEnsemble*)taskData;
+
+    for (int thread = rangeStart; thread < rangeEnd; ++thread) {
+        do {
+            int memberIndex;
+            while ((memberIndex = pop_member(&ensemble->queues[thread])) >= 0) {
+                step_member(ensemble, memberIndex);
+            }
+        } while (steal_members(ensemble, thread));
+    }
+}
+
+FluidEnsemble* fluid_ensemble_create(int numMembers, float density, int numX, int numY, float cellSize,
+                                     PressureSolverType pressureSolver, SmokeStorage smokeStorage, int numThreads) {
+
+    if (numMembers < 1) {
+        printf("ERROR: fluid_ensemble_create needs at least one member\n");
+        return NULL;
+    }
+    if (numThreads < 1) numThreads = 1;
+
+    FluidEnsemble* ensemble = (FluidEnsemble*)calloc(1, sizeof(FluidEnsemble));
+    if (ensemble == NULL) {
+        printf("ERROR: fluid_ensemble_create failed to allocate ensemble\n");
+        return NULL;
+    }
+
+    ensemble->members = (Fluid**)calloc(numMembers, sizeof(Fluid*));
+    ensemble->gravityForce = (float*)malloc(numMembers * sizeof(float));
+    ensemble->overRelaxation = (float*)malloc(numMembers * sizeof(float));
+    ensemble->dissipation = (float*)malloc(numMembers * sizeof(float));
+    ensemble->smokeDissipation = (float*)malloc(numMembers * sizeof(float));
+    if (!ensemble->members || !ensemble->gravityForce || !ensemble->overRelaxation || !ensemble->dissipation ||
+        !ensemble->smokeDissipation) {
+        printf("ERROR: fluid_ensemble_create failed to allocate members\n");
+        fluid_ensemble_free(ensemble);
+        return NULL;
+    }
+
+    for (int member = 0; member < numMembers; ++member) {
+        ensemble->members[member] = fluid_init(density, numX, numY, cellSize, pressureSolver);
+        if (ensemble->members[member] == NULL) {
+            fluid_ensemble_free(ensemble);
+            return NULL;
+        }
+        ensemble->numMembers = member + 1;
+        fluid_set_smoke_storage(ensemble->members[member], smokeStorage);
+        if (ensemble->members[member]->smokeStorage != smokeStorage) {
+            fluid_ensemble_free(ensemble);
+            return NULL;
+        }
+        fluid_ensemble_set_parameters(ensemble, member, -9.81f, 1.9f, 1.0f, 1.0f);
+    }
+
+    // gather the arenas so the members are laid out one after another
+    size_t arenaSize = ensemble->members[0]->arenaSize;
+    ensemble->arenaAllocation = malloc(arenaSize * numMembers + FLUID_ARENA_ALIGNMENT);
+    if (ensemble->arenaAllocation == NULL) {
+        printf("ERROR: fluid_ensemble_create failed to allocate the arenas\n");
+        fluid_ensemble_free(ensemble);
+        return NULL;
+    }
+    unsigned char* arena = (unsigned char*)(((uintptr_t)ensemble->arenaAllocation + FLUID_ARENA_ALIGNMENT - 1)
+                                            & ~(uintptr_t)(FLUID_ARENA_ALIGNMENT - 1));
+    for (int member = 0; member < numMembers; ++member) {
+        fluid_move_arena(ensemble->members[member], arena + (size_t)member * arenaSize);
+    }
+
+    ensemble->queueAllocation = malloc(numThreads * sizeof(MemberQueue) + FLUID_ARENA_ALIGNMENT);
+    ensemble->workerPool = numThreads > 1 ? fluid_pool_create(numThreads) : NULL;
+    if (ensemble->queueAllocation == NULL || (numThreads > 1 && ensemble->workerPool == NULL)) {
+        printf("ERROR: fluid_ensemble_create failed to create the worker threads\n");
+        fluid_ensemble_free(ensemble);
+        return NULL;
+    }
+    ensemble->queues = (MemberQueue*)(((uintptr_t)ensemble->queueAllocation + FLUID_ARENA_ALIGNMENT - 1)
+                                      & ~(uintptr_t)(FLUID_ARENA_ALIGNMENT - 1));
+    ensemble->numThreads = fluid_pool_num_threads(ensemble->workerPool);
+    atomic_init(&ensemble->numSteals, 0);
+
+    return ensemble;
+}
+
+void fluid_ensemble_free(FluidEnsemble* ensemble) {
+    if (ensemble == NULL) return;
+
+    fluid_pool_free(ensemble->workerPool);
+    for (int member = 0; member < ensemble->numMembers; ++member) {
+        fluid_free(ensemble->members[member]);
+    }
+    free(ensemble->arenaAllocation);
+    free(ensemble->queueAllocation);
+    free(ensemble->members);
+    free(ensemble->gravityForce);
+    free(ensemble->overRelaxation);
+    free(ensemble->dissipation);
+    free(ensemble->smokeDissipation);
+    free(ensemble);
+}
+
+int fluid_ensemble_num_members(const FluidEnsemble* ensemble) {
+    return ensemble->numMembers;
+}
+
+Fluid* fluid_ensemble_member(FluidEnsemble* ensemble, int memberIndex) {
+    if (memberIndex < 0 || memberIndex >= ensemble->numMembers) return NULL;
+    return ensemble->members[memberIndex];
+}
+
+void fluid_ensemble_set_parameters(FluidEnsemble* ensemble, int memberIndex, float gravityForce,
+                                   float overRelaxation, float dissipation, float smokeDissipation) {
+    if (memberIndex < 0 || memberIndex >= ensemble->numMembers) return;
+
+    ensemble->gravityForce[memberIndex] = gravityForce;
+    ensemble->overRelaxation[memberIndex] = overRelaxation;
+    ensemble->dissipation[memberIndex] = dissipation;
+    ensemble->smokeDissipation[memberIndex] = smokeDissipation;
+}
+
+void fluid_ensemble_simulate(FluidEnsemble* ensemble, int numSteps, int numIterations, float deltaTime,
+                             FluidEnsembleStepFunction stepFunction, void* userData) {
+    if (numSteps < 1) return;
+
+    ensemble->numSteps = numSteps;
+    ensemble->numIterations = numIterations;
+    ensemble->deltaTime = deltaTime;
+    ensemble->stepFunction = stepFunction;
+    ensemble->userData = userData;
+    atomic_store(&ensemble->numSteals, 0);
+
+    // contiguous runs of members per thread, stealing evens out the rest
+    for (int thread = 0; thread < ensemble->numThreads; ++thread) {
+        unsigned int first = (unsigned int)((long long)ensemble->numMembers * thread / ensemble->numThreads);
+        unsigned int end = (unsigned int)((long long)ensemble->numMembers * (thread + 1) / ensemble->numThreads);
+        atomic_store(&ensemble->queues[thread].range, pack_range(first, end));
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    fluid_pool_run(ensemble->workerPool, ensemble_worker_task, ensemble, 0, ensemble->numThreads);
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+    ensemble->stepCount += numSteps;
+    ensemble->statistics.seconds = seconds;
+    ensemble->statistics.memberSteps = (long long)ensemble->numMembers * numSteps;
+    ensemble->statistics.memberStepsPerSecond = seconds > 0.0 ? (double)ensemble->statistics.memberSteps / seconds : 0.0;
+    ensemble->statistics.numSteals = atomic_load(&ensemble->numSteals);
+}
+
+void fluid_ensemble_statistics(const FluidEnsemble* ensemble, FluidEnsembleStatistics* statistics) {
+    *statistics = ensemble->statistics;
+}
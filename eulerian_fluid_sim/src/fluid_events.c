@@ -0,0 +1,171 @@
+#include "fluid_events.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define EVENT_LOG_VERSION 1
+
+// events the log holds before it first grows
+#define EVENT_LOG_INITIAL_CAPACITY 256
+
+struct FluidEventLog {
+    FluidEvent* events;
+    int numEvents;
+    int capacity;
+};
+
+void fluid_apply_command(Fluid* fluidPtr, const FluidCommand* command) {
+    int cellX = command->cellX < 1 ? 1 : (command->cellX > fluidPtr->numCellsX - 2 ? fluidPtr->numCellsX - 2 : command->cellX);
+    int cellY = command->cellY < 1 ? 1 : (command->cellY > fluidPtr->numCellsY - 2 ? fluidPtr->numCellsY - 2 : command->cellY);
+
+    size_t cellIndex = (size_t)cellX * fluidPtr->rowStride + cellY;
+    if (fluidPtr->solidFlags[cellIndex] != 1.0f) return;
+
+    switch (command->type) {
+        case FLUID_COMMAND_ADD_SMOKE:
+            fluid_set_smoke(fluidPtr, cellX, cellY, fminf(fluid_get_smoke(fluidPtr, cellX, cellY) + command->amount, 1.0f));
+            break;
+        case FLUID_COMMAND_ADD_FORCE:
+            fluidPtr->velocityX[cellIndex] += command->forceX;
+            fluidPtr->velocityY[cellIndex] += command->forceY;
+            break;
+    }
+}
+
+FluidEventLog* fluid_event_log_create(void) {
+    FluidEventLog* log = (FluidEventLog*)calloc(1, sizeof(FluidEventLog));
+    if (log == NULL) {
+        printf("ERROR: fluid_event_log_create failed to allocate log\n");
+    }
+    return log;
+}
+
+void fluid_event_log_free(FluidEventLog* log) {
+    if (log) {
+        free(log->events);
+        free(log);
+    }
+}
+
+int fluid_event_log_append(FluidEventLog* log, long long step, const FluidCommand* command) {
+    if (log->numEvents > 0 && step < log->events[log->numEvents - 1].step) {
+        printf("ERROR: fluid_event_log_append got step %lld after step %lld\n", step, log->events[log->numEvents - 1].step);
+        return 0;
+    }
+
+    if (log->numEvents == log->capacity) {
+        int capacity = log->capacity ? 2 * log->capacity : EVENT_LOG_INITIAL_CAPACITY;
+        FluidEvent* events = (FluidEvent*)realloc(log->events, (size_t)capacity * sizeof(FluidEvent));
+        if (events == NULL) {
+            printf("ERROR: fluid_event_log_append failed to grow the log\n");
+            return 0;
+        }
+        log->events = events;
+        log->capacity = capacity;
+    }
+
+    log->events[log->numEvents].step = step;
+    log->events[log->numEvents].command = *command;
+    log->numEvents++;
+    return 1;
+}
+
+int fluid_event_log_num_events(const FluidEventLog* log) {
+    return log->numEvents;
+}
+
+const FluidEvent* fluid_event_log_events(const FluidEventLog* log) {
+    return log->events;
+}
+
+int fluid_event_log_save(const FluidEventLog* log, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf("ERROR: fluid_event_log_save could not open %s\n", path);
+        return 0;
+    }
+
+    // 9 significant digits read back as the same float
+    fprintf(file, "fluid-events %d\n", EVENT_LOG_VERSION);
+    for (int e = 0; e < log->numEvents; ++e) {
+        const FluidEvent* event = &log->events[e];
+        const FluidCommand* command = &event->command;
+
+        if (command->type == FLUID_COMMAND_ADD_SMOKE) {
+            fprintf(file, "%lld smoke %d %d %.9g\n", event->step, command->cellX, command->cellY, command->amount);
+        } else {
+            fprintf(file, "%lld force %d %d %.9g %.9g\n", event->step, command->cellX, command->cellY,
+                    command->forceX, command->forceY);
+        }
+    }
+
+    int ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) printf("ERROR: fluid_event_log_save failed to write %s\n", path);
+    return ok;
+}
+
+/**
+ * Parses one event line. Returns 0 when it is malformed.
+ */
+static int parse_event(const char* line, FluidEvent* event) {
+    char type[16];
+    int numRead;
+    FluidCommand* command = &event->command;
+    memset(command, 0, sizeof(FluidCommand));
+
+    if (sscanf(line, "%lld %15s %d %d%n", &event->step, type, &command->cellX, &command->cellY, &numRead) != 4) return 0;
+    line += numRead;
+
+    if (strcmp(type, "smoke") == 0) {
+        command->type = FLUID_COMMAND_ADD_SMOKE;
+        return sscanf(line, "%f", &command->amount) == 1;
+    }
+    if (strcmp(type, "force") == 0) {
+        command->type = FLUID_COMMAND_ADD_FORCE;
+        return sscanf(line, "%f %f", &command->forceX, &command->forceY) == 2;
+    }
+    return 0;
+}
+
+FluidEventLog* fluid_event_log_load(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        printf("ERROR: fluid_event_log_load could not open %s\n", path);
+        return NULL;
+    }
+
+    char line[256];
+    int version = 0;
+    if (fgets(line, sizeof(line), file) == NULL || sscanf(line, "fluid-events %d", &version) != 1 ||
+        version != EVENT_LOG_VERSION) {
+        printf("ERROR: %s is not a fluid event log of version %d\n", path, EVENT_LOG_VERSION);
+        fclose(file);
+        return NULL;
+    }
+
+    FluidEventLog* log = fluid_event_log_create();
+    if (log == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    for (int lineNumber = 2; fgets(line, sizeof(line), file) != NULL; ++lineNumber) {
+        FluidEvent event;
+        if (!parse_event(line, &event)) {
+            printf("ERROR: %s:%d is not a valid event\n", path, lineNumber);
+            fluid_event_log_free(log);
+            fclose(file);
+            return NULL;
+        }
+        if (!fluid_event_log_append(log, event.step, &event.command)) {
+            fluid_event_log_free(log);
+            fclose(file);
+            return NULL;
+        }
+    }
+
+    fclose(file);
+    return log;
+}
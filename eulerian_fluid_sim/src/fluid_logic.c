@@ -1,11 +1,24 @@
 #include "fluid_logic.h"
+#include "fluid_solver.h"
+#include "fluid_profile.h"
+#include "fluid_checkpoint.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
 
 
-Fluid* fluid_init(float density, int numX, int numY, float cellSize) {
+/**
+ * Reserves the next 64-byte aligned block of the arena layout and returns its offset.
+ */
+static size_t arena_reserve(size_t* arenaSize, size_t numBytes) {
+    size_t offset = *arenaSize;
+    *arenaSize += (numBytes + FLUID_ARENA_ALIGNMENT - 1) & ~(size_t)(FLUID_ARENA_ALIGNMENT - 1);
+    return offset;
+}
+
+Fluid* fluid_init(float density, int numX, int numY, float cellSize, PressureSolverType pressureSolver) {
 
     Fluid* fluid = (Fluid*)calloc(1, sizeof(Fluid));
     if (fluid == NULL) {
@@ -19,253 +32,1184 @@ Fluid* fluid_init(float density, int numX, int numY, float cellSize) {
     fluid->numCellsX = numX + 2;
     fluid->numCellsY = numY + 2;
 
-    fluid->totalNumCells = (size_t)fluid->numCellsX * fluid->numCellsY;
+    // pad every column to a whole number of cache lines
+    int floatsPerLine = FLUID_ARENA_ALIGNMENT / (int)sizeof(float);
+    fluid->rowStride = (fluid->numCellsY + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+
+    fluid->totalNumCells = (size_t)fluid->numCellsX * fluid->rowStride;
+    fluid->numTilesX = (fluid->numCellsX + FLUID_TILE_SIZE - 1) / FLUID_TILE_SIZE;
+    fluid->numTilesY = (fluid->numCellsY + FLUID_TILE_SIZE - 1) / FLUID_TILE_SIZE;
+    size_t numTiles = (size_t)fluid->numTilesX * fluid->numTilesY;
     fluid->cellSize = cellSize;
+    fluid->pressureSolver = pressureSolver;
+    fluid->kernels = fluid_kernels_best();
+
+    // lay out every field in a single arena
+    size_t fieldBytes = fluid->totalNumCells * sizeof(float);
+    size_t arenaSize = 0;
+    size_t velocityXOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t velocityYOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t newVelocityXOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t newVelocityYOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t pressureOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t solidFlagsOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t pressureDeltaOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t neighborScaleOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t correctionXOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t correctionYOffset = arena_reserve(&arenaSize, fieldBytes);
+    size_t fluidCellMaskOffset = arena_reserve(&arenaSize, (fluid->totalNumCells + 63) / 64 * sizeof(uint64_t));
+    size_t columnResidualMaxOffset = arena_reserve(&arenaSize, (size_t)fluid->numCellsX * sizeof(float));
+    size_t columnResidualSquaresOffset = arena_reserve(&arenaSize, (size_t)fluid->numCellsX * sizeof(double));
+    size_t tileActiveOffset = arena_reserve(&arenaSize, numTiles);
+    size_t tileOccupiedOffset = arena_reserve(&arenaSize, numTiles);
+
+    // smoke comes last, so fluid_set_smoke_storage can resize it without moving the other fields
+    size_t smokeDensityOffset = arena_reserve(&arenaSize, fluid_smoke_buffer_bytes(fluid, SMOKE_STORAGE_FLOAT32));
+    size_t newSmokeDensityOffset = arena_reserve(&arenaSize, fluid_smoke_buffer_bytes(fluid, SMOKE_STORAGE_FLOAT32));
 
     // allocate memory
-    fluid->velocityX = (float*)calloc(fluid->totalNumCells, sizeof(float));
-    fluid->velocityY = (float*)calloc(fluid->totalNumCells, sizeof(float));
-    fluid->newVelocityX = (float*)calloc(fluid->totalNumCells, sizeof(float));
-    fluid->newVelocityY = (float*)calloc(fluid->totalNumCells, sizeof(float));
-    fluid->pressure = (float*)calloc(fluid->totalNumCells, sizeof(float));
-    fluid->solidFlags = (float*)calloc(fluid->totalNumCells, sizeof(float));
-    fluid->smokeDensity = (float*)calloc(fluid->totalNumCells, sizeof(float));
-    fluid->newSmokeDensity = (float*)calloc(fluid->totalNumCells, sizeof(float));
-
-
-    if (!fluid->velocityX || !fluid->velocityY || !fluid->newVelocityX || !fluid->newVelocityY ||
-        !fluid->pressure || !fluid->solidFlags || !fluid->smokeDensity || !fluid->newSmokeDensity) {
+    fluid->arenaAllocation = calloc(1, arenaSize + FLUID_ARENA_ALIGNMENT);
+    if (fluid->arenaAllocation == NULL) {
         fluid_free(fluid);
         printf("ERROR: fluid_init failed to allocate fluid arrays\n");
         return NULL;
     }
 
+    uintptr_t arenaAddress = ((uintptr_t)fluid->arenaAllocation + FLUID_ARENA_ALIGNMENT - 1) & ~(uintptr_t)(FLUID_ARENA_ALIGNMENT - 1);
+    fluid->arena = (unsigned char*)arenaAddress;
+    fluid->arenaSize = arenaSize;
+
+    fluid->velocityX = (float*)(fluid->arena + velocityXOffset);
+    fluid->velocityY = (float*)(fluid->arena + velocityYOffset);
+    fluid->newVelocityX = (float*)(fluid->arena + newVelocityXOffset);
+    fluid->newVelocityY = (float*)(fluid->arena + newVelocityYOffset);
+    fluid->pressure = (float*)(fluid->arena + pressureOffset);
+    fluid->solidFlags = (float*)(fluid->arena + solidFlagsOffset);
+    fluid->smokeDensity = (float*)(fluid->arena + smokeDensityOffset);
+    fluid->newSmokeDensity = (float*)(fluid->arena + newSmokeDensityOffset);
+    fluid->pressureDelta = (float*)(fluid->arena + pressureDeltaOffset);
+    fluid->neighborScale = (float*)(fluid->arena + neighborScaleOffset);
+    fluid->correctionX = (float*)(fluid->arena + correctionXOffset);
+    fluid->correctionY = (float*)(fluid->arena + correctionYOffset);
+    fluid->fluidCellMask = (uint64_t*)(fluid->arena + fluidCellMaskOffset);
+    fluid->obstaclesDirty = 1;
+    fluid->columnResidualMax = (float*)(fluid->arena + columnResidualMaxOffset);
+    fluid->columnResidualSquares = (double*)(fluid->arena + columnResidualSquaresOffset);
+
+    // every tile is active until tracking is turned on
+    fluid->tileActive = fluid->arena + tileActiveOffset;
+    fluid->tileOccupied = fluid->arena + tileOccupiedOffset;
+    memset(fluid->tileActive, 1, numTiles);
+    fluid->numActiveTiles = (int)numTiles;
+
+    if (pressureSolver == PRESSURE_SOLVER_PCG || pressureSolver == PRESSURE_SOLVER_MULTIGRID) {
+        fluid->pressureSystem = fluid_pressure_system_create(fluid->numCellsX, fluid->numCellsY, fluid->rowStride, pressureSolver);
+        if (fluid->pressureSystem == NULL) {
+            fluid_free(fluid);
+            printf("ERROR: fluid_init failed to create pressure solver\n");
+            return NULL;
+        }
+    }
+
+#ifdef FLUID_ENABLE_PROFILING
+    fluid->profile = fluid_profile_create();
+    if (fluid->profile == NULL) {
+        fluid_free(fluid);
+        return NULL;
+    }
+#endif
+
     return fluid;
 }
 
 void fluid_free(Fluid* fluidPtr) {
     if (fluidPtr) {
-        free(fluidPtr->velocityX);
-        free(fluidPtr->velocityY);
-        free(fluidPtr->newVelocityX);
-        free(fluidPtr->newVelocityY);
-        free(fluidPtr->pressure);
-        free(fluidPtr->solidFlags);
-        free(fluidPtr->smokeDensity);
-        free(fluidPtr->newSmokeDensity);
+        free(fluidPtr->arenaAllocation);
+        fluid_checkpoint_unmap(fluidPtr->arenaMapping, fluidPtr->arenaMappingSize);
+        fluid_pressure_system_free(fluidPtr->pressureSystem);
+        fluid_pool_free(fluidPtr->workerPool);
+        fluid_profile_free(fluidPtr->profile);
         free(fluidPtr);
     }
 }
 
-void fluid_integrate(Fluid* fluidPtr, float deltaTime, float gravityForce) {
+/**
+ * Points every field but the smoke buffers at the same offset in another arena.
+ */
+static void rebase_fields(Fluid* fluidPtr, unsigned char* arena) {
+    float** floatFields[] = {
+        &fluidPtr->velocityX, &fluidPtr->velocityY, &fluidPtr->newVelocityX, &fluidPtr->newVelocityY,
+        &fluidPtr->pressure, &fluidPtr->solidFlags, &fluidPtr->pressureDelta, &fluidPtr->neighborScale,
+        &fluidPtr->correctionX, &fluidPtr->correctionY, &fluidPtr->columnResidualMax
+    };
+    for (size_t field = 0; field < sizeof(floatFields) / sizeof(floatFields[0]); ++field) {
+        *floatFields[field] = (float*)(arena + ((unsigned char*)*floatFields[field] - fluidPtr->arena));
+    }
+    fluidPtr->fluidCellMask = (uint64_t*)(arena + ((unsigned char*)fluidPtr->fluidCellMask - fluidPtr->arena));
+    fluidPtr->columnResidualSquares = (double*)(arena + ((unsigned char*)fluidPtr->columnResidualSquares - fluidPtr->arena));
+    fluidPtr->tileActive = arena + (fluidPtr->tileActive - fluidPtr->arena);
+    fluidPtr->tileOccupied = arena + (fluidPtr->tileOccupied - fluidPtr->arena);
+}
 
-    int numRows = fluidPtr->numCellsY;
+/**
+ * Releases the current arena and makes arena, allocated as allocation (NULL when the caller owns it), the current one.
+ */
+static void replace_arena(Fluid* fluidPtr, unsigned char* arena, void* allocation) {
+    free(fluidPtr->arenaAllocation);
+    fluid_checkpoint_unmap(fluidPtr->arenaMapping, fluidPtr->arenaMappingSize);
+    fluidPtr->arenaAllocation = allocation;
+    fluidPtr->arenaMapping = NULL;
+    fluidPtr->arena = arena;
+}
 
-    for (int i = 1; i < fluidPtr->numCellsX - 1; ++i) {
-        for (int j = 1; j < fluidPtr->numCellsY - 1; ++j) {
+void fluid_move_arena(Fluid* fluidPtr, unsigned char* arena) {
+    memcpy(arena, fluidPtr->arena, fluidPtr->arenaSize);
+
+    // every field keeps its offset in the arena
+    rebase_fields(fluidPtr, arena);
+    fluidPtr->smokeDensity = (float*)(arena + ((unsigned char*)fluidPtr->smokeDensity - fluidPtr->arena));
+    fluidPtr->newSmokeDensity = (float*)(arena + ((unsigned char*)fluidPtr->newSmokeDensity - fluidPtr->arena));
+    replace_arena(fluidPtr, arena, NULL);
+}
+
+void fluid_set_num_threads(Fluid* fluidPtr, int numThreads) {
+
+    fluid_pool_free(fluidPtr->workerPool);
+    fluidPtr->workerPool = NULL;
+
+    // a single thread runs the passes inline
+    if (numThreads > 1) {
+        fluidPtr->workerPool = fluid_pool_create(numThreads);
+    }
+}
+
+int fluid_set_simd_level(Fluid* fluidPtr, FluidSimdLevel level) {
+    const FluidKernels* kernels = fluid_kernels_get(level);
+    if (kernels == NULL) return 0;
+
+    fluidPtr->kernels = kernels;
+    return 1;
+}
+
+void fluid_set_solver_tolerance(Fluid* fluidPtr, float tolerance, int warmStartPressure) {
+    fluidPtr->solverTolerance = tolerance;
+    fluidPtr->warmStartPressure = warmStartPressure;
+}
+
+static inline int is_fluid_cell(const Fluid* fluidPtr, size_t cellIndex) {
+    return (int)((fluidPtr->fluidCellMask[cellIndex >> 6] >> (cellIndex & 63)) & 1);
+}
+
+/**
+ * Rebuilds the fluid cell mask and the neighbor scales after obstacles changed.
+ */
+static void update_obstacle_cache(Fluid* fluidPtr) {
+    if (!fluidPtr->obstaclesDirty) return;
+
+    int numRows = fluidPtr->rowStride;
+    const float* solidFlags = fluidPtr->solidFlags;
+
+    memset(fluidPtr->fluidCellMask, 0, (fluidPtr->totalNumCells + 63) / 64 * sizeof(uint64_t));
+    memset(fluidPtr->neighborScale, 0, fluidPtr->totalNumCells * sizeof(float));
+
+    for (int i = 0; i < fluidPtr->numCellsX; ++i) {
+        for (int j = 0; j < fluidPtr->numCellsY; ++j) {
             size_t currentCellIndex = (size_t)i * numRows + j;
+            if (solidFlags[currentCellIndex] == 0.0f) continue;
+
+            fluidPtr->fluidCellMask[currentCellIndex >> 6] |= (uint64_t)1 << (currentCellIndex & 63);
+
+            // border cells are never relaxed
+            if (i == 0 || i == fluidPtr->numCellsX - 1 || j == 0 || j == fluidPtr->numCellsY - 1) continue;
+
+            float s = solidFlags[currentCellIndex - numRows] + solidFlags[currentCellIndex + numRows] +
+                      solidFlags[currentCellIndex - 1] + solidFlags[currentCellIndex + 1];
+            if (s != 0.0f) fluidPtr->neighborScale[currentCellIndex] = 1.0f / s;
+        }
+    }
+
+    fluidPtr->obstaclesDirty = 0;
+}
+
+void fluid_set_temporal_blocking(Fluid* fluidPtr, int numIterations) {
+    if (numIterations > FLUID_MAX_TEMPORAL_BLOCK) numIterations = FLUID_MAX_TEMPORAL_BLOCK;
+    fluidPtr->temporalBlockIterations = numIterations;
+}
+
+/**
+ * Cells [*first, *last) along one axis covered by a tile, clamped to [minCell, maxCell).
+ */
+static inline void tile_span(int tile, int minCell, int maxCell, int* first, int* last) {
+    *first = tile * FLUID_TILE_SIZE > minCell ? tile * FLUID_TILE_SIZE : minCell;
+    *last = (tile + 1) * FLUID_TILE_SIZE < maxCell ? (tile + 1) * FLUID_TILE_SIZE : maxCell;
+}
+
+static void activate_all_tiles(Fluid* fluidPtr) {
+    int numTiles = fluidPtr->numTilesX * fluidPtr->numTilesY;
+    if (fluidPtr->numActiveTiles == numTiles) return;
+
+    memset(fluidPtr->tileActive, 1, (size_t)numTiles);
+    fluidPtr->numActiveTiles = numTiles;
+}
+
+void fluid_set_active_tiles(Fluid* fluidPtr, int enabled, float threshold) {
+    fluidPtr->activeTilesEnabled = enabled;
+    fluidPtr->activityThreshold = threshold;
+    if (!enabled) activate_all_tiles(fluidPtr);
+}
+
+void fluid_set_advection_scheme(Fluid* fluidPtr, AdvectionScheme scheme) {
+    fluidPtr->advectionScheme = scheme;
+}
+
+static inline void swap_fields(float** front, float** back) {
+    float* temp = *front;
+    *front = *back;
+    *back = temp;
+}
+
+size_t fluid_smoke_buffer_bytes(const Fluid* fluidPtr, SmokeStorage storage) {
+    size_t valueBytes = storage == SMOKE_STORAGE_FLOAT32 ? sizeof(float) : sizeof(uint16_t);
+    size_t numBytes = fluidPtr->totalNumCells * valueBytes;
+    return (numBytes + FLUID_ARENA_ALIGNMENT - 1) & ~(size_t)(FLUID_ARENA_ALIGNMENT - 1);
+}
+
+void fluid_set_smoke_storage(Fluid* fluidPtr, SmokeStorage storage) {
+    if (storage == fluidPtr->smokeStorage) return;
+
+    // the other fields keep their offsets, only the smoke buffers at the end of the arena change size
+    size_t smokeOffset = fluidPtr->arenaSize - 2 * fluid_smoke_buffer_bytes(fluidPtr, fluidPtr->smokeStorage);
+    size_t arenaSize = smokeOffset;
+    size_t smokeDensityOffset = arena_reserve(&arenaSize, fluid_smoke_buffer_bytes(fluidPtr, storage));
+    size_t newSmokeDensityOffset = arena_reserve(&arenaSize, fluid_smoke_buffer_bytes(fluidPtr, storage));
+
+    void* allocation = calloc(1, arenaSize + FLUID_ARENA_ALIGNMENT);
+    if (allocation == NULL) {
+        printf("ERROR: fluid_set_smoke_storage failed to allocate the arena\n");
+        return;
+    }
+    uintptr_t arenaAddress = ((uintptr_t)allocation + FLUID_ARENA_ALIGNMENT - 1) & ~(uintptr_t)(FLUID_ARENA_ALIGNMENT - 1);
+    unsigned char* arena = (unsigned char*)arenaAddress;
+    memcpy(arena, fluidPtr->arena, smokeOffset);
+    rebase_fields(fluidPtr, arena);
+
+    // convert through fp32, staged in the new correctionX (scratch between advection passes) between two 16-bit formats
+    const FluidKernels* kernels = fluidPtr->kernels;
+    float* values = storage == SMOKE_STORAGE_FLOAT32 ? (float*)(arena + smokeDensityOffset) : fluidPtr->correctionX;
+    if (fluidPtr->smokeStorage == SMOKE_STORAGE_FLOAT32) {
+        values = fluidPtr->smokeDensity;
+    } else {
+        kernels->decode_half(fluidPtr->smokeHalf, values, fluidPtr->totalNumCells, fluid_smoke_half_format(fluidPtr));
+    }
+    fluidPtr->smokeStorage = storage;
+    if (storage != SMOKE_STORAGE_FLOAT32) {
+        kernels->encode_half(values, (uint16_t*)(arena + smokeDensityOffset), fluidPtr->totalNumCells, fluid_smoke_half_format(fluidPtr));
+    }
+
+    fluidPtr->smokeDensity = (float*)(arena + smokeDensityOffset);
+    fluidPtr->newSmokeDensity = (float*)(arena + newSmokeDensityOffset);
+    replace_arena(fluidPtr, arena, allocation);
+    fluidPtr->arenaSize = arenaSize;
+}
+
+float fluid_get_smoke(const Fluid* fluidPtr, int x, int y) {
+    if (x < 0 || x >= fluidPtr->numCellsX || y < 0 || y >= fluidPtr->numCellsY) return 0.0f;
+
+    size_t cellIndex = (size_t)x * fluidPtr->rowStride + y;
+    if (fluidPtr->smokeStorage == SMOKE_STORAGE_FLOAT32) return fluidPtr->smokeDensity[cellIndex];
+    return fluid_decode_half(fluidPtr->smokeHalf[cellIndex], fluid_smoke_half_format(fluidPtr));
+}
+
+void fluid_set_smoke(Fluid* fluidPtr, int x, int y, float amount) {
+    if (x < 0 || x >= fluidPtr->numCellsX || y < 0 || y >= fluidPtr->numCellsY) return;
+
+    size_t cellIndex = (size_t)x * fluidPtr->rowStride + y;
+    if (fluidPtr->smokeStorage == SMOKE_STORAGE_FLOAT32) {
+        fluidPtr->smokeDensity[cellIndex] = amount;
+    } else {
+        fluidPtr->smokeHalf[cellIndex] = fluid_encode_half(amount, fluid_smoke_half_format(fluidPtr));
+    }
+}
+
+/**
+ * Largest |value| of 16-bit values laid out like max_abs. Without the sign bit, fp16 and bf16 bit patterns
+ * order like their magnitudes, so the max is taken on the bits and decoded once.
+ */
+static float max_abs_half(const uint16_t* halves, size_t count, int numColumns, size_t columnStride, FluidHalfFormat format) {
+    uint16_t maxBits = 0;
+    for (int column = 0; column < numColumns; ++column) {
+        const uint16_t* columnHalves = halves + (size_t)column * columnStride;
+        for (size_t k = 0; k < count; ++k) {
+            uint16_t magnitude = (uint16_t)(columnHalves[k] & 0x7fffu);
+            maxBits = magnitude > maxBits ? magnitude : maxBits;
+        }
+    }
+    return fluid_decode_half(maxBits, format);
+}
+
+// marks the tiles of columns [rangeStart, rangeEnd) holding a value above the threshold
+static void find_occupied_tiles_task(void* taskData, int rangeStart, int rangeEnd) {
+    Fluid* fluidPtr = (Fluid*)taskData;
+    const FluidKernels* kernels = fluidPtr->kernels;
+    float threshold = fluidPtr->activityThreshold;
+    int numRows = fluidPtr->rowStride;
+
+    for (int tileX = rangeStart; tileX < rangeEnd; ++tileX) {
+        int firstColumn, lastColumn;
+        tile_span(tileX, 0, fluidPtr->numCellsX, &firstColumn, &lastColumn);
+
+        for (int tileY = 0; tileY < fluidPtr->numTilesY; ++tileY) {
+            int firstRow, lastRow;
+            tile_span(tileY, 0, fluidPtr->numCellsY, &firstRow, &lastRow);
+            size_t numTileRows = (size_t)(lastRow - firstRow);
+            int numTileColumns = lastColumn - firstColumn;
+            size_t tileStart = (size_t)firstColumn * numRows + firstRow;
+
+            float smokeMax = fluidPtr->smokeStorage == SMOKE_STORAGE_FLOAT32
+                ? kernels->max_abs(fluidPtr->smokeDensity + tileStart, numTileRows, numTileColumns, (size_t)numRows)
+                : max_abs_half(fluidPtr->smokeHalf + tileStart, numTileRows, numTileColumns, (size_t)numRows, fluid_smoke_half_format(fluidPtr));
+
+            int occupied = smokeMax > threshold ||
+                           kernels->max_abs(fluidPtr->velocityX + tileStart, numTileRows, numTileColumns, (size_t)numRows) > threshold ||
+                           kernels->max_abs(fluidPtr->velocityY + tileStart, numTileRows, numTileColumns, (size_t)numRows) > threshold;
+            fluidPtr->tileOccupied[(size_t)tileX * fluidPtr->numTilesY + tileY] = (uint8_t)occupied;
+        }
+    }
+}
+
+void fluid_update_active_tiles(Fluid* fluidPtr) {
+    if (!fluidPtr->activeTilesEnabled) {
+        activate_all_tiles(fluidPtr);
+        return;
+    }
 
-            // Apply gravity to only fluid cells
-            if (fluidPtr->solidFlags[currentCellIndex] == 1.0f) {
-                fluidPtr->velocityY[currentCellIndex] += gravityForce * deltaTime;
+    int numTilesX = fluidPtr->numTilesX;
+    int numTilesY = fluidPtr->numTilesY;
+    fluid_pool_run(fluidPtr->workerPool, find_occupied_tiles_task, fluidPtr, 0, numTilesX);
+
+    // semi-Lagrangian advection reads up to a cell away per CFL unit, so grow the occupied tiles by one tile
+    int numActiveTiles = 0;
+    for (int tileX = 0; tileX < numTilesX; ++tileX) {
+        for (int tileY = 0; tileY < numTilesY; ++tileY) {
+            uint8_t active = 0;
+            for (int x = tileX - 1; x <= tileX + 1 && !active; ++x) {
+                if (x < 0 || x >= numTilesX) continue;
+                for (int y = tileY - 1; y <= tileY + 1; ++y) {
+                    if (y >= 0 && y < numTilesY && fluidPtr->tileOccupied[(size_t)x * numTilesY + y]) active = 1;
+                }
             }
+            fluidPtr->tileActive[(size_t)tileX * numTilesY + tileY] = active;
+            numActiveTiles += active;
         }
     }
+    fluidPtr->numActiveTiles = numActiveTiles;
+}
+
+void fluid_integrate(Fluid* fluidPtr, float deltaTime, float gravityForce) {
+
+    int numRows = fluidPtr->rowStride;
+
+    for (int i = 1; i < fluidPtr->numCellsX - 1; ++i) {
+        size_t columnStart = (size_t)i * numRows + 1;
+
+        // Apply gravity to only fluid cells
+        fluidPtr->kernels->add_where_fluid(fluidPtr->velocityY + columnStart, fluidPtr->solidFlags + columnStart,
+                                           (size_t)fluidPtr->numCellsY - 2, gravityForce * deltaTime);
+    }
+}
+
+/**
+ * Relaxes a single fluid cell and pushes the pressure change into its four faces.
+ * Returns the divergence of the cell before the update.
+ */
+static inline float relax_cell(Fluid* fluidPtr, int i, int j, float overRelaxation) {
+    int numRows = fluidPtr->rowStride;
+    size_t currentCellIndex = (size_t)i * numRows + j;
+
+    // solid cells and cells without fluid neighbors have a scale of 0
+    float scale = fluidPtr->neighborScale[currentCellIndex];
+    if (scale == 0.0f) return 0.0f;
+
+    // indicate neighboring solid cells
+    float sx0 = fluidPtr->solidFlags[(size_t)(i - 1) * numRows + j];
+    float sx1 = fluidPtr->solidFlags[(size_t)(i + 1) * numRows + j];
+    float sy0 = fluidPtr->solidFlags[(size_t)i * numRows + (j - 1)];
+    float sy1 = fluidPtr->solidFlags[(size_t)i * numRows + (j + 1)];
+
+    // calculate velocity divergence
+    float divergence = fluidPtr->velocityX[currentCellIndex] - fluidPtr->velocityX[(size_t)(i + 1) * numRows + j] +
+                       fluidPtr->velocityY[currentCellIndex] - fluidPtr->velocityY[(size_t)i * numRows + (j + 1)];
+
+    // calculate pressure change
+    float dp = -divergence * scale;
+
+    // apply over relaxation
+    dp *= overRelaxation;
+
+    fluidPtr->pressure[currentCellIndex] += dp;
+
+    // adjust velocities based on changes
+    fluidPtr->velocityX[currentCellIndex] += sx0 * dp;
+    fluidPtr->velocityX[(size_t)(i + 1) * numRows + j] -= sx1 * dp;
+    fluidPtr->velocityY[currentCellIndex] += sy0 * dp;
+    fluidPtr->velocityY[(size_t)i * numRows + (j + 1)] -= sy1 * dp;
+
+    return divergence;
 }
 
-void fluid_solve_incompressibility(Fluid* fluidPtr, int numIterations, float overRelaxation) {
+/**
+ * Data shared by the workers of one red-black half-sweep.
+ */
+typedef struct {
+    Fluid* fluidPtr;
+    int color;
+    float overRelaxation;
+} RedBlackSweep;
+
+static void red_black_relax_task(void* taskData, int rangeStart, int rangeEnd) {
+    RedBlackSweep* sweep = (RedBlackSweep*)taskData;
+    Fluid* fluidPtr = sweep->fluidPtr;
+    int numRows = fluidPtr->rowStride;
 
-    int numRows = fluidPtr->numCellsY;
+    for (int i = rangeStart; i < rangeEnd; ++i) {
+        size_t columnStart = (size_t)i * numRows;
 
-    for (int iter = 0; iter < numIterations; ++iter) {
-        for (int i = 1; i < fluidPtr->numCellsX - 1; ++i) {
-            for (int j = 1; j < fluidPtr->numCellsY - 1; ++j) {
-                size_t currentCellIndex = (size_t)i * numRows + j;
+        FluidRelaxColumn column;
+        column.neighborScale = fluidPtr->neighborScale + columnStart;
+        column.velocityX = fluidPtr->velocityX + columnStart;
+        column.velocityXRight = fluidPtr->velocityX + columnStart + numRows;
+        column.velocityY = fluidPtr->velocityY + columnStart;
+        column.pressure = fluidPtr->pressure + columnStart;
+        column.pressureDelta = fluidPtr->pressureDelta + columnStart;
+        column.firstRow = 1;
+        column.lastRow = fluidPtr->numCellsY - 1;
+        // rows with (i + j) % 2 == color
+        column.rowParity = (sweep->color + i) & 1;
+        column.overRelaxation = sweep->overRelaxation;
 
-                if (fluidPtr->solidFlags[currentCellIndex] == 0.0f) continue;
+        fluidPtr->kernels->relax_column(&column);
+
+        // the first color starts the column's partials, the second adds to them
+        if (sweep->color == 0) {
+            fluidPtr->columnResidualMax[i] = column.residualMax;
+            fluidPtr->columnResidualSquares[i] = column.residualSquares;
+        } else {
+            fluidPtr->columnResidualMax[i] = fmaxf(fluidPtr->columnResidualMax[i], column.residualMax);
+            fluidPtr->columnResidualSquares[i] += column.residualSquares;
+        }
+    }
+}
 
-                // indicate neighboring solid cells
-                float sx0 = fluidPtr->solidFlags[(size_t)(i - 1) * numRows + j];
-                float sx1 = fluidPtr->solidFlags[(size_t)(i + 1) * numRows + j];
-                float sy0 = fluidPtr->solidFlags[(size_t)i * numRows + (j - 1)];
-                float sy1 = fluidPtr->solidFlags[(size_t)i * numRows + (j + 1)];
-                float s = sx0 + sx1 + sy0 + sy1;
+static void red_black_apply_task(void* taskData, int rangeStart, int rangeEnd) {
+    RedBlackSweep* sweep = (RedBlackSweep*)taskData;
+    Fluid* fluidPtr = sweep->fluidPtr;
+    int numRows = fluidPtr->rowStride;
 
-                if (s == 0.0f) continue;
+    // each column only writes the faces it stores, so columns stay independent
+    for (int i = rangeStart; i < rangeEnd; ++i) {
+        size_t columnStart = (size_t)i * numRows;
 
-                // calculate velocity divergence
-                float divergence = fluidPtr->velocityX[currentCellIndex] - fluidPtr->velocityX[(size_t)(i + 1) * numRows + j] +
-                                   fluidPtr->velocityY[currentCellIndex] - fluidPtr->velocityY[(size_t)i * numRows + (j + 1)];
+        fluidPtr->kernels->apply_column(fluidPtr->velocityX + columnStart, fluidPtr->velocityY + columnStart,
+                                        fluidPtr->solidFlags + columnStart, fluidPtr->solidFlags + columnStart - numRows,
+                                        fluidPtr->pressureDelta + columnStart, fluidPtr->pressureDelta + columnStart - numRows,
+                                        1, fluidPtr->numCellsY);
+    }
+}
 
-                // calculate pressure change
-                float dp = -divergence / s;
+/**
+ * Runs red-black iterations in blocks of temporalBlockIterations on the calling thread.
+ * Half-sweep h of the block (color h & 1) relaxes and applies column 1 + w - h in wave w, after the
+ * earlier half-sweeps of the wave, so every column sees the same neighbor state as in the full sweeps
+ * and only a window of about 2 * temporalBlockIterations columns is touched per wave.
+ * Returns the number of iterations run.
+ */
+static int red_black_blocked(Fluid* fluidPtr, int numIterations, float overRelaxation,
+                             float* residualMax, double* residualSquares) {
+    RedBlackSweep sweep = { fluidPtr, 0, overRelaxation };
+    int numCellsX = fluidPtr->numCellsX;
+    int iter = 0;
 
-                // apply over relaxation
-                dp *= overRelaxation;
+    float blockResidualMax[FLUID_MAX_TEMPORAL_BLOCK];
+    double blockResidualSquares[FLUID_MAX_TEMPORAL_BLOCK];
 
-                fluidPtr->pressure[currentCellIndex] += dp;
+    while (iter < numIterations) {
+        int blockSize = fluidPtr->temporalBlockIterations;
+        if (blockSize > numIterations - iter) blockSize = numIterations - iter;
+        int numHalfSweeps = 2 * blockSize;
 
-                // adjust velocities based on changes
-                fluidPtr->velocityX[currentCellIndex] += sx0 * dp;
-                fluidPtr->velocityX[(size_t)(i + 1) * numRows + j] -= sx1 * dp;
-                fluidPtr->velocityY[currentCellIndex] += sy0 * dp;
-                fluidPtr->velocityY[(size_t)i * numRows + (j + 1)] -= sy1 * dp;
+        for (int t = 0; t < blockSize; ++t) {
+            blockResidualMax[t] = 0.0f;
+            blockResidualSquares[t] = 0.0;
+        }
+
+        // the apply pass covers columns [1, numCellsX), the relax pass [1, numCellsX - 1)
+        int numWaves = numCellsX - 1 + numHalfSweeps - 1;
+        for (int wave = 0; wave < numWaves; ++wave) {
+            for (int h = 0; h < numHalfSweeps; ++h) {
+                int i = 1 + wave - h;
+                if (i < 1) break;
+                if (i >= numCellsX) continue;
+
+                sweep.color = h & 1;
+                if (i < numCellsX - 1) {
+                    red_black_relax_task(&sweep, i, i + 1);
+
+                    // the second color completes the column's residual of this iteration
+                    if (sweep.color == 1) {
+                        blockResidualMax[h / 2] = fmaxf(blockResidualMax[h / 2], fluidPtr->columnResidualMax[i]);
+                        blockResidualSquares[h / 2] += fluidPtr->columnResidualSquares[i];
+                    }
+                }
+                red_black_apply_task(&sweep, i, i + 1);
             }
         }
+
+        iter += blockSize;
+        *residualMax = blockResidualMax[blockSize - 1];
+        *residualSquares = blockResidualSquares[blockSize - 1];
+
+        int converged = 0;
+        for (int t = 0; t < blockSize; ++t) {
+            if (blockResidualMax[t] <= fluidPtr->solverTolerance) converged = 1;
+        }
+        if (converged) break;
     }
+
+    return iter;
 }
 
+/**
+ * Applies the pressure gradient of the previous step as the starting guess, or clears the pressure.
+ */
+static void prepare_pressure(Fluid* fluidPtr) {
+    int numRows = fluidPtr->rowStride;
 
-void fluid_extrapolate(Fluid* fluidPtr) {
-    int numRows = fluidPtr->numCellsY;
+    if (!fluidPtr->warmStartPressure) {
+        memset(fluidPtr->pressure, 0, fluidPtr->totalNumCells * sizeof(float));
+        return;
+    }
 
-    for (int i = 0; i < fluidPtr->numCellsX; ++i) {
-        for (int j = 0; j < fluidPtr->numCellsY; ++j) {
+    const float* p = fluidPtr->pressure;
+    const float* solidFlags = fluidPtr->solidFlags;
+
+    // same face updates the solvers make, so the pressure stays consistent with the velocities
+    for (int i = 1; i < fluidPtr->numCellsX; ++i) {
+        for (int j = 1; j < fluidPtr->numCellsY; ++j) {
             size_t currentCellIndex = (size_t)i * numRows + j;
-            // set velocity for solid cells
-            if (fluidPtr->solidFlags[currentCellIndex] == 0.0f) { 
-                fluidPtr->velocityX[currentCellIndex] = 0.0f;
-                fluidPtr->velocityY[currentCellIndex] = 0.0f;
+            size_t leftCellIndex = currentCellIndex - numRows;
+            size_t belowCellIndex = currentCellIndex - 1;
+
+            if (j < fluidPtr->numCellsY - 1) {
+                fluidPtr->velocityX[currentCellIndex] += solidFlags[currentCellIndex] * solidFlags[leftCellIndex] *
+                                                         (p[currentCellIndex] - p[leftCellIndex]);
+            }
+            if (i < fluidPtr->numCellsX - 1) {
+                fluidPtr->velocityY[currentCellIndex] += solidFlags[currentCellIndex] * solidFlags[belowCellIndex] *
+                                                         (p[currentCellIndex] - p[belowCellIndex]);
             }
         }
     }
 }
 
+static int store_solver_statistics(Fluid* fluidPtr, int numIterations, float residualMax, double residualSquares) {
+    fluidPtr->lastSolverIterations = numIterations;
+    fluidPtr->lastResidualMax = residualMax;
+    fluidPtr->lastResidualL2 = (float)sqrt(residualSquares);
+    return numIterations;
+}
+
+void fluid_begin_pressure_solve(Fluid* fluidPtr) {
+    update_obstacle_cache(fluidPtr);
+    prepare_pressure(fluidPtr);
+}
 
-float fluid_sample_field(Fluid* fluidPtr, float xPos, float yPos, FieldType fieldType) {
-    float cellSize = fluidPtr->cellSize;
-    int numRows = fluidPtr->numCellsY;
+void fluid_relax_color(Fluid* fluidPtr, int color, float overRelaxation) {
+    RedBlackSweep sweep = { fluidPtr, color, overRelaxation };
+    fluid_pool_run(fluidPtr->workerPool, red_black_relax_task, &sweep, 1, fluidPtr->numCellsX - 1);
+}
+
+void fluid_apply_pressure_delta(Fluid* fluidPtr) {
+    RedBlackSweep sweep = { fluidPtr, 0, 0.0f };
+    fluid_pool_run(fluidPtr->workerPool, red_black_apply_task, &sweep, 1, fluidPtr->numCellsX);
+}
+
+float fluid_sweep_residual(const Fluid* fluidPtr, double* residualSquares) {
+    float residualMax = 0.0f;
+    for (int i = 1; i < fluidPtr->numCellsX - 1; ++i) {
+        residualMax = fmaxf(residualMax, fluidPtr->columnResidualMax[i]);
+        *residualSquares += fluidPtr->columnResidualSquares[i];
+    }
+    return residualMax;
+}
+
+int fluid_solve_incompressibility(Fluid* fluidPtr, int numIterations, float overRelaxation) {
+
+    fluid_begin_pressure_solve(fluidPtr);
+
+    if (fluidPtr->pressureSystem) {
+        fluidPtr->lastSolverIterations = fluid_pressure_system_solve(fluidPtr->pressureSystem, fluidPtr, numIterations,
+                                                                     fluidPtr->solverTolerance,
+                                                                     &fluidPtr->lastResidualMax, &fluidPtr->lastResidualL2);
+        return fluidPtr->lastSolverIterations;
+    }
+
+    float residualMax = 0.0f;
+    double residualSquares = 0.0;
+    int iter = 0;
+
+    if (fluidPtr->pressureSolver == PRESSURE_SOLVER_RED_BLACK_SOR && fluidPtr->temporalBlockIterations > 1) {
+        iter = red_black_blocked(fluidPtr, numIterations, overRelaxation, &residualMax, &residualSquares);
+        return store_solver_statistics(fluidPtr, iter, residualMax, residualSquares);
+    }
+
+    while (iter < numIterations) {
+        ++iter;
+        residualMax = 0.0f;
+        residualSquares = 0.0;
+
+        if (fluidPtr->pressureSolver == PRESSURE_SOLVER_RED_BLACK_SOR) {
+            /* cells of one color only share faces with cells of the other color,
+               so all pressure changes of a half-sweep are computed first and then pushed into the faces */
+            for (int color = 0; color < 2; ++color) {
+                fluid_relax_color(fluidPtr, color, overRelaxation);
+                fluid_apply_pressure_delta(fluidPtr);
+            }
+            residualMax = fluid_sweep_residual(fluidPtr, &residualSquares);
+        } else {
+            for (int i = 1; i < fluidPtr->numCellsX - 1; ++i) {
+                for (int j = 1; j < fluidPtr->numCellsY - 1; ++j) {
+                    float divergence = relax_cell(fluidPtr, i, j, overRelaxation);
+                    residualMax = fmaxf(residualMax, fabsf(divergence));
+                    residualSquares += (double)divergence * divergence;
+                }
+            }
+        }
+
+        // the residual is measured during the sweep, so it lags the velocities by one iteration
+        if (residualMax <= fluidPtr->solverTolerance) break;
+    }
+
+    return store_solver_statistics(fluidPtr, iter, residualMax, residualSquares);
+}
+
+
+void fluid_extrapolate(Fluid* fluidPtr) {
+    // set velocity for solid cells
+    fluidPtr->kernels->zero_where_solid(fluidPtr->velocityX, fluidPtr->velocityY, fluidPtr->solidFlags, fluidPtr->totalNumCells);
+}
+
+
+/**
+ * Precomputed data for sampling one staggered field.
+ * The field value at index (i, j) lives at world position ((i + offsetX) * cellSize, (j + offsetY) * cellSize).
+ * Smoke samplers of 16-bit smoke read halfField instead of field.
+ */
+typedef struct {
+    const float* field;
+    const uint16_t* halfField;
+    int numRows;
+    float invCellSize;
+    float offsetX;
+    float offsetY;
+    float maxX;
+    float maxY;
+    int maxI;
+    int maxJ;
+} FieldSampler;
+
+static inline FieldSampler make_sampler(const Fluid* fluidPtr, const float* field, float offsetX, float offsetY) {
+    FieldSampler sampler;
+    sampler.field = field;
+    sampler.halfField = NULL;
+    sampler.numRows = fluidPtr->rowStride;
+    sampler.invCellSize = 1.0f / fluidPtr->cellSize;
+    sampler.offsetX = offsetX;
+    sampler.offsetY = offsetY;
+    sampler.maxX = (float)(fluidPtr->numCellsX - 1);
+    sampler.maxY = (float)(fluidPtr->numCellsY - 1);
+    sampler.maxI = fluidPtr->numCellsX - 2;
+    sampler.maxJ = fluidPtr->numCellsY - 2;
+    return sampler;
+}
+
+/**
+ * Clamps a position to the grid without branches, using min/max, and returns the index of the lower left of the
+ * 4 values around it. The lower corner is clamped so the upper corner is always inside.
+ * fx and fy are the position between the corners.
+ */
+static inline size_t sample_corner(const FieldSampler* sampler, float xPos, float yPos, float* fx, float* fy) {
+    float gridX = fminf(fmaxf(xPos * sampler->invCellSize - sampler->offsetX, 0.0f), sampler->maxX);
+    float gridY = fminf(fmaxf(yPos * sampler->invCellSize - sampler->offsetY, 0.0f), sampler->maxY);
+
+    int i = (int)gridX;
+    int j = (int)gridY;
+    i = i < sampler->maxI ? i : sampler->maxI;
+    j = j < sampler->maxJ ? j : sampler->maxJ;
+
+    *fx = gridX - (float)i;
+    *fy = gridY - (float)j;
+    return (size_t)i * sampler->numRows + j;
+}
+
+static inline float bilinear(float val00, float val01, float val10, float val11, float fx, float fy) {
+    return (val00 * (1 - fx) * (1 - fy)) +
+           (val10 * fx * (1 - fy)) +
+           (val01 * (1 - fx) * fy) +
+           (val11 * fx * fy);
+}
+
+/**
+ * Bilinear sample of a float field.
+ */
+static inline float sample(const FieldSampler* sampler, float xPos, float yPos) {
+    float fx, fy;
+    const float* corner = sampler->field + sample_corner(sampler, xPos, yPos, &fx, &fy);
+    return bilinear(corner[0], corner[1], corner[sampler->numRows], corner[sampler->numRows + 1], fx, fy);
+}
+
+/**
+ * Min and max of the 4 values sample() interpolates between at the same position, the limiter of the MacCormack correction.
+ */
+static inline void sample_bounds(const FieldSampler* sampler, float xPos, float yPos, float* minValue, float* maxValue) {
+    float fx, fy;
+    const float* corner = sampler->field + sample_corner(sampler, xPos, yPos, &fx, &fy);
+    *minValue = fminf(fminf(corner[0], corner[1]), fminf(corner[sampler->numRows], corner[sampler->numRows + 1]));
+    *maxValue = fmaxf(fmaxf(corner[0], corner[1]), fmaxf(corner[sampler->numRows], corner[sampler->numRows + 1]));
+}
+
+/**
+ * Smoke value at an index in the given storage format (the same for a whole pass, so the switch is well predicted).
+ */
+static inline float smoke_value(const FieldSampler* sampler, size_t index, SmokeStorage storage) {
+    switch (storage) {
+        case SMOKE_STORAGE_FLOAT16:
+            return fluid_half_to_float(sampler->halfField[index]);
+        case SMOKE_STORAGE_BFLOAT16:
+            return fluid_bfloat16_to_float(sampler->halfField[index]);
+        default:
+            return sampler->field[index];
+    }
+}
 
-    // convert world coordinates to cell coordinates
-    float cellX = xPos / cellSize;
-    float cellY = yPos / cellSize;
+/**
+ * The 4 smoke values sample() interpolates between, stored as val00, val01, val10, val11.
+ */
+static inline void smoke_corners(const FieldSampler* sampler, size_t corner, SmokeStorage storage, float values[4]) {
+    if (storage == SMOKE_STORAGE_FLOAT32) {
+        values[0] = sampler->field[corner];
+        values[1] = sampler->field[corner + 1];
+        values[2] = sampler->field[corner + sampler->numRows];
+        values[3] = sampler->field[corner + sampler->numRows + 1];
+        return;
+    }
+    FluidHalfFormat format = storage == SMOKE_STORAGE_BFLOAT16 ? FLUID_HALF_BFLOAT16 : FLUID_HALF_FLOAT16;
+    fluid_decode_half_corners(sampler->halfField + corner, sampler->halfField + corner + sampler->numRows, format, values);
+}
 
-    int i = (int)cellX;
-    int j = (int)cellY;
-    float fx = cellX - i;
-    float fy = cellY - j;
+/**
+ * sample() and sample_bounds() of a smoke field; 16-bit corners are converted to fp32 before they are combined.
+ */
+static inline float sample_smoke(const FieldSampler* sampler, float xPos, float yPos, SmokeStorage storage) {
+    float fx, fy;
+    float values[4];
+    smoke_corners(sampler, sample_corner(sampler, xPos, yPos, &fx, &fy), storage, values);
+    return bilinear(values[0], values[1], values[2], values[3], fx, fy);
+}
 
-    // clamp cell indices to grid boundary
-    i = fmaxf(0, fminf(i, fluidPtr->numCellsX - 1));
-    j = fmaxf(0, fminf(j, fluidPtr->numCellsY - 1));
+static inline void sample_smoke_bounds(const FieldSampler* sampler, float xPos, float yPos, SmokeStorage storage,
+                                       float* minValue, float* maxValue) {
+    float fx, fy;
+    float values[4];
+    smoke_corners(sampler, sample_corner(sampler, xPos, yPos, &fx, &fy), storage, values);
+    *minValue = fminf(fminf(values[0], values[1]), fminf(values[2], values[3]));
+    *maxValue = fmaxf(fmaxf(values[0], values[1]), fmaxf(values[2], values[3]));
+}
 
-    // get indices for nearest grid points
-    int i0 = i;
-    int i1 = fminf(i + 1, fluidPtr->numCellsX - 1); 
-    int j0 = j;
-    int j1 = fminf(j + 1, fluidPtr->numCellsY - 1);
+// x-velocities sit on the left face of a cell, y-velocities on the bottom face, smoke in the center
+static inline FieldSampler u_sampler(const Fluid* fluidPtr, const float* field) { return make_sampler(fluidPtr, field, 0.0f, 0.5f); }
+static inline FieldSampler v_sampler(const Fluid* fluidPtr, const float* field) { return make_sampler(fluidPtr, field, 0.5f, 0.0f); }
+static inline FieldSampler smoke_sampler(const Fluid* fluidPtr, const float* field) { return make_sampler(fluidPtr, field, 0.5f, 0.5f); }
 
-    // indices for 4 nearest grid points
-    size_t idx00 = (size_t)i0 * numRows + j0;
-    size_t idx10 = (size_t)i1 * numRows + j0;
-    size_t idx01 = (size_t)i0 * numRows + j1;
-    size_t idx11 = (size_t)i1 * numRows + j1;
+/**
+ * Sampler of the current smoke storage: field when smoke is fp32, else halfField.
+ */
+static inline FieldSampler smoke_storage_sampler(const Fluid* fluidPtr, const float* field, const uint16_t* halfField) {
+    FieldSampler sampler = smoke_sampler(fluidPtr, field);
+    if (fluidPtr->smokeStorage != SMOKE_STORAGE_FLOAT32) sampler.halfField = halfField;
+    return sampler;
+}
 
-    float val00, val10, val01, val11;
+float fluid_sample_field(Fluid* fluidPtr, float xPos, float yPos, FieldType fieldType) {
+    FieldSampler sampler;
 
     // select the correct field based on fieldType
     switch (fieldType) {
         case U_FIELD:
-            val00 = fluidPtr->velocityX[idx00];
-            val10 = fluidPtr->velocityX[idx10];
-            val01 = fluidPtr->velocityX[idx01];
-            val11 = fluidPtr->velocityX[idx11];
+            sampler = u_sampler(fluidPtr, fluidPtr->velocityX);
             break;
         case V_FIELD:
-            val00 = fluidPtr->velocityY[idx00];
-            val10 = fluidPtr->velocityY[idx10];
-            val01 = fluidPtr->velocityY[idx01];
-            val11 = fluidPtr->velocityY[idx11];
+            sampler = v_sampler(fluidPtr, fluidPtr->velocityY);
             break;
         case SMOKE_FIELD:
-            val00 = fluidPtr->smokeDensity[idx00];
-            val10 = fluidPtr->smokeDensity[idx10];
-            val01 = fluidPtr->smokeDensity[idx01];
-            val11 = fluidPtr->smokeDensity[idx11];
-            break;
+            sampler = smoke_storage_sampler(fluidPtr, fluidPtr->smokeDensity, fluidPtr->smokeHalf);
+            return sample_smoke(&sampler, xPos, yPos, fluidPtr->smokeStorage);
         default:
             return 0.0f;
     }
+    return sample(&sampler, xPos, yPos);
+}
+
+/**
+ * Copies the border ring of a field of valueBytes sized values, which the advection passes don't compute.
+ */
+static void copy_border(const Fluid* fluidPtr, const void* source, void* destination, size_t valueBytes) {
+    const unsigned char* sourceBytes = (const unsigned char*)source;
+    unsigned char* destinationBytes = (unsigned char*)destination;
+    size_t columnBytes = (size_t)fluidPtr->rowStride * valueBytes;
+    size_t lastColumn = (size_t)(fluidPtr->numCellsX - 1) * columnBytes;
+    size_t lastRow = (size_t)(fluidPtr->numCellsY - 1) * valueBytes;
+
+    memcpy(destinationBytes, sourceBytes, (size_t)fluidPtr->numCellsY * valueBytes);
+    memcpy(destinationBytes + lastColumn, sourceBytes + lastColumn, (size_t)fluidPtr->numCellsY * valueBytes);
 
-    // bilinear interpolation
-    float result = (val00 * (1 - fx) * (1 - fy)) +
-                   (val10 * fx * (1 - fy)) +
-                   (val01 * (1 - fx) * fy) +
-                   (val11 * fx * fy);
-    return result;
+    for (int i = 1; i < fluidPtr->numCellsX - 1; ++i) {
+        size_t columnStart = (size_t)i * columnBytes;
+        memcpy(destinationBytes + columnStart, sourceBytes + columnStart, valueBytes);
+        memcpy(destinationBytes + columnStart + lastRow, sourceBytes + columnStart + lastRow, valueBytes);
+    }
 }
 
-void fluid_advect_velocity(Fluid* fluidPtr, float deltaTime) {
+/**
+ * Data shared by the workers of one advection pass. Each worker writes its own strip of columns
+ * of the back buffers and only reads the front buffers, so the result doesn't depend on the split.
+ * The MacCormack correction runs as a second pass that also reads the semi-Lagrangian result
+ * in the back buffers (the *Forward samplers) and writes the correction buffers. Smoke swaps the
+ * roles of the two, see fluid_advect_smoke.
+ */
+typedef struct {
+    Fluid* fluidPtr;
+    float deltaTime;
+    int correction;
+    FieldSampler uSampler;
+    FieldSampler vSampler;
+    FieldSampler smokeSampler;
+    FieldSampler uForwardSampler;
+    FieldSampler vForwardSampler;
+    FieldSampler smokeForwardSampler;
+} AdvectionPass;
+
+/**
+ * u and v at the x- and y-face of a fluid cell. They come straight from the grid:
+ * the own component is stored there, the other one is the average of its 4 neighbors.
+ */
+static inline void face_velocities(const Fluid* fluidPtr, size_t cellIndex, float* uAtX, float* vAtX, float* uAtY, float* vAtY) {
+    const float* velocityX = fluidPtr->velocityX;
+    const float* velocityY = fluidPtr->velocityY;
+    size_t left = cellIndex - fluidPtr->rowStride;
+    size_t right = cellIndex + fluidPtr->rowStride;
+
+    *uAtX = velocityX[cellIndex];
+    *vAtX = 0.25f * (velocityY[left] + velocityY[cellIndex] + velocityY[left + 1] + velocityY[cellIndex + 1]);
+    *uAtY = 0.25f * (velocityX[cellIndex - 1] + velocityX[cellIndex] + velocityX[right - 1] + velocityX[right]);
+    *vAtY = velocityY[cellIndex];
+}
+
+/**
+ * MacCormack correction of one value: forwardValue came from the backward trace, backwardValue is the
+ * forward result traced forward again, so half their round-trip error is taken back. The result is clamped
+ * to the values the backward trace interpolated between, which keeps the scheme from overshooting.
+ */
+static inline float maccormack_clamp(float forwardValue, float currentValue, float backwardValue, float minValue, float maxValue) {
+    float corrected = forwardValue + 0.5f * (currentValue - backwardValue);
+    return fminf(fmaxf(corrected, minValue), maxValue);
+}
+
+static inline float maccormack_correct(const FieldSampler* sampler, float forwardValue, float currentValue, float backwardValue,
+                                       float prevX, float prevY) {
+    float minValue, maxValue;
+    sample_bounds(sampler, prevX, prevY, &minValue, &maxValue);
+    return maccormack_clamp(forwardValue, currentValue, backwardValue, minValue, maxValue);
+}
+
+static void advect_velocity_rows(AdvectionPass* pass, int i, int firstRow, int lastRow) {
+    Fluid* fluidPtr = pass->fluidPtr;
+    float deltaTime = pass->deltaTime;
 
     float cellSize = fluidPtr->cellSize;
     float halfCellSize = cellSize * 0.5f;
-    int numRows = fluidPtr->numCellsY;
+    int numRows = fluidPtr->rowStride;
+    const float* velocityX = fluidPtr->velocityX;
+    const float* velocityY = fluidPtr->velocityY;
 
-    // copy velocities for data in advection
-    memcpy(fluidPtr->newVelocityX, fluidPtr->velocityX, fluidPtr->totalNumCells * sizeof(float));
-    memcpy(fluidPtr->newVelocityY, fluidPtr->velocityY, fluidPtr->totalNumCells * sizeof(float));
+    for (int j = firstRow; j < lastRow; ++j) {
+        size_t currentCellIndex = (size_t)i * numRows + j;
+        if (!is_fluid_cell(fluidPtr, currentCellIndex)) {
+            fluidPtr->newVelocityX[currentCellIndex] = velocityX[currentCellIndex];
+            fluidPtr->newVelocityY[currentCellIndex] = velocityY[currentCellIndex];
+            continue;
+        }
 
-    for (int i = 1; i < fluidPtr->numCellsX - 1; ++i) {
-        for (int j = 1; j < fluidPtr->numCellsY - 1; ++j) {
-            size_t currentCellIndex = (size_t)i * numRows + j;
-            if (fluidPtr->solidFlags[currentCellIndex] == 0.0f) continue; 
-
-            // advect x-velocity
-            float xCurrent = (float)i * cellSize; 
-            float yCurrent = (float)j * cellSize + halfCellSize;
-            float uAvg = fluid_sample_field(fluidPtr, xCurrent, yCurrent, U_FIELD);
-            float vAvg = fluid_sample_field(fluidPtr, xCurrent, yCurrent, V_FIELD);
-            float prevX = xCurrent - deltaTime * uAvg;
-            float prevY = yCurrent - deltaTime * vAvg;
-            fluidPtr->newVelocityX[currentCellIndex] = fluid_sample_field(fluidPtr, prevX, prevY, U_FIELD);
-
-            // advect y-velocity
-            xCurrent = (float)i * cellSize + halfCellSize;
-            yCurrent = (float)j * cellSize;
-            uAvg = fluid_sample_field(fluidPtr, xCurrent, yCurrent, U_FIELD);
-            vAvg = fluid_sample_field(fluidPtr, xCurrent, yCurrent, V_FIELD);
-            prevX = xCurrent - deltaTime * uAvg;
-            prevY = yCurrent - deltaTime * vAvg;
-            fluidPtr->newVelocityY[currentCellIndex] = fluid_sample_field(fluidPtr, prevX, prevY, V_FIELD);
+        float uAtX, vAtX, uAtY, vAtY;
+        face_velocities(fluidPtr, currentCellIndex, &uAtX, &vAtX, &uAtY, &vAtY);
+
+        // advect x-velocity
+        float xCurrent = (float)i * cellSize;
+        float yCurrent = (float)j * cellSize + halfCellSize;
+        fluidPtr->newVelocityX[currentCellIndex] = sample(&pass->uSampler, xCurrent - deltaTime * uAtX, yCurrent - deltaTime * vAtX);
+
+        // advect y-velocity
+        xCurrent = (float)i * cellSize + halfCellSize;
+        yCurrent = (float)j * cellSize;
+        fluidPtr->newVelocityY[currentCellIndex] = sample(&pass->vSampler, xCurrent - deltaTime * uAtY, yCurrent - deltaTime * vAtY);
+    }
+}
+
+static void correct_velocity_rows(AdvectionPass* pass, int i, int firstRow, int lastRow) {
+    Fluid* fluidPtr = pass->fluidPtr;
+    float deltaTime = pass->deltaTime;
+
+    float cellSize = fluidPtr->cellSize;
+    float halfCellSize = cellSize * 0.5f;
+    int numRows = fluidPtr->rowStride;
+    const float* velocityX = fluidPtr->velocityX;
+    const float* velocityY = fluidPtr->velocityY;
+
+    for (int j = firstRow; j < lastRow; ++j) {
+        size_t currentCellIndex = (size_t)i * numRows + j;
+        if (!is_fluid_cell(fluidPtr, currentCellIndex)) {
+            fluidPtr->correctionX[currentCellIndex] = velocityX[currentCellIndex];
+            fluidPtr->correctionY[currentCellIndex] = velocityY[currentCellIndex];
+            continue;
         }
+
+        float uAtX, vAtX, uAtY, vAtY;
+        face_velocities(fluidPtr, currentCellIndex, &uAtX, &vAtX, &uAtY, &vAtY);
+
+        // x-velocity
+        float xCurrent = (float)i * cellSize;
+        float yCurrent = (float)j * cellSize + halfCellSize;
+        float backward = sample(&pass->uForwardSampler, xCurrent + deltaTime * uAtX, yCurrent + deltaTime * vAtX);
+        fluidPtr->correctionX[currentCellIndex] = maccormack_correct(&pass->uSampler, fluidPtr->newVelocityX[currentCellIndex],
+                                                                     velocityX[currentCellIndex], backward,
+                                                                     xCurrent - deltaTime * uAtX, yCurrent - deltaTime * vAtX);
+
+        // y-velocity
+        xCurrent = (float)i * cellSize + halfCellSize;
+        yCurrent = (float)j * cellSize;
+        backward = sample(&pass->vForwardSampler, xCurrent + deltaTime * uAtY, yCurrent + deltaTime * vAtY);
+        fluidPtr->correctionY[currentCellIndex] = maccormack_correct(&pass->vSampler, fluidPtr->newVelocityY[currentCellIndex],
+                                                                     velocityY[currentCellIndex], backward,
+                                                                     xCurrent - deltaTime * uAtY, yCurrent - deltaTime * vAtY);
+    }
+}
+
+static void advect_velocity_task(void* taskData, int rangeStart, int rangeEnd) {
+    AdvectionPass* pass = (AdvectionPass*)taskData;
+    Fluid* fluidPtr = pass->fluidPtr;
+    float* targetX = pass->correction ? fluidPtr->correctionX : fluidPtr->newVelocityX;
+    float* targetY = pass->correction ? fluidPtr->correctionY : fluidPtr->newVelocityY;
+
+    for (int i = rangeStart; i < rangeEnd; ++i) {
+        const uint8_t* tileColumn = fluidPtr->tileActive + (size_t)(i / FLUID_TILE_SIZE) * fluidPtr->numTilesY;
+
+        for (int tileY = 0; tileY < fluidPtr->numTilesY; ++tileY) {
+            int firstRow, lastRow;
+            tile_span(tileY, 1, fluidPtr->numCellsY - 1, &firstRow, &lastRow);
+
+            if (tileColumn[tileY]) {
+                if (pass->correction) {
+                    correct_velocity_rows(pass, i, firstRow, lastRow);
+                } else {
+                    advect_velocity_rows(pass, i, firstRow, lastRow);
+                }
+            } else {
+                // nothing moves in an inactive tile, whatever is left below the threshold is dropped
+                size_t tileStart = (size_t)i * fluidPtr->rowStride + firstRow;
+                memset(targetX + tileStart, 0, (size_t)(lastRow - firstRow) * sizeof(float));
+                memset(targetY + tileStart, 0, (size_t)(lastRow - firstRow) * sizeof(float));
+            }
+        }
+    }
+}
+
+void fluid_advect_velocity(Fluid* fluidPtr, float deltaTime) {
+
+    update_obstacle_cache(fluidPtr);
+
+    AdvectionPass pass;
+    pass.fluidPtr = fluidPtr;
+    pass.deltaTime = deltaTime;
+    pass.correction = 0;
+    pass.uSampler = u_sampler(fluidPtr, fluidPtr->velocityX);
+    pass.vSampler = v_sampler(fluidPtr, fluidPtr->velocityY);
+
+    // every cell of the back buffers is written, so the buffers can be swapped instead of copied
+    copy_border(fluidPtr, fluidPtr->velocityX, fluidPtr->newVelocityX, sizeof(float));
+    copy_border(fluidPtr, fluidPtr->velocityY, fluidPtr->newVelocityY, sizeof(float));
+
+    fluid_pool_run(fluidPtr->workerPool, advect_velocity_task, &pass, 1, fluidPtr->numCellsX - 1);
+
+    if (fluidPtr->advectionScheme == ADVECTION_MACCORMACK) {
+        pass.correction = 1;
+        pass.uForwardSampler = u_sampler(fluidPtr, fluidPtr->newVelocityX);
+        pass.vForwardSampler = v_sampler(fluidPtr, fluidPtr->newVelocityY);
+
+        copy_border(fluidPtr, fluidPtr->velocityX, fluidPtr->correctionX, sizeof(float));
+        copy_border(fluidPtr, fluidPtr->velocityY, fluidPtr->correctionY, sizeof(float));
+
+        fluid_pool_run(fluidPtr->workerPool, advect_velocity_task, &pass, 1, fluidPtr->numCellsX - 1);
+
+        // the corrected values become the velocity, the old velocity the next correction buffer
+        swap_fields(&fluidPtr->velocityX, &fluidPtr->correctionX);
+        swap_fields(&fluidPtr->velocityY, &fluidPtr->correctionY);
+        return;
     }
+
     // update velocity with advected values
-    memcpy(fluidPtr->velocityX, fluidPtr->newVelocityX, fluidPtr->totalNumCells * sizeof(float));
-    memcpy(fluidPtr->velocityY, fluidPtr->newVelocityY, fluidPtr->totalNumCells * sizeof(float));
+    swap_fields(&fluidPtr->velocityX, &fluidPtr->newVelocityX);
+    swap_fields(&fluidPtr->velocityY, &fluidPtr->newVelocityY);
 }
 
-void fluid_advect_smoke(Fluid* fluidPtr, float deltaTime) {
+/**
+ * Writes the advected smoke of rows [firstRow, lastRow) of column i to values[j - firstRow].
+ */
+static void advect_smoke_rows(AdvectionPass* pass, int i, int firstRow, int lastRow, float* values, SmokeStorage storage) {
+    Fluid* fluidPtr = pass->fluidPtr;
+    float deltaTime = pass->deltaTime;
+
     float cellSize = fluidPtr->cellSize;
     float halfCellSize = cellSize * 0.5f;
-    int numRows = fluidPtr->numCellsY;
+    int numRows = fluidPtr->rowStride;
+    const float* velocityX = fluidPtr->velocityX;
+    const float* velocityY = fluidPtr->velocityY;
 
-    // copy smoke density for data during advection
-    memcpy(fluidPtr->newSmokeDensity, fluidPtr->smokeDensity, fluidPtr->totalNumCells * sizeof(float));
+    for (int j = firstRow; j < lastRow; ++j) {
+        size_t currentCellIndex = (size_t)i * numRows + j;
+        // solid cells don't have smoke
+        if (!is_fluid_cell(fluidPtr, currentCellIndex)) {
+            values[j - firstRow] = 0.0f;
+            continue;
+        }
 
-    for (int i = 1; i < fluidPtr->numCellsX - 1; ++i) {
-        for (int j = 1; j < fluidPtr->numCellsY - 1; ++j) {
-            size_t currentCellIndex = (size_t)i * numRows + j;
-            // solid cells don't have smoke
-            if (fluidPtr->solidFlags[currentCellIndex] == 0.0f) {
-                fluidPtr->newSmokeDensity[currentCellIndex] = 0.0f;
-                continue;
+        // cell center coordinates and the velocity there (average of the cell's faces)
+        float xCurrent = (float)i * cellSize + halfCellSize;
+        float yCurrent = (float)j * cellSize + halfCellSize;
+        float uAvg = 0.5f * (velocityX[currentCellIndex] + velocityX[currentCellIndex + numRows]);
+        float vAvg = 0.5f * (velocityY[currentCellIndex] + velocityY[currentCellIndex + 1]);
+
+        float prevX = xCurrent - deltaTime * uAvg;
+        float prevY = yCurrent - deltaTime * vAvg;
+
+        values[j - firstRow] = sample_smoke(&pass->smokeSampler, prevX, prevY, storage);
+    }
+}
+
+static void correct_smoke_rows(AdvectionPass* pass, int i, int firstRow, int lastRow, float* values, SmokeStorage storage) {
+    Fluid* fluidPtr = pass->fluidPtr;
+    float deltaTime = pass->deltaTime;
+
+    float cellSize = fluidPtr->cellSize;
+    float halfCellSize = cellSize * 0.5f;
+    int numRows = fluidPtr->rowStride;
+    const float* velocityX = fluidPtr->velocityX;
+    const float* velocityY = fluidPtr->velocityY;
+
+    for (int j = firstRow; j < lastRow; ++j) {
+        size_t currentCellIndex = (size_t)i * numRows + j;
+        if (!is_fluid_cell(fluidPtr, currentCellIndex)) {
+            values[j - firstRow] = 0.0f;
+            continue;
+        }
+
+        float xCurrent = (float)i * cellSize + halfCellSize;
+        float yCurrent = (float)j * cellSize + halfCellSize;
+        float uAvg = 0.5f * (velocityX[currentCellIndex] + velocityX[currentCellIndex + numRows]);
+        float vAvg = 0.5f * (velocityY[currentCellIndex] + velocityY[currentCellIndex + 1]);
+
+        float backward = sample_smoke(&pass->smokeForwardSampler, xCurrent + deltaTime * uAvg, yCurrent + deltaTime * vAvg, storage);
+        float minValue, maxValue;
+        sample_smoke_bounds(&pass->smokeSampler, xCurrent - deltaTime * uAvg, yCurrent - deltaTime * vAvg, storage, &minValue, &maxValue);
+        values[j - firstRow] = maccormack_clamp(smoke_value(&pass->smokeForwardSampler, currentCellIndex, storage),
+                                                smoke_value(&pass->smokeSampler, currentCellIndex, storage), backward, minValue, maxValue);
+    }
+}
+
+static void advect_smoke_task(void* taskData, int rangeStart, int rangeEnd) {
+    AdvectionPass* pass = (AdvectionPass*)taskData;
+    Fluid* fluidPtr = pass->fluidPtr;
+    int halfStorage = fluidPtr->smokeStorage != SMOKE_STORAGE_FLOAT32;
+    int intoCorrection = !pass->correction && fluidPtr->advectionScheme == ADVECTION_MACCORMACK;
+    float* target = intoCorrection ? fluidPtr->correctionX : fluidPtr->newSmokeDensity;
+    uint16_t* halfTarget = intoCorrection ? fluidPtr->correctionHalf : fluidPtr->newSmokeHalf;
+    float tileValues[FLUID_TILE_SIZE];
+
+    for (int i = rangeStart; i < rangeEnd; ++i) {
+        const uint8_t* tileColumn = fluidPtr->tileActive + (size_t)(i / FLUID_TILE_SIZE) * fluidPtr->numTilesY;
+
+        for (int tileY = 0; tileY < fluidPtr->numTilesY; ++tileY) {
+            int firstRow, lastRow;
+            tile_span(tileY, 1, fluidPtr->numCellsY - 1, &firstRow, &lastRow);
+            size_t tileStart = (size_t)i * fluidPtr->rowStride + firstRow;
+            size_t numTileRows = (size_t)(lastRow - firstRow);
+
+            if (tileColumn[tileY]) {
+                // 16-bit smoke is computed into a float tile column and converted with one kernel call
+                float* values = halfStorage ? tileValues : target + tileStart;
+                if (pass->correction) {
+                    correct_smoke_rows(pass, i, firstRow, lastRow, values, fluidPtr->smokeStorage);
+                } else {
+                    advect_smoke_rows(pass, i, firstRow, lastRow, values, fluidPtr->smokeStorage);
+                }
+                if (halfStorage) {
+                    fluidPtr->kernels->encode_half(tileValues, halfTarget + tileStart, numTileRows, fluid_smoke_half_format(fluidPtr));
+                }
+            } else if (halfStorage) {
+                memset(halfTarget + tileStart, 0, numTileRows * sizeof(uint16_t));
+            } else {
+                memset(target + tileStart, 0, numTileRows * sizeof(float));
             }
+        }
+    }
+}
+
+void fluid_advect_smoke(Fluid* fluidPtr, float deltaTime) {
+
+    update_obstacle_cache(fluidPtr);
+
+    int halfStorage = fluidPtr->smokeStorage != SMOKE_STORAGE_FLOAT32;
 
-            // cell center coordinates
-            float xCurrent = (float)i * cellSize + halfCellSize;
-            float yCurrent = (float)j * cellSize + halfCellSize;
+    AdvectionPass pass;
+    pass.fluidPtr = fluidPtr;
+    pass.deltaTime = deltaTime;
+    pass.correction = 0;
+    pass.smokeSampler = smoke_storage_sampler(fluidPtr, fluidPtr->smokeDensity, fluidPtr->smokeHalf);
+
+    /* MacCormack advects into correctionX, free again once the velocities are advected, and corrects from there
+       into the back buffer: the smoke buffers are sized for the smoke storage and never trade places with it */
+    int maccormack = fluidPtr->advectionScheme == ADVECTION_MACCORMACK;
+    if (halfStorage) {
+        copy_border(fluidPtr, fluidPtr->smokeHalf, maccormack ? fluidPtr->correctionHalf : fluidPtr->newSmokeHalf, sizeof(uint16_t));
+    } else {
+        copy_border(fluidPtr, fluidPtr->smokeDensity, maccormack ? fluidPtr->correctionX : fluidPtr->newSmokeDensity, sizeof(float));
+    }
 
-            float uAvg = fluid_sample_field(fluidPtr, xCurrent, yCurrent, U_FIELD);
-            float vAvg = fluid_sample_field(fluidPtr, xCurrent, yCurrent, V_FIELD);
+    fluid_pool_run(fluidPtr->workerPool, advect_smoke_task, &pass, 1, fluidPtr->numCellsX - 1);
 
-            float prevX = xCurrent - deltaTime * uAvg;
-            float prevY = yCurrent - deltaTime * vAvg;
+    if (maccormack) {
+        pass.correction = 1;
+        pass.smokeForwardSampler = smoke_storage_sampler(fluidPtr, fluidPtr->correctionX, fluidPtr->correctionHalf);
 
-            fluidPtr->newSmokeDensity[currentCellIndex] = fluid_sample_field(fluidPtr, prevX, prevY, SMOKE_FIELD);
+        if (halfStorage) {
+            copy_border(fluidPtr, fluidPtr->smokeHalf, fluidPtr->newSmokeHalf, sizeof(uint16_t));
+        } else {
+            copy_border(fluidPtr, fluidPtr->smokeDensity, fluidPtr->newSmokeDensity, sizeof(float));
         }
+
+        fluid_pool_run(fluidPtr->workerPool, advect_smoke_task, &pass, 1, fluidPtr->numCellsX - 1);
     }
+
     // update smoke density with advected values
-    memcpy(fluidPtr->smokeDensity, fluidPtr->newSmokeDensity, fluidPtr->totalNumCells * sizeof(float));
+    swap_fields(&fluidPtr->smokeDensity, &fluidPtr->newSmokeDensity);
 }
 
 void fluid_set_obstacle(Fluid* fluidPtr, int x, int y, float isSolidFlag) {
@@ -274,14 +1218,17 @@ void fluid_set_obstacle(Fluid* fluidPtr, int x, int y, float isSolidFlag) {
         return; 
     }
 
-    int numRows = fluidPtr->numCellsY;
+    int numRows = fluidPtr->rowStride;
     size_t cellIndex = (size_t)x * numRows + y;
 
-    fluidPtr->solidFlags[cellIndex] = isSolidFlag;
+    if (fluidPtr->solidFlags[cellIndex] != isSolidFlag) {
+        fluidPtr->solidFlags[cellIndex] = isSolidFlag;
+        fluidPtr->obstaclesDirty = 1;
+    }
 
     // if solid, make it static
     if (isSolidFlag == 0.0f) {
-        fluidPtr->smokeDensity[cellIndex] = 0.0f; 
+        fluid_set_smoke(fluidPtr, x, y, 0.0f);
         fluidPtr->velocityX[cellIndex] = 0.0f; 
         if (x + 1 < fluidPtr->numCellsX) fluidPtr->velocityX[(size_t)(x + 1) * numRows + y] = 0.0f; 
         fluidPtr->velocityY[cellIndex] = 0.0f;
@@ -289,23 +1236,154 @@ void fluid_set_obstacle(Fluid* fluidPtr, int x, int y, float isSolidFlag) {
     }
 }
 
-void fluid_simulate_step(Fluid* fluidPtr, int numIterations, float deltaTime, float gravityForce, float overRelaxation, float dissipation, float smokeDissipation) {
-    size_t totalNumCells = fluidPtr->totalNumCells;
+/**
+ * Settings of one fused pre-projection pass.
+ */
+typedef struct {
+    Fluid* fluidPtr;
+    float dissipation;
+    float smokeDissipation;
+    float gravityDelta;
+} PreparePass;
 
-    // apply velocity dissipation
-    for (size_t i = 0; i < totalNumCells; ++i) {
-        fluidPtr->velocityX[i] *= dissipation;
-        fluidPtr->velocityY[i] *= dissipation;
+/**
+ * Runs the pre-projection kernel on rows [firstRow, lastRow) of column i. Gravity only reaches the interior,
+ * like fluid_integrate, so the rows are split at the border.
+ */
+static void prepare_rows(const PreparePass* pass, int i, int firstRow, int lastRow) {
+    Fluid* fluidPtr = pass->fluidPtr;
+    size_t columnStart = (size_t)i * fluidPtr->rowStride;
+    int isInteriorColumn = i > 0 && i < fluidPtr->numCellsX - 1;
+
+    // 16-bit smoke is scaled by its own kernel, the fused kernel then skips smoke
+    float* smoke = NULL;
+    if (fluidPtr->smokeStorage == SMOKE_STORAGE_FLOAT32) {
+        smoke = fluidPtr->smokeDensity + columnStart;
+    } else {
+        fluidPtr->kernels->scale_half(fluidPtr->smokeHalf + columnStart + firstRow, (size_t)(lastRow - firstRow),
+                                      pass->smokeDissipation, fluid_smoke_half_format(fluidPtr));
     }
 
-    // apply smoke dissipation
-    for (size_t i = 0; i < totalNumCells; ++i) {
-        fluidPtr->smokeDensity[i] *= smokeDissipation;
+    int interiorStart = firstRow > 1 ? firstRow : 1;
+    int interiorEnd = lastRow < fluidPtr->numCellsY - 1 ? lastRow : fluidPtr->numCellsY - 1;
+    if (interiorStart > interiorEnd) interiorStart = interiorEnd = lastRow;
+
+    int bounds[4] = { firstRow, interiorStart, interiorEnd, lastRow };
+    for (int segment = 0; segment < 3; ++segment) {
+        if (bounds[segment + 1] <= bounds[segment]) continue;
+        size_t start = columnStart + bounds[segment];
+        float gravity = (segment == 1 && isInteriorColumn) ? pass->gravityDelta : 0.0f;
+        fluidPtr->kernels->prepare_cells(fluidPtr->velocityX + start, fluidPtr->velocityY + start, smoke ? smoke + bounds[segment] : NULL,
+                                         fluidPtr->solidFlags + start, (size_t)(bounds[segment + 1] - bounds[segment]),
+                                         pass->dissipation, pass->smokeDissipation, gravity);
+    }
+}
+
+// prepares columns [rangeStart, rangeEnd), the whole column when every tile is active, else runs of active tiles
+static void prepare_task(void* taskData, int rangeStart, int rangeEnd) {
+    const PreparePass* pass = (const PreparePass*)taskData;
+    Fluid* fluidPtr = pass->fluidPtr;
+    int numTilesY = fluidPtr->numTilesY;
+    int allActive = fluidPtr->numActiveTiles == fluidPtr->numTilesX * numTilesY;
+
+    for (int i = rangeStart; i < rangeEnd; ++i) {
+        if (allActive) {
+            prepare_rows(pass, i, 0, fluidPtr->rowStride);
+            continue;
+        }
+
+        const uint8_t* tileColumn = fluidPtr->tileActive + (size_t)(i / FLUID_TILE_SIZE) * numTilesY;
+        for (int tileY = 0; tileY < numTilesY; ++tileY) {
+            if (!tileColumn[tileY]) continue;
+
+            int firstTileY = tileY;
+            while (tileY + 1 < numTilesY && tileColumn[tileY + 1]) ++tileY;
+
+            int firstRow, lastRow, unused;
+            tile_span(firstTileY, 0, fluidPtr->numCellsY, &firstRow, &unused);
+            tile_span(tileY, 0, fluidPtr->numCellsY, &unused, &lastRow);
+            prepare_rows(pass, i, firstRow, lastRow);
+        }
     }
+}
+
+void fluid_prepare_projection(Fluid* fluidPtr, float deltaTime, float gravityForce, float dissipation, float smokeDissipation) {
+
+    // gravity moves every fluid cell, so there is nothing to skip
+    if (gravityForce != 0.0f) activate_all_tiles(fluidPtr);
+
+    PreparePass pass;
+    pass.fluidPtr = fluidPtr;
+    pass.dissipation = dissipation;
+    pass.smokeDissipation = smokeDissipation;
+    pass.gravityDelta = gravityForce * deltaTime;
+
+    fluid_pool_run(fluidPtr->workerPool, prepare_task, &pass, 0, fluidPtr->numCellsX);
+}
+
+void fluid_simulate_step(Fluid* fluidPtr, int numIterations, float deltaTime, float gravityForce, float overRelaxation, float dissipation, float smokeDissipation) {
+    size_t totalNumCells = fluidPtr->totalNumCells;
+    size_t numInteriorCells = (size_t)(fluidPtr->numCellsX - 2) * (fluidPtr->numCellsY - 2);
 
-    fluid_integrate(fluidPtr, deltaTime, gravityForce);
-    fluid_solve_incompressibility(fluidPtr, numIterations, overRelaxation);
-    fluid_extrapolate(fluidPtr);
+    /* one sweep for dissipation, gravity and the solid velocities: the solvers never change the faces of
+       solid cells, so zeroing them before the solve leaves them zero for advection */
+    FLUID_PROFILE_START(prepareStart);
+    fluid_prepare_projection(fluidPtr, deltaTime, gravityForce, dissipation, smokeDissipation);
+    FLUID_PROFILE_STOP(fluidPtr, FLUID_PHASE_PREPARE, prepareStart, totalNumCells);
+
+    FLUID_PROFILE_START(solveStart);
+    int solverIterations = fluid_solve_incompressibility(fluidPtr, numIterations, overRelaxation);
+    FLUID_PROFILE_STOP(fluidPtr, FLUID_PHASE_SOLVE, solveStart, (size_t)solverIterations * numInteriorCells);
+    FLUID_PROFILE_SOLVE(fluidPtr, solverIterations);
+
+    FLUID_PROFILE_START(activeTilesStart);
+    if (gravityForce == 0.0f) fluid_update_active_tiles(fluidPtr);
+    FLUID_PROFILE_STOP(fluidPtr, FLUID_PHASE_ACTIVE_TILES, activeTilesStart, totalNumCells);
+
+    FLUID_PROFILE_START(advectVelocityStart);
     fluid_advect_velocity(fluidPtr, deltaTime);
+    FLUID_PROFILE_STOP(fluidPtr, FLUID_PHASE_ADVECT_VELOCITY, advectVelocityStart, numInteriorCells);
+
+    FLUID_PROFILE_START(advectSmokeStart);
     fluid_advect_smoke(fluidPtr, deltaTime);
+    FLUID_PROFILE_STOP(fluidPtr, FLUID_PHASE_ADVECT_SMOKE, advectSmokeStart, numInteriorCells);
+}
+
+uint64_t fluid_smoke_checksum(const Fluid* fluidPtr) {
+    uint64_t checksum = 0xcbf29ce484222325ull;
+
+    for (int i = 0; i < fluidPtr->numCellsX; ++i) {
+        size_t columnStart = (size_t)i * fluidPtr->rowStride;
+
+        // one word per cell instead of byte by byte, the padding rows are skipped
+        for (int j = 0; j < fluidPtr->numCellsY; ++j) {
+            uint32_t bits;
+            if (fluidPtr->smokeStorage == SMOKE_STORAGE_FLOAT32) {
+                memcpy(&bits, &fluidPtr->smokeDensity[columnStart + j], sizeof(bits));
+            } else {
+                bits = fluidPtr->smokeHalf[columnStart + j];
+            }
+            checksum = (checksum ^ bits) * 0x100000001b3ull;
+        }
+    }
+    return checksum;
+}
+
+float fluid_max_velocity(const Fluid* fluidPtr) {
+    float maxVelocityX = fluidPtr->kernels->max_abs(fluidPtr->velocityX, fluidPtr->totalNumCells, 1, 0);
+    float maxVelocityY = fluidPtr->kernels->max_abs(fluidPtr->velocityY, fluidPtr->totalNumCells, 1, 0);
+    return fmaxf(maxVelocityX, maxVelocityY);
+}
+
+int fluid_cfl_substeps(const Fluid* fluidPtr, float deltaTime, float maxCflNumber, int maxSubsteps) {
+    if (maxSubsteps < 1) maxSubsteps = 1;
+    if (maxCflNumber <= 0.0f) return 1;
+
+    // CFL number = cells travelled per step by the fastest velocity component
+    float cflNumber = fluid_max_velocity(fluidPtr) * deltaTime / fluidPtr->cellSize;
+    float numSubsteps = ceilf(cflNumber / maxCflNumber);
+
+    if (!(numSubsteps >= 1.0f)) return 1;
+    if (numSubsteps >= (float)maxSubsteps) return maxSubsteps;
+    return (int)numSubsteps;
 }
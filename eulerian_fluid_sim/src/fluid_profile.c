@@ -0,0 +1,179 @@
+#include "fluid_profile.h"
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+
+static const char* PHASE_NAMES[FLUID_NUM_PHASES] = {
+    "prepare",
+    "solve",
+    "active_tiles",
+    "advect_velocity",
+    "advect_smoke"
+};
+
+/**
+ * Ring buffer of the latest call times of one phase plus running totals.
+ */
+typedef struct {
+    uint64_t samples[FLUID_PROFILE_HISTORY];
+    int nextSample;
+    int numSamples;
+
+    long long numCalls;
+    uint64_t totalTicks;
+    long long cellsTouched;
+} PhaseHistory;
+
+struct FluidProfile {
+    PhaseHistory phases[FLUID_NUM_PHASES];
+    long long numSolves;
+    long long solverIterations;
+};
+
+FluidProfile* fluid_profile_create(void) {
+    FluidProfile* profile = (FluidProfile*)calloc(1, sizeof(FluidProfile));
+    if (profile == NULL) {
+        printf("ERROR: fluid_profile_create failed to allocate profile\n");
+        return NULL;
+    }
+    return profile;
+}
+
+void fluid_profile_free(FluidProfile* profile) {
+    free(profile);
+}
+
+uint64_t fluid_profile_now(void) {
+    return SDL_GetPerformanceCounter();
+}
+
+void fluid_profile_record(FluidProfile* profile, FluidPhase phase, uint64_t startTicks, size_t numCells) {
+    if (profile == NULL) return;
+
+    uint64_t ticks = SDL_GetPerformanceCounter() - startTicks;
+    PhaseHistory* history = &profile->phases[phase];
+
+    history->samples[history->nextSample] = ticks;
+    history->nextSample = (history->nextSample + 1) % FLUID_PROFILE_HISTORY;
+    if (history->numSamples < FLUID_PROFILE_HISTORY) history->numSamples++;
+
+    history->numCalls++;
+    history->totalTicks += ticks;
+    history->cellsTouched += (long long)numCells;
+}
+
+void fluid_profile_record_solve(FluidProfile* profile, int numIterations) {
+    if (profile == NULL) return;
+
+    profile->numSolves++;
+    profile->solverIterations += numIterations;
+}
+
+void fluid_profile_reset(Fluid* fluidPtr) {
+    if (fluidPtr->profile == NULL) return;
+    memset(fluidPtr->profile, 0, sizeof(FluidProfile));
+}
+
+static int compare_ticks(const void* a, const void* b) {
+    uint64_t left = *(const uint64_t*)a;
+    uint64_t right = *(const uint64_t*)b;
+    return (left > right) - (left < right);
+}
+
+int fluid_profile_phase_stats(const Fluid* fluidPtr, FluidPhase phase, FluidPhaseStats* stats) {
+    memset(stats, 0, sizeof(FluidPhaseStats));
+    if (phase < 0 || phase >= FLUID_NUM_PHASES) return 0;
+    stats->name = PHASE_NAMES[phase];
+    if (fluidPtr->profile == NULL) return 0;
+
+    const PhaseHistory* history = &fluidPtr->profile->phases[phase];
+    double millisecondsPerTick = 1000.0 / (double)SDL_GetPerformanceFrequency();
+
+    stats->numCalls = history->numCalls;
+    stats->totalMilliseconds = (double)history->totalTicks * millisecondsPerTick;
+    stats->cellsTouched = history->cellsTouched;
+    if (history->cellsTouched > 0) {
+        stats->nanosecondsPerCell = stats->totalMilliseconds * 1e6 / (double)history->cellsTouched;
+    }
+
+    if (history->numSamples > 0) {
+        uint64_t sorted[FLUID_PROFILE_HISTORY];
+        memcpy(sorted, history->samples, (size_t)history->numSamples * sizeof(uint64_t));
+        qsort(sorted, (size_t)history->numSamples, sizeof(uint64_t), compare_ticks);
+
+        // nearest-rank percentiles
+        int p50Index = (history->numSamples * 50 + 99) / 100 - 1;
+        int p99Index = (history->numSamples * 99 + 99) / 100 - 1;
+        stats->p50Milliseconds = (double)sorted[p50Index] * millisecondsPerTick;
+        stats->p99Milliseconds = (double)sorted[p99Index] * millisecondsPerTick;
+    }
+    return 1;
+}
+
+long long fluid_profile_num_steps(const Fluid* fluidPtr) {
+    if (fluidPtr->profile == NULL) return 0;
+    return fluidPtr->profile->phases[FLUID_PHASE_PREPARE].numCalls;
+}
+
+long long fluid_profile_solver_iterations(const Fluid* fluidPtr) {
+    if (fluidPtr->profile == NULL) return 0;
+    return fluidPtr->profile->solverIterations;
+}
+
+int fluid_profile_write_csv(const Fluid* fluidPtr, const char* path) {
+    if (fluidPtr->profile == NULL) {
+        printf("ERROR: fluid_profile_write_csv needs a build with FLUID_ENABLE_PROFILING\n");
+        return 0;
+    }
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf("ERROR: fluid_profile_write_csv failed to open %s\n", path);
+        return 0;
+    }
+
+    fprintf(file, "phase,calls,total_ms,p50_ms,p99_ms,cells_touched,ns_per_cell\n");
+    for (int phase = 0; phase < FLUID_NUM_PHASES; ++phase) {
+        FluidPhaseStats stats;
+        fluid_profile_phase_stats(fluidPtr, (FluidPhase)phase, &stats);
+        fprintf(file, "%s,%lld,%.6f,%.6f,%.6f,%lld,%.4f\n", stats.name, stats.numCalls, stats.totalMilliseconds,
+                stats.p50Milliseconds, stats.p99Milliseconds, stats.cellsTouched, stats.nanosecondsPerCell);
+    }
+
+    int ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+int fluid_profile_write_json(const Fluid* fluidPtr, const char* path) {
+    if (fluidPtr->profile == NULL) {
+        printf("ERROR: fluid_profile_write_json needs a build with FLUID_ENABLE_PROFILING\n");
+        return 0;
+    }
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        printf("ERROR: fluid_profile_write_json failed to open %s\n", path);
+        return 0;
+    }
+
+    fprintf(file, "{\n  \"grid\": [%d, %d],\n  \"steps\": %lld,\n  \"solver_iterations\": %lld,\n  \"phases\": [\n",
+            fluidPtr->numCellsX - 2, fluidPtr->numCellsY - 2, fluid_profile_num_steps(fluidPtr),
+            fluidPtr->profile->solverIterations);
+
+    for (int phase = 0; phase < FLUID_NUM_PHASES; ++phase) {
+        FluidPhaseStats stats;
+        fluid_profile_phase_stats(fluidPtr, (FluidPhase)phase, &stats);
+        fprintf(file, "    {\"name\": \"%s\", \"calls\": %lld, \"total_ms\": %.6f, \"p50_ms\": %.6f, \"p99_ms\": %.6f, "
+                      "\"cells_touched\": %lld, \"ns_per_cell\": %.4f}%s\n",
+                stats.name, stats.numCalls, stats.totalMilliseconds, stats.p50Milliseconds, stats.p99Milliseconds,
+                stats.cellsTouched, stats.nanosecondsPerCell, phase + 1 < FLUID_NUM_PHASES ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    int ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,690 @@
+// 64-bit offsets for fseeko and ftello on 32-bit systems
+#define _FILE_OFFSET_BITS 64
+
+#include "fluid_recorder.h"
+#include <SDL.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define RECORDING_VERSION 1
+#define HEADER_BYTES 40
+#define FRAME_HEADER_BYTES 20
+#define INDEX_ENTRY_BYTES 24
+#define TRAILER_BYTES 24
+
+#define FRAME_TAG 0x454d5246u       // "FRME"
+#define FRAME_KEYFRAME 1u
+
+// longest zero or literal run of one token of the run encoding
+#define MAX_RUN 65535
+
+// stdio buffer of the recording file
+#define FILE_BUFFER_BYTES (1 << 20)
+
+// recordings grow past 2 GB, so seek with 64-bit offsets
+#ifdef _WIN32
+#define file_seek _fseeki64
+#define file_tell _ftelli64
+#else
+#define file_seek fseeko
+#define file_tell ftello
+#endif
+
+static const char RECORDING_MAGIC[8] = { 'F', 'L', 'U', 'I', 'D', 'R', 'E', 'C' };
+static const char INDEX_MAGIC[8] = { 'F', 'L', 'U', 'I', 'D', 'I', 'D', 'X' };
+
+
+// ------------------------------------------------------------------------------------------
+// Value encoding shared by the recorder and the reader
+// ------------------------------------------------------------------------------------------
+
+static inline uint32_t quantize(float value, FluidRecordPrecision precision) {
+    if (precision == FLUID_RECORD_FLOAT16) return fluid_float_to_half(value);
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline float dequantize(uint32_t word, FluidRecordPrecision precision) {
+    if (precision == FLUID_RECORD_FLOAT16) return fluid_half_to_float((uint16_t)word);
+    float value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+static inline int word_bytes(FluidRecordPrecision precision) { return precision == FLUID_RECORD_FLOAT16 ? 2 : 4; }
+static inline uint32_t word_mask(FluidRecordPrecision precision) { return precision == FLUID_RECORD_FLOAT16 ? 0xffffu : 0xffffffffu; }
+
+static int count_fields(int fields) {
+    return ((fields & FLUID_RECORD_SMOKE) ? 1 : 0) + ((fields & FLUID_RECORD_VELOCITY) ? 2 : 0);
+}
+
+static void put_u16(uint8_t* bytes, uint32_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* bytes, uint32_t value) {
+    put_u16(bytes, value & 0xffffu);
+    put_u16(bytes + 2, value >> 16);
+}
+
+static void put_u64(uint8_t* bytes, uint64_t value) {
+    put_u32(bytes, (uint32_t)value);
+    put_u32(bytes + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t get_u16(const uint8_t* bytes) { return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8); }
+static uint32_t get_u32(const uint8_t* bytes) { return get_u16(bytes) | (get_u16(bytes + 2) << 16); }
+static uint64_t get_u64(const uint8_t* bytes) { return (uint64_t)get_u32(bytes) | ((uint64_t)get_u32(bytes + 4) << 32); }
+
+// upper bound of encode_runs output: every token carries at least one word, except a final run of zeros
+static size_t max_encoded_bytes(size_t count, int wordBytes) {
+    return count * (size_t)(wordBytes + 4) + 4;
+}
+
+/**
+ * Encodes words as tokens of (u16 zero count, u16 literal count, literal words). Returns the encoded size.
+ */
+static size_t encode_runs(const uint32_t* words, size_t count, int wordBytes, uint8_t* out) {
+    size_t size = 0;
+    size_t k = 0;
+
+    while (k < count) {
+        uint32_t numZeros = 0;
+        while (k < count && numZeros < MAX_RUN && words[k] == 0) {
+            ++numZeros;
+            ++k;
+        }
+
+        uint8_t* token = out + size;
+        size += 4;
+        uint32_t numLiterals = 0;
+        while (k < count && numLiterals < MAX_RUN && words[k] != 0) {
+            if (wordBytes == 2) put_u16(out + size, words[k]);
+            else put_u32(out + size, words[k]);
+            size += (size_t)wordBytes;
+            ++numLiterals;
+            ++k;
+        }
+
+        put_u16(token, numZeros);
+        put_u16(token + 2, numLiterals);
+    }
+    return size;
+}
+
+/**
+ * Decodes exactly count words written by encode_runs. Returns 0 when the data does not fit.
+ */
+static int decode_runs(const uint8_t* in, size_t size, int wordBytes, uint32_t* words, size_t count) {
+    size_t position = 0;
+    size_t k = 0;
+
+    while (position < size) {
+        if (size - position < 4) return 0;
+        size_t numZeros = get_u16(in + position);
+        size_t numLiterals = get_u16(in + position + 2);
+        position += 4;
+
+        if (numZeros + numLiterals > count - k) return 0;
+        if (numLiterals * (size_t)wordBytes > size - position) return 0;
+
+        memset(words + k, 0, numZeros * sizeof(uint32_t));
+        k += numZeros;
+        for (size_t literal = 0; literal < numLiterals; ++literal) {
+            words[k++] = wordBytes == 2 ? get_u16(in + position) : get_u32(in + position);
+            position += (size_t)wordBytes;
+        }
+    }
+    return k == count;
+}
+
+
+// ------------------------------------------------------------------------------------------
+// Recorder
+// ------------------------------------------------------------------------------------------
+
+/**
+ * One captured frame: the recorded fields copied as they are laid out in the fluid, padding included.
+ * filled is set by the capturing thread and cleared by the writer once the frame is written.
+ */
+typedef struct {
+    float* fields;
+    long long step;
+    atomic_int filled;
+} CaptureBuffer;
+
+struct FluidRecorder {
+    FILE* file;
+    FluidRecorderSettings settings;
+    int numFields;
+    int numCellsX;
+    int numCellsY;
+    int rowStride;
+    size_t totalNumCells;
+    size_t numValues;
+
+    // buffers are filled and written in the same round-robin order, the semaphore counts filled buffers
+    CaptureBuffer* buffers;
+    int captureIndex;
+    SDL_sem* framesQueued;
+    SDL_Thread* thread;
+
+    // writer thread state
+    uint32_t* words;
+    uint32_t* previousWords;
+    uint8_t* encoded;
+    uint8_t* index;
+    long long indexCapacity;
+    long long numFramesWritten;
+    uint64_t fileOffset;
+    int writeFailed;
+
+    atomic_llong framesCaptured;
+    atomic_llong framesDropped;
+    atomic_llong framesWritten;
+    atomic_llong bytesWritten;
+};
+
+static int write_bytes(FluidRecorder* recorder, const void* bytes, size_t size) {
+    if (recorder->writeFailed) return 0;
+    if (fwrite(bytes, 1, size, recorder->file) != size) {
+        recorder->writeFailed = 1;
+        printf("ERROR: fluid recorder failed to write to the recording\n");
+        return 0;
+    }
+    recorder->fileOffset += size;
+    return 1;
+}
+
+static int append_index_entry(FluidRecorder* recorder, long long step, uint64_t offset, uint32_t flags) {
+    if (recorder->numFramesWritten == recorder->indexCapacity) {
+        long long capacity = recorder->indexCapacity ? recorder->indexCapacity * 2 : 1024;
+        uint8_t* index = (uint8_t*)realloc(recorder->index, (size_t)capacity * INDEX_ENTRY_BYTES);
+        if (index == NULL) {
+            recorder->writeFailed = 1;
+            printf("ERROR: fluid recorder failed to grow the frame index\n");
+            return 0;
+        }
+        recorder->index = index;
+        recorder->indexCapacity = capacity;
+    }
+
+    uint8_t* entry = recorder->index + (size_t)recorder->numFramesWritten * INDEX_ENTRY_BYTES;
+    put_u64(entry, (uint64_t)step);
+    put_u64(entry + 8, offset);
+    put_u32(entry + 16, flags);
+    put_u32(entry + 20, 0);
+    return 1;
+}
+
+/**
+ * Quantizes, delta-encodes and run-encodes one captured frame and writes it with its index entry.
+ */
+static void write_frame(FluidRecorder* recorder, const CaptureBuffer* buffer) {
+    FluidRecordPrecision precision = recorder->settings.precision;
+    int wordBytes = word_bytes(precision);
+    uint32_t mask = word_mask(precision);
+    int keyframeInterval = recorder->settings.keyframeInterval;
+    int isKeyframe = keyframeInterval <= 1 || recorder->numFramesWritten % keyframeInterval == 0;
+
+    size_t payloadBytes = 0;
+    for (int field = 0; field < recorder->numFields; ++field) {
+        const float* values = buffer->fields + (size_t)field * recorder->totalNumCells;
+        uint32_t* previous = recorder->previousWords + (size_t)field * recorder->numValues;
+        uint32_t* words = recorder->words;
+
+        // drop the column padding, keep the bits of this frame for the next delta
+        size_t k = 0;
+        for (int i = 0; i < recorder->numCellsX; ++i) {
+            const float* column = values + (size_t)i * recorder->rowStride;
+            for (int j = 0; j < recorder->numCellsY; ++j, ++k) {
+                uint32_t word = quantize(column[j], precision);
+                words[k] = isKeyframe ? word : ((word - previous[k]) & mask);
+                previous[k] = word;
+            }
+        }
+
+        uint8_t* fieldBytes = recorder->encoded + payloadBytes;
+        size_t encodedSize = encode_runs(words, recorder->numValues, wordBytes, fieldBytes + 4);
+        put_u32(fieldBytes, (uint32_t)encodedSize);
+        payloadBytes += 4 + encodedSize;
+    }
+
+    uint32_t flags = isKeyframe ? FRAME_KEYFRAME : 0u;
+    uint8_t header[FRAME_HEADER_BYTES];
+    put_u32(header, FRAME_TAG);
+    put_u32(header + 4, flags);
+    put_u64(header + 8, (uint64_t)buffer->step);
+    put_u32(header + 16, (uint32_t)payloadBytes);
+
+    uint64_t frameOffset = recorder->fileOffset;
+    if (!write_bytes(recorder, header, sizeof(header))) return;
+    if (!write_bytes(recorder, recorder->encoded, payloadBytes)) return;
+    if (!append_index_entry(recorder, buffer->step, frameOffset, flags)) return;
+
+    recorder->numFramesWritten++;
+    atomic_fetch_add_explicit(&recorder->framesWritten, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&recorder->bytesWritten, (long long)(FRAME_HEADER_BYTES + payloadBytes), memory_order_relaxed);
+}
+
+static int writer_thread(void* data) {
+    FluidRecorder* recorder = (FluidRecorder*)data;
+    int writeIndex = 0;
+
+    for (;;) {
+        SDL_SemWait(recorder->framesQueued);
+
+        // fluid_recorder_close posts once more after the last capture, which finds no filled buffer
+        CaptureBuffer* buffer = &recorder->buffers[writeIndex];
+        if (!atomic_load_explicit(&buffer->filled, memory_order_acquire)) break;
+
+        write_frame(recorder, buffer);
+        atomic_store_explicit(&buffer->filled, 0, memory_order_release);
+        writeIndex = (writeIndex + 1) % recorder->settings.numBuffers;
+    }
+    return 0;
+}
+
+static void free_recorder(FluidRecorder* recorder) {
+    if (recorder->file) fclose(recorder->file);
+    if (recorder->framesQueued) SDL_DestroySemaphore(recorder->framesQueued);
+    if (recorder->buffers) {
+        for (int buffer = 0; buffer < recorder->settings.numBuffers; ++buffer) {
+            free(recorder->buffers[buffer].fields);
+        }
+        free(recorder->buffers);
+    }
+    free(recorder->words);
+    free(recorder->previousWords);
+    free(recorder->encoded);
+    free(recorder->index);
+    free(recorder);
+}
+
+FluidRecorder* fluid_recorder_create(const char* path, const Fluid* fluidPtr, const FluidRecorderSettings* settings) {
+
+    if (count_fields(settings->fields) == 0) {
+        printf("ERROR: fluid_recorder_create needs at least one field to record\n");
+        return NULL;
+    }
+
+    FluidRecorder* recorder = (FluidRecorder*)calloc(1, sizeof(FluidRecorder));
+    if (recorder == NULL) {
+        printf("ERROR: fluid_recorder_create failed to allocate recorder\n");
+        return NULL;
+    }
+
+    recorder->settings = *settings;
+    if (recorder->settings.numBuffers < 1) recorder->settings.numBuffers = FLUID_RECORDER_DEFAULT_BUFFERS;
+    if (recorder->settings.keyframeInterval < 0) recorder->settings.keyframeInterval = 0;
+    recorder->numFields = count_fields(settings->fields);
+    recorder->numCellsX = fluidPtr->numCellsX;
+    recorder->numCellsY = fluidPtr->numCellsY;
+    recorder->rowStride = fluidPtr->rowStride;
+    recorder->totalNumCells = fluidPtr->totalNumCells;
+    recorder->numValues = (size_t)fluidPtr->numCellsX * fluidPtr->numCellsY;
+
+    int numBuffers = recorder->settings.numBuffers;
+    recorder->buffers = (CaptureBuffer*)calloc((size_t)numBuffers, sizeof(CaptureBuffer));
+    recorder->words = (uint32_t*)malloc(recorder->numValues * sizeof(uint32_t));
+    recorder->previousWords = (uint32_t*)calloc((size_t)recorder->numFields * recorder->numValues, sizeof(uint32_t));
+    recorder->encoded = (uint8_t*)malloc((size_t)recorder->numFields *
+                                         (4 + max_encoded_bytes(recorder->numValues, word_bytes(settings->precision))));
+    if (recorder->buffers == NULL || recorder->words == NULL || recorder->previousWords == NULL || recorder->encoded == NULL) {
+        free_recorder(recorder);
+        printf("ERROR: fluid_recorder_create failed to allocate buffers\n");
+        return NULL;
+    }
+
+    // every capture buffer is allocated up front so capturing never allocates or page-faults
+    for (int buffer = 0; buffer < numBuffers; ++buffer) {
+        size_t bufferBytes = (size_t)recorder->numFields * recorder->totalNumCells * sizeof(float);
+        recorder->buffers[buffer].fields = (float*)malloc(bufferBytes);
+        atomic_init(&recorder->buffers[buffer].filled, 0);
+        if (recorder->buffers[buffer].fields == NULL) {
+            free_recorder(recorder);
+            printf("ERROR: fluid_recorder_create failed to allocate capture buffers\n");
+            return NULL;
+        }
+        // touch the pages now rather than in the first captures
+        memset(recorder->buffers[buffer].fields, 0, bufferBytes);
+    }
+
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL) {
+        free_recorder(recorder);
+        printf("ERROR: fluid_recorder_create could not open %s\n", path);
+        return NULL;
+    }
+    setvbuf(recorder->file, NULL, _IOFBF, FILE_BUFFER_BYTES);
+
+    uint8_t header[HEADER_BYTES];
+    memcpy(header, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    put_u32(header + 8, RECORDING_VERSION);
+    put_u32(header + 12, (uint32_t)recorder->numCellsX);
+    put_u32(header + 16, (uint32_t)recorder->numCellsY);
+    uint32_t cellSizeBits;
+    memcpy(&cellSizeBits, &fluidPtr->cellSize, sizeof(cellSizeBits));
+    put_u32(header + 20, cellSizeBits);
+    put_u32(header + 24, (uint32_t)settings->fields);
+    put_u32(header + 28, (uint32_t)settings->precision);
+    put_u32(header + 32, (uint32_t)recorder->settings.keyframeInterval);
+    put_u32(header + 36, 0);
+    if (!write_bytes(recorder, header, sizeof(header))) {
+        free_recorder(recorder);
+        return NULL;
+    }
+
+    atomic_init(&recorder->framesCaptured, 0);
+    atomic_init(&recorder->framesDropped, 0);
+    atomic_init(&recorder->framesWritten, 0);
+    atomic_init(&recorder->bytesWritten, 0);
+
+    recorder->framesQueued = SDL_CreateSemaphore(0);
+    if (recorder->framesQueued == NULL) {
+        free_recorder(recorder);
+        printf("ERROR: fluid_recorder_create failed to create a semaphore\n");
+        return NULL;
+    }
+
+    recorder->thread = SDL_CreateThread(writer_thread, "fluidRecorder", recorder);
+    if (recorder->thread == NULL) {
+        free_recorder(recorder);
+        printf("ERROR: fluid_recorder_create failed to start the writer thread\n");
+        return NULL;
+    }
+
+    return recorder;
+}
+
+int fluid_recorder_capture(FluidRecorder* recorder, const Fluid* fluidPtr, long long step) {
+
+    if (fluidPtr->numCellsX != recorder->numCellsX || fluidPtr->numCellsY != recorder->numCellsY) return 0;
+
+    // the writer is a whole round of buffers behind: drop the frame rather than wait
+    CaptureBuffer* buffer = &recorder->buffers[recorder->captureIndex];
+    if (atomic_load_explicit(&buffer->filled, memory_order_acquire)) {
+        atomic_fetch_add_explicit(&recorder->framesDropped, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    size_t fieldBytes = recorder->totalNumCells * sizeof(float);
+    float* destination = buffer->fields;
+    if (recorder->settings.fields & FLUID_RECORD_SMOKE) {
+        if (fluidPtr->smokeStorage == SMOKE_STORAGE_FLOAT32) {
+            memcpy(destination, fluidPtr->smokeDensity, fieldBytes);
+        } else {
+            fluidPtr->kernels->decode_half(fluidPtr->smokeHalf, destination, recorder->totalNumCells, fluid_smoke_half_format(fluidPtr));
+        }
+        destination += recorder->totalNumCells;
+    }
+    if (recorder->settings.fields & FLUID_RECORD_VELOCITY) {
+        memcpy(destination, fluidPtr->velocityX, fieldBytes);
+        memcpy(destination + recorder->totalNumCells, fluidPtr->velocityY, fieldBytes);
+    }
+    buffer->step = step;
+
+    atomic_store_explicit(&buffer->filled, 1, memory_order_release);
+    recorder->captureIndex = (recorder->captureIndex + 1) % recorder->settings.numBuffers;
+    atomic_fetch_add_explicit(&recorder->framesCaptured, 1, memory_order_relaxed);
+    SDL_SemPost(recorder->framesQueued);
+    return 1;
+}
+
+void fluid_recorder_stats(const FluidRecorder* recorder, FluidRecorderStats* stats) {
+    stats->framesCaptured = atomic_load_explicit(&recorder->framesCaptured, memory_order_relaxed);
+    stats->framesDropped = atomic_load_explicit(&recorder->framesDropped, memory_order_relaxed);
+    stats->framesWritten = atomic_load_explicit(&recorder->framesWritten, memory_order_relaxed);
+    stats->bytesWritten = atomic_load_explicit(&recorder->bytesWritten, memory_order_relaxed);
+}
+
+int fluid_recorder_close(FluidRecorder* recorder) {
+    if (recorder == NULL) return 0;
+
+    // let the writer finish the queued frames
+    SDL_SemPost(recorder->framesQueued);
+    SDL_WaitThread(recorder->thread, NULL);
+
+    uint64_t indexOffset = recorder->fileOffset;
+    write_bytes(recorder, recorder->index, (size_t)recorder->numFramesWritten * INDEX_ENTRY_BYTES);
+
+    uint8_t trailer[TRAILER_BYTES];
+    put_u64(trailer, indexOffset);
+    put_u64(trailer + 8, (uint64_t)recorder->numFramesWritten);
+    memcpy(trailer + 16, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    write_bytes(recorder, trailer, sizeof(trailer));
+
+    int ok = !recorder->writeFailed;
+    if (fclose(recorder->file) != 0) {
+        ok = 0;
+        printf("ERROR: fluid recorder failed to close the recording\n");
+    }
+    recorder->file = NULL;
+
+    free_recorder(recorder);
+    return ok;
+}
+
+
+// ------------------------------------------------------------------------------------------
+// Reader
+// ------------------------------------------------------------------------------------------
+
+struct FluidRecording {
+    FILE* file;
+    FluidRecordingInfo info;
+    int numFields;
+    size_t numValues;
+
+    long long* steps;
+    uint64_t* offsets;
+    uint32_t* flags;
+
+    // quantized fields of decodedFrame, the base for decoding the next delta frame
+    uint32_t* words;
+    uint32_t* deltaWords;
+    long long decodedFrame;
+
+    uint8_t* payload;
+    size_t payloadCapacity;
+};
+
+static int read_at(FILE* file, uint64_t offset, void* bytes, size_t size) {
+    if (file_seek(file, (int64_t)offset, SEEK_SET) != 0) return 0;
+    return fread(bytes, 1, size, file) == size;
+}
+
+void fluid_recording_close(FluidRecording* recording) {
+    if (recording) {
+        if (recording->file) fclose(recording->file);
+        free(recording->steps);
+        free(recording->offsets);
+        free(recording->flags);
+        free(recording->words);
+        free(recording->deltaWords);
+        free(recording->payload);
+        free(recording);
+    }
+}
+
+FluidRecording* fluid_recording_open(const char* path) {
+
+    FluidRecording* recording = (FluidRecording*)calloc(1, sizeof(FluidRecording));
+    if (recording == NULL) {
+        printf("ERROR: fluid_recording_open failed to allocate recording\n");
+        return NULL;
+    }
+    recording->decodedFrame = -1;
+
+    recording->file = fopen(path, "rb");
+    if (recording->file == NULL) {
+        fluid_recording_close(recording);
+        printf("ERROR: fluid_recording_open could not open %s\n", path);
+        return NULL;
+    }
+
+    uint8_t header[HEADER_BYTES];
+    if (!read_at(recording->file, 0, header, sizeof(header)) || memcmp(header, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0 ||
+        get_u32(header + 8) != RECORDING_VERSION) {
+        fluid_recording_close(recording);
+        printf("ERROR: fluid_recording_open: %s is not a fluid recording\n", path);
+        return NULL;
+    }
+
+    FluidRecordingInfo* info = &recording->info;
+    info->numCellsX = (int)get_u32(header + 12);
+    info->numCellsY = (int)get_u32(header + 16);
+    uint32_t cellSizeBits = get_u32(header + 20);
+    memcpy(&info->cellSize, &cellSizeBits, sizeof(info->cellSize));
+    info->fields = (int)get_u32(header + 24);
+    info->precision = (FluidRecordPrecision)get_u32(header + 28);
+    info->keyframeInterval = (int)get_u32(header + 32);
+    recording->numFields = count_fields(info->fields);
+    recording->numValues = (size_t)info->numCellsX * info->numCellsY;
+
+    // the index sits in front of the trailer at the end of the file
+    uint8_t trailer[TRAILER_BYTES];
+    int64_t fileSize = -1;
+    if (file_seek(recording->file, 0, SEEK_END) == 0) fileSize = (int64_t)file_tell(recording->file);
+    if (fileSize < HEADER_BYTES + TRAILER_BYTES || !read_at(recording->file, (uint64_t)fileSize - TRAILER_BYTES, trailer, sizeof(trailer)) ||
+        memcmp(trailer + 16, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        fluid_recording_close(recording);
+        printf("ERROR: fluid_recording_open: %s has no index, the recorder was not closed\n", path);
+        return NULL;
+    }
+
+    uint64_t indexOffset = get_u64(trailer);
+    uint64_t numFrames = get_u64(trailer + 8);
+    if (indexOffset + numFrames * INDEX_ENTRY_BYTES + TRAILER_BYTES != (uint64_t)fileSize) {
+        fluid_recording_close(recording);
+        printf("ERROR: fluid_recording_open: the index of %s is damaged\n", path);
+        return NULL;
+    }
+    info->numFrames = (long long)numFrames;
+
+    size_t numEntries = numFrames > 0 ? (size_t)numFrames : 1;
+    uint8_t* index = (uint8_t*)malloc(numEntries * INDEX_ENTRY_BYTES);
+    recording->steps = (long long*)malloc(numEntries * sizeof(long long));
+    recording->offsets = (uint64_t*)malloc(numEntries * sizeof(uint64_t));
+    recording->flags = (uint32_t*)malloc(numEntries * sizeof(uint32_t));
+    recording->words = (uint32_t*)malloc((size_t)recording->numFields * recording->numValues * sizeof(uint32_t) + 1);
+    recording->deltaWords = (uint32_t*)malloc(recording->numValues * sizeof(uint32_t) + 1);
+    if (index == NULL || recording->steps == NULL || recording->offsets == NULL || recording->flags == NULL ||
+        recording->words == NULL || recording->deltaWords == NULL) {
+        free(index);
+        fluid_recording_close(recording);
+        printf("ERROR: fluid_recording_open failed to allocate the index\n");
+        return NULL;
+    }
+
+    if (!read_at(recording->file, indexOffset, index, (size_t)numFrames * INDEX_ENTRY_BYTES)) {
+        free(index);
+        fluid_recording_close(recording);
+        printf("ERROR: fluid_recording_open failed to read the index of %s\n", path);
+        return NULL;
+    }
+    for (uint64_t frame = 0; frame < numFrames; ++frame) {
+        const uint8_t* entry = index + frame * INDEX_ENTRY_BYTES;
+        recording->steps[frame] = (long long)get_u64(entry);
+        recording->offsets[frame] = get_u64(entry + 8);
+        recording->flags[frame] = get_u32(entry + 16);
+    }
+    free(index);
+
+    return recording;
+}
+
+const FluidRecordingInfo* fluid_recording_info(const FluidRecording* recording) {
+    return &recording->info;
+}
+
+long long fluid_recording_frame_step(const FluidRecording* recording, long long frame) {
+    if (frame < 0 || frame >= recording->info.numFrames) return -1;
+    return recording->steps[frame];
+}
+
+/**
+ * Reads one frame and applies it to the decoded words: keyframes replace them, other frames add their differences.
+ */
+static int decode_frame(FluidRecording* recording, long long frame) {
+    FluidRecordPrecision precision = recording->info.precision;
+    int wordBytes = word_bytes(precision);
+    uint32_t mask = word_mask(precision);
+
+    uint8_t header[FRAME_HEADER_BYTES];
+    if (!read_at(recording->file, recording->offsets[frame], header, sizeof(header)) || get_u32(header) != FRAME_TAG) return 0;
+    int isKeyframe = (get_u32(header + 4) & FRAME_KEYFRAME) != 0;
+    size_t payloadBytes = get_u32(header + 16);
+
+    if (payloadBytes > recording->payloadCapacity) {
+        uint8_t* payload = (uint8_t*)realloc(recording->payload, payloadBytes);
+        if (payload == NULL) return 0;
+        recording->payload = payload;
+        recording->payloadCapacity = payloadBytes;
+    }
+    if (fread(recording->payload, 1, payloadBytes, recording->file) != payloadBytes) return 0;
+
+    size_t position = 0;
+    for (int field = 0; field < recording->numFields; ++field) {
+        if (payloadBytes - position < 4) return 0;
+        size_t encodedSize = get_u32(recording->payload + position);
+        position += 4;
+        if (encodedSize > payloadBytes - position) return 0;
+
+        uint32_t* words = recording->words + (size_t)field * recording->numValues;
+        uint32_t* target = isKeyframe ? words : recording->deltaWords;
+        if (!decode_runs(recording->payload + position, encodedSize, wordBytes, target, recording->numValues)) return 0;
+        position += encodedSize;
+
+        if (!isKeyframe) {
+            for (size_t k = 0; k < recording->numValues; ++k) {
+                words[k] = (words[k] + recording->deltaWords[k]) & mask;
+            }
+        }
+    }
+    return 1;
+}
+
+int fluid_recording_read_frame(FluidRecording* recording, long long frame, float* smoke, float* velocityX, float* velocityY) {
+
+    if (frame < 0 || frame >= recording->info.numFrames) {
+        printf("ERROR: fluid_recording_read_frame: no frame %lld\n", frame);
+        return 0;
+    }
+
+    // continue from the decoded frame when no keyframe lies in between, else start at the keyframe
+    long long keyframe = frame;
+    while (keyframe > 0 && !(recording->flags[keyframe] & FRAME_KEYFRAME)) --keyframe;
+    long long firstFrame = keyframe;
+    if (recording->decodedFrame >= keyframe && recording->decodedFrame <= frame) firstFrame = recording->decodedFrame + 1;
+
+    for (long long current = firstFrame; current <= frame; ++current) {
+        if (!decode_frame(recording, current)) {
+            recording->decodedFrame = -1;
+            printf("ERROR: fluid_recording_read_frame failed to decode frame %lld\n", current);
+            return 0;
+        }
+        recording->decodedFrame = current;
+    }
+
+    float* outputs[3] = { NULL, NULL, NULL };
+    int numOutputs = 0;
+    if (recording->info.fields & FLUID_RECORD_SMOKE) outputs[numOutputs++] = smoke;
+    if (recording->info.fields & FLUID_RECORD_VELOCITY) {
+        outputs[numOutputs++] = velocityX;
+        outputs[numOutputs++] = velocityY;
+    }
+
+    for (int field = 0; field < numOutputs; ++field) {
+        if (outputs[field] == NULL) continue;
+        const uint32_t* words = recording->words + (size_t)field * recording->numValues;
+        for (size_t k = 0; k < recording->numValues; ++k) {
+            outputs[field][k] = dequantize(words[k], recording->info.precision);
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,108 @@
+#include "fluid_render.h"
+#include <math.h>
+#include <string.h>
+
+
+/**
+ * Data shared by the workers of one smoke conversion.
+ */
+typedef struct {
+    const Fluid* fluidPtr;
+    uint32_t* pixels;
+    int pitch;
+} SmokeImage;
+
+static void render_smoke_task(void* taskData, int rangeStart, int rangeEnd) {
+    SmokeImage* image = (SmokeImage*)taskData;
+    const Fluid* fluidPtr = image->fluidPtr;
+    int numRows = fluidPtr->rowStride;
+    int height = fluidPtr->numCellsY - 2;
+    int width = fluidPtr->numCellsX - 2;
+    int halfStorage = fluidPtr->smokeStorage != SMOKE_STORAGE_FLOAT32;
+    float tileValues[FLUID_TILE_SIZE * FLUID_TILE_SIZE];
+
+    // one band of grid columns per tile column (pixel x is cell x + 1)
+    for (int tileX = rangeStart; tileX < rangeEnd; ++tileX) {
+        int firstX = tileX * FLUID_TILE_SIZE - 1 > 0 ? tileX * FLUID_TILE_SIZE - 1 : 0;
+        int lastX = (tileX + 1) * FLUID_TILE_SIZE - 1 < width ? (tileX + 1) * FLUID_TILE_SIZE - 1 : width;
+        const uint8_t* tileColumn = fluidPtr->tileActive + (size_t)tileX * fluidPtr->numTilesY;
+
+        // the grid is stored column by column and the image row by row, so walk a narrow band of columns, top tile first
+        for (int tileY = fluidPtr->numTilesY - 1; tileY >= 0; --tileY) {
+            int firstJ = tileY * FLUID_TILE_SIZE > 1 ? tileY * FLUID_TILE_SIZE : 1;
+            int lastJ = (tileY + 1) * FLUID_TILE_SIZE < height + 1 ? (tileY + 1) * FLUID_TILE_SIZE : height + 1;
+            if (firstJ >= lastJ) continue;
+
+            // inactive tiles hold no smoke
+            if (!tileColumn[tileY]) {
+                for (int j = lastJ - 1; j >= firstJ; --j) {
+                    memset(image->pixels + (size_t)(height - j) * image->pitch + firstX, 0, (size_t)(lastX - firstX) * sizeof(uint32_t));
+                }
+                continue;
+            }
+
+            // 16-bit smoke is converted one tile column at a time, value (x, j) at (x - firstX) * columnStride + j - firstJ
+            const float* values = fluidPtr->smokeDensity + (size_t)(firstX + 1) * numRows + firstJ;
+            size_t columnStride = (size_t)numRows;
+            if (halfStorage) {
+                for (int x = firstX; x < lastX; ++x) {
+                    fluidPtr->kernels->decode_half(fluidPtr->smokeHalf + (size_t)(x + 1) * numRows + firstJ,
+                                                   tileValues + (size_t)(x - firstX) * FLUID_TILE_SIZE, (size_t)(lastJ - firstJ),
+                                                   fluid_smoke_half_format(fluidPtr));
+                }
+                values = tileValues;
+                columnStride = FLUID_TILE_SIZE;
+            }
+
+            for (int j = lastJ - 1; j >= firstJ; --j) {
+                uint32_t* pixelRow = image->pixels + (size_t)(height - j) * image->pitch;
+                const float* smoke = values + (j - firstJ);
+
+                for (int x = firstX; x < lastX; ++x) {
+                    float value = fminf(fmaxf(smoke[(size_t)(x - firstX) * columnStride] * 255.0f, 0.0f), 255.0f);
+                    uint32_t gray = (uint32_t)value;
+                    pixelRow[x] = (gray << 16) | (gray << 8) | gray;
+                }
+            }
+        }
+    }
+}
+
+void fluid_render_smoke(const Fluid* fluidPtr, uint32_t* pixels, int pitch) {
+    SmokeImage image = { fluidPtr, pixels, pitch };
+    fluid_pool_run(fluidPtr->workerPool, render_smoke_task, &image, 0, fluidPtr->numTilesX);
+}
+
+/**
+ * Data shared by the workers of one sparse smoke conversion.
+ */
+typedef struct {
+    const FluidSparse* sparse;
+    uint32_t* pixels;
+    int pitch;
+    int firstX;
+    int firstY;
+    int width;
+    int height;
+} SparseSmokeImage;
+
+static void render_sparse_smoke_task(void* taskData, int rangeStart, int rangeEnd) {
+    SparseSmokeImage* image = (SparseSmokeImage*)taskData;
+
+    for (int y = rangeStart; y < rangeEnd; ++y) {
+        int j = image->firstY + image->height - 1 - y;
+        uint32_t* pixelRow = image->pixels + (size_t)y * image->pitch;
+
+        for (int x = 0; x < image->width; ++x) {
+            float smoke = fluid_sparse_value(image->sparse, SPARSE_SMOKE, image->firstX + x, j);
+            uint32_t gray = (uint32_t)fminf(fmaxf(smoke * 255.0f, 0.0f), 255.0f);
+            pixelRow[x] = (gray << 16) | (gray << 8) | gray;
+        }
+    }
+}
+
+void fluid_sparse_render_smoke(const FluidSparse* sparse, uint32_t* pixels, int pitch, int firstX, int firstY, int width, int height) {
+    SparseSmokeImage image = { sparse, pixels, pitch, firstX, firstY, width, height };
+
+    fluid_pool_run(sparse->workerPool, render_sparse_smoke_task, &image, 0, height);
+}
@@ -0,0 +1,269 @@
+#include "fluid_runner.h"
+#include "fluid_render.h"
+#include <SDL.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+// bit set in the shared triple buffer slot while it holds a snapshot the reader has not taken yet
+#define SNAPSHOT_FRESH 4
+
+struct FluidRunner {
+    Fluid* fluidPtr;
+    FluidRunnerSettings settings;
+    SDL_Thread* thread;
+    atomic_int running;
+
+    // single producer (input thread), single consumer (simulation thread)
+    FluidCommand commands[FLUID_COMMAND_QUEUE_SIZE];
+    atomic_uint commandHead;
+    atomic_uint commandTail;
+
+    // next event of settings.replayEvents to apply
+    int nextReplayEvent;
+
+    /* triple buffer: the simulation writes snapshots[backSnapshot], the reader owns snapshots[frontSnapshot],
+       and sharedSnapshot holds the third index plus SNAPSHOT_FRESH when it was published after the last read */
+    FluidSnapshot snapshots[3];
+    int backSnapshot;
+    int frontSnapshot;
+    atomic_int sharedSnapshot;
+};
+
+int fluid_runner_push_command(FluidRunner* runner, const FluidCommand* command) {
+    if (runner->settings.replayEvents) return 0;
+
+    unsigned int head = atomic_load_explicit(&runner->commandHead, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&runner->commandTail, memory_order_acquire);
+    if (head - tail == FLUID_COMMAND_QUEUE_SIZE) return 0;
+
+    runner->commands[head & (FLUID_COMMAND_QUEUE_SIZE - 1)] = *command;
+    atomic_store_explicit(&runner->commandHead, head + 1, memory_order_release);
+    return 1;
+}
+
+// applies the commands due before the step after the first numStepsDone steps
+static void apply_commands(FluidRunner* runner, long long numStepsDone) {
+    const FluidEventLog* replayEvents = runner->settings.replayEvents;
+
+    if (replayEvents) {
+        const FluidEvent* events = fluid_event_log_events(replayEvents);
+        int numEvents = fluid_event_log_num_events(replayEvents);
+
+        for (; runner->nextReplayEvent < numEvents && events[runner->nextReplayEvent].step <= numStepsDone; ++runner->nextReplayEvent) {
+            fluid_apply_command(runner->fluidPtr, &events[runner->nextReplayEvent].command);
+        }
+        return;
+    }
+
+    unsigned int tail = atomic_load_explicit(&runner->commandTail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&runner->commandHead, memory_order_acquire);
+
+    for (; tail != head; ++tail) {
+        const FluidCommand* command = &runner->commands[tail & (FLUID_COMMAND_QUEUE_SIZE - 1)];
+        fluid_apply_command(runner->fluidPtr, command);
+        if (runner->settings.recordEvents) fluid_event_log_append(runner->settings.recordEvents, numStepsDone, command);
+    }
+    atomic_store_explicit(&runner->commandTail, tail, memory_order_release);
+}
+
+/**
+ * Step and work counters of the simulation thread, copied into every snapshot.
+ */
+typedef struct {
+    long long step;
+    long long totalSubsteps;
+    long long totalSolverIterations;
+    long long droppedSteps;
+} RunnerCounters;
+
+static void publish_snapshot(FluidRunner* runner, const RunnerCounters* counters) {
+    Fluid* fluidPtr = runner->fluidPtr;
+    FluidSnapshot* snapshot = &runner->snapshots[runner->backSnapshot];
+
+    fluid_render_smoke(fluidPtr, snapshot->pixels, snapshot->width);
+    snapshot->step = counters->step;
+    snapshot->totalSubsteps = counters->totalSubsteps;
+    snapshot->totalSolverIterations = counters->totalSolverIterations;
+    snapshot->droppedSteps = counters->droppedSteps;
+    snapshot->residualMax = fluidPtr->lastResidualMax;
+    snapshot->smokeChecksum = fluid_smoke_checksum(fluidPtr);
+
+    // hand the finished buffer over and take back whichever one the reader left
+    int previous = atomic_exchange_explicit(&runner->sharedSnapshot, runner->backSnapshot | SNAPSHOT_FRESH, memory_order_acq_rel);
+    runner->backSnapshot = previous & ~SNAPSHOT_FRESH;
+}
+
+const FluidSnapshot* fluid_runner_latest_snapshot(FluidRunner* runner) {
+    if (atomic_load_explicit(&runner->sharedSnapshot, memory_order_relaxed) & SNAPSHOT_FRESH) {
+        int previous = atomic_exchange_explicit(&runner->sharedSnapshot, runner->frontSnapshot, memory_order_acq_rel);
+        runner->frontSnapshot = previous & ~SNAPSHOT_FRESH;
+    }
+    return &runner->snapshots[runner->frontSnapshot];
+}
+
+// one step of 1 / stepsPerSecond, split into as many substeps as the current velocities need
+static void run_step(FluidRunner* runner, float deltaTime, RunnerCounters* counters) {
+    const FluidRunnerSettings* settings = &runner->settings;
+    Fluid* fluidPtr = runner->fluidPtr;
+
+    int numSubsteps = fluid_cfl_substeps(fluidPtr, deltaTime, settings->maxCflNumber, settings->maxSubsteps);
+    float substepTime = deltaTime / numSubsteps;
+
+    // the dissipation factors are per step, so every substep applies its share
+    float dissipation = settings->dissipation;
+    float smokeDissipation = settings->smokeDissipation;
+    if (numSubsteps > 1) {
+        dissipation = powf(dissipation, 1.0f / numSubsteps);
+        smokeDissipation = powf(smokeDissipation, 1.0f / numSubsteps);
+    }
+
+    for (int substep = 0; substep < numSubsteps; ++substep) {
+        fluid_simulate_step(fluidPtr, settings->numIterations, substepTime, settings->gravityForce,
+                            settings->overRelaxation, dissipation, smokeDissipation);
+        counters->totalSolverIterations += fluidPtr->lastSolverIterations;
+    }
+    counters->totalSubsteps += numSubsteps;
+    counters->step++;
+}
+
+// everything that happens for one step, the same with and without the clock
+static void advance_step(FluidRunner* runner, float deltaTime, RunnerCounters* counters) {
+    const FluidRunnerSettings* settings = &runner->settings;
+
+    apply_commands(runner, counters->step);
+    run_step(runner, deltaTime, counters);
+    if (settings->recorder) fluid_recorder_capture(settings->recorder, runner->fluidPtr, counters->step);
+    if (settings->checksumFile) {
+        fprintf(settings->checksumFile, "%lld %016llx\n", counters->step, (unsigned long long)fluid_smoke_checksum(runner->fluidPtr));
+    }
+}
+
+static int simulation_thread(void* data) {
+    FluidRunner* runner = (FluidRunner*)data;
+    const FluidRunnerSettings* settings = &runner->settings;
+
+    float deltaTime = 1.0f / settings->stepsPerSecond;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 ticksPerStep = (Uint64)((double)frequency / settings->stepsPerSecond);
+    if (ticksPerStep == 0) ticksPerStep = 1;
+    Uint64 maxAccumulatedTicks = ticksPerStep * (Uint64)settings->maxCatchUpSteps;
+
+    // the first step is due right away
+    Uint64 accumulatedTicks = ticksPerStep;
+    Uint64 lastTick = SDL_GetPerformanceCounter();
+    RunnerCounters counters = {0, 0, 0, 0};
+
+    while (atomic_load(&runner->running)) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        accumulatedTicks += now - lastTick;
+        lastTick = now;
+
+        // after a stall only catch up a bounded number of steps, the rest of the time is lost
+        if (accumulatedTicks > maxAccumulatedTicks) {
+            counters.droppedSteps += (long long)((accumulatedTicks - maxAccumulatedTicks) / ticksPerStep);
+            accumulatedTicks = maxAccumulatedTicks;
+        }
+
+        if (accumulatedTicks >= ticksPerStep) {
+            while (accumulatedTicks >= ticksPerStep && atomic_load(&runner->running)) {
+                advance_step(runner, deltaTime, &counters);
+                accumulatedTicks -= ticksPerStep;
+            }
+            publish_snapshot(runner, &counters);
+            continue;
+        }
+
+        // sleep until the next step is due
+        Uint32 sleepMilliseconds = (Uint32)((ticksPerStep - accumulatedTicks) * 1000 / frequency);
+        if (sleepMilliseconds > 0) SDL_Delay(sleepMilliseconds);
+    }
+    return 0;
+}
+
+/**
+ * Allocates a runner without snapshots or thread.
+ */
+static FluidRunner* allocate_runner(Fluid* fluidPtr, const FluidRunnerSettings* settings) {
+
+    if (settings->stepsPerSecond <= 0.0f) {
+        printf("ERROR: fluid runner needs a positive step rate\n");
+        return NULL;
+    }
+
+    FluidRunner* runner = (FluidRunner*)calloc(1, sizeof(FluidRunner));
+    if (runner == NULL) {
+        printf("ERROR: failed to allocate fluid runner\n");
+        return NULL;
+    }
+
+    runner->fluidPtr = fluidPtr;
+    runner->settings = *settings;
+    if (runner->settings.maxSubsteps < 1) runner->settings.maxSubsteps = 1;
+    if (runner->settings.maxCatchUpSteps < 1) runner->settings.maxCatchUpSteps = 1;
+    return runner;
+}
+
+long long fluid_runner_run_steps(Fluid* fluidPtr, const FluidRunnerSettings* settings, long long numSteps) {
+    FluidRunner* runner = allocate_runner(fluidPtr, settings);
+    if (runner == NULL) return 0;
+
+    float deltaTime = 1.0f / settings->stepsPerSecond;
+    RunnerCounters counters = {0, 0, 0, 0};
+    while (counters.step < numSteps) {
+        advance_step(runner, deltaTime, &counters);
+    }
+
+    fluid_runner_free(runner);
+    return counters.step;
+}
+
+FluidRunner* fluid_runner_create(Fluid* fluidPtr, const FluidRunnerSettings* settings) {
+
+    FluidRunner* runner = allocate_runner(fluidPtr, settings);
+    if (runner == NULL) return NULL;
+
+    int width = fluidPtr->numCellsX - 2;
+    int height = fluidPtr->numCellsY - 2;
+    for (int slot = 0; slot < 3; ++slot) {
+        FluidSnapshot* snapshot = &runner->snapshots[slot];
+        snapshot->width = width;
+        snapshot->height = height;
+        snapshot->pixels = (uint32_t*)calloc((size_t)width * height, sizeof(uint32_t));
+        if (snapshot->pixels == NULL) {
+            fluid_runner_free(runner);
+            printf("ERROR: fluid_runner_create failed to allocate snapshots\n");
+            return NULL;
+        }
+    }
+
+    runner->backSnapshot = 0;
+    runner->frontSnapshot = 1;
+    atomic_init(&runner->sharedSnapshot, 2);
+    atomic_init(&runner->commandHead, 0);
+    atomic_init(&runner->commandTail, 0);
+    atomic_init(&runner->running, 1);
+
+    runner->thread = SDL_CreateThread(simulation_thread, "fluidSimulation", runner);
+    if (runner->thread == NULL) {
+        fluid_runner_free(runner);
+        printf("ERROR: fluid_runner_create failed to start the simulation thread\n");
+        return NULL;
+    }
+
+    return runner;
+}
+
+void fluid_runner_free(FluidRunner* runner) {
+    if (runner) {
+        if (runner->thread) {
+            atomic_store(&runner->running, 0);
+            SDL_WaitThread(runner->thread, NULL);
+        }
+        for (int slot = 0; slot < 3; ++slot) {
+            free(runner->snapshots[slot].pixels);
+        }
+        free(runner);
+    }
+}
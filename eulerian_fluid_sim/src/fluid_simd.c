@@ -0,0 +1,753 @@
+#include "fluid_simd.h"
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLUID_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define FLUID_HAVE_NEON_KERNELS 1
+#include <arm_neon.h>
+#endif
+
+
+// ------------------------------------------------------------------------------------------
+// Scalar kernels, also used for the tails of the vector loops
+// ------------------------------------------------------------------------------------------
+
+static void add_where_fluid_scalar(float* values, const float* solidFlags, size_t count, float amount) {
+    for (size_t k = 0; k < count; ++k) {
+        if (solidFlags[k] == 1.0f) values[k] += amount;
+    }
+}
+
+static void zero_where_solid_scalar(float* valuesX, float* valuesY, const float* solidFlags, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        if (solidFlags[k] == 0.0f) {
+            valuesX[k] = 0.0f;
+            valuesY[k] = 0.0f;
+        }
+    }
+}
+
+static void prepare_cells_scalar(float* velocityX, float* velocityY, float* smoke, const float* solidFlags, size_t count,
+                                 float dissipation, float smokeDissipation, float gravity) {
+    for (size_t k = 0; k < count; ++k) {
+        float u = velocityX[k] * dissipation;
+        float v = velocityY[k] * dissipation;
+        if (solidFlags[k] == 1.0f) v += gravity;
+        if (solidFlags[k] == 0.0f) {
+            u = 0.0f;
+            v = 0.0f;
+        }
+        velocityX[k] = u;
+        velocityY[k] = v;
+        if (smoke) smoke[k] *= smokeDissipation;
+    }
+}
+
+static float max_abs_scalar(const float* values, size_t count, int numColumns, size_t columnStride) {
+    float maxValue = 0.0f;
+    for (int column = 0; column < numColumns; ++column) {
+        const float* columnValues = values + (size_t)column * columnStride;
+        for (size_t k = 0; k < count; ++k) {
+            maxValue = fmaxf(maxValue, fabsf(columnValues[k]));
+        }
+    }
+    return maxValue;
+}
+
+static void relax_rows_scalar(FluidRelaxColumn* column, int firstRow, int lastRow) {
+    for (int j = firstRow; j < lastRow; ++j) {
+        float dp = 0.0f;
+
+        if ((j & 1) == column->rowParity) {
+            float scale = column->neighborScale[j];
+
+            if (scale != 0.0f) {
+                float divergence = column->velocityX[j] - column->velocityXRight[j] +
+                                   column->velocityY[j] - column->velocityY[j + 1];
+                dp = -divergence * scale;
+                dp *= column->overRelaxation;
+
+                column->pressure[j] += dp;
+                column->residualMax = fmaxf(column->residualMax, fabsf(divergence));
+                column->residualSquares += (double)divergence * divergence;
+            }
+        }
+        column->pressureDelta[j] = dp;
+    }
+}
+
+static void relax_column_scalar(FluidRelaxColumn* column) {
+    column->residualMax = 0.0f;
+    column->residualSquares = 0.0;
+    relax_rows_scalar(column, column->firstRow, column->lastRow);
+}
+
+static void apply_rows_scalar(float* velocityX, float* velocityY, const float* solid, const float* solidLeft,
+                              const float* pressureDelta, const float* pressureDeltaLeft, int firstRow, int lastRow) {
+    // only one of the two cells sharing a face was relaxed, the other term is zero
+    for (int j = firstRow; j < lastRow; ++j) {
+        velocityX[j] = velocityX[j] + solidLeft[j] * pressureDelta[j] - solid[j] * pressureDeltaLeft[j];
+        velocityY[j] = velocityY[j] + solid[j - 1] * pressureDelta[j] - solid[j] * pressureDelta[j - 1];
+    }
+}
+
+static void decode_half_scalar(const uint16_t* halves, float* values, size_t count, FluidHalfFormat format) {
+    for (size_t k = 0; k < count; ++k) {
+        values[k] = fluid_decode_half(halves[k], format);
+    }
+}
+
+static void encode_half_scalar(const float* values, uint16_t* halves, size_t count, FluidHalfFormat format) {
+    for (size_t k = 0; k < count; ++k) {
+        halves[k] = fluid_encode_half(values[k], format);
+    }
+}
+
+static void scale_half_scalar(uint16_t* halves, size_t count, float factor, FluidHalfFormat format) {
+    for (size_t k = 0; k < count; ++k) {
+        halves[k] = fluid_encode_half(fluid_decode_half(halves[k], format) * factor, format);
+    }
+}
+
+static const FluidKernels scalarKernels = {
+    FLUID_SIMD_SCALAR,
+    "scalar",
+    add_where_fluid_scalar,
+    zero_where_solid_scalar,
+    prepare_cells_scalar,
+    max_abs_scalar,
+    relax_column_scalar,
+    apply_rows_scalar,
+    decode_half_scalar,
+    encode_half_scalar,
+    scale_half_scalar
+};
+
+#ifdef FLUID_HAVE_X86_KERNELS
+
+// ------------------------------------------------------------------------------------------
+// SSE4.1 kernels, 4 cells per instruction
+// ------------------------------------------------------------------------------------------
+
+__attribute__((target("sse4.1")))
+static void add_where_fluid_sse4(float* values, const float* solidFlags, size_t count, float amount) {
+    __m128 amountVec = _mm_set1_ps(amount);
+    __m128 one = _mm_set1_ps(1.0f);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 isFluid = _mm_cmpeq_ps(_mm_loadu_ps(solidFlags + k), one);
+        _mm_storeu_ps(values + k, _mm_add_ps(_mm_loadu_ps(values + k), _mm_and_ps(isFluid, amountVec)));
+    }
+    add_where_fluid_scalar(values + k, solidFlags + k, count - k, amount);
+}
+
+__attribute__((target("sse4.1")))
+static void zero_where_solid_sse4(float* valuesX, float* valuesY, const float* solidFlags, size_t count) {
+    __m128 zero = _mm_setzero_ps();
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 isSolid = _mm_cmpeq_ps(_mm_loadu_ps(solidFlags + k), zero);
+        _mm_storeu_ps(valuesX + k, _mm_andnot_ps(isSolid, _mm_loadu_ps(valuesX + k)));
+        _mm_storeu_ps(valuesY + k, _mm_andnot_ps(isSolid, _mm_loadu_ps(valuesY + k)));
+    }
+    zero_where_solid_scalar(valuesX + k, valuesY + k, solidFlags + k, count - k);
+}
+
+__attribute__((target("sse4.1")))
+static void prepare_cells_sse4(float* velocityX, float* velocityY, float* smoke, const float* solidFlags, size_t count,
+                               float dissipation, float smokeDissipation, float gravity) {
+    __m128 dissipationVec = _mm_set1_ps(dissipation);
+    __m128 smokeDissipationVec = _mm_set1_ps(smokeDissipation);
+    __m128 gravityVec = _mm_set1_ps(gravity);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 solid = _mm_loadu_ps(solidFlags + k);
+        __m128 isSolid = _mm_cmpeq_ps(solid, zero);
+        __m128 isFluid = _mm_cmpeq_ps(solid, one);
+        __m128 u = _mm_mul_ps(_mm_loadu_ps(velocityX + k), dissipationVec);
+        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(velocityY + k), dissipationVec), _mm_and_ps(isFluid, gravityVec));
+        _mm_storeu_ps(velocityX + k, _mm_andnot_ps(isSolid, u));
+        _mm_storeu_ps(velocityY + k, _mm_andnot_ps(isSolid, v));
+        if (smoke) _mm_storeu_ps(smoke + k, _mm_mul_ps(_mm_loadu_ps(smoke + k), smokeDissipationVec));
+    }
+    prepare_cells_scalar(velocityX + k, velocityY + k, smoke ? smoke + k : NULL, solidFlags + k, count - k, dissipation, smokeDissipation, gravity);
+}
+
+__attribute__((target("sse4.1")))
+static float max_abs_sse4(const float* values, size_t count, int numColumns, size_t columnStride) {
+    __m128 signBit = _mm_set1_ps(-0.0f);
+    __m128 maxVec = _mm_setzero_ps();
+    float maxValue = 0.0f;
+    for (int column = 0; column < numColumns; ++column) {
+        const float* columnValues = values + (size_t)column * columnStride;
+        size_t k = 0;
+        for (; k + 4 <= count; k += 4) {
+            maxVec = _mm_max_ps(maxVec, _mm_andnot_ps(signBit, _mm_loadu_ps(columnValues + k)));
+        }
+        maxValue = fmaxf(maxValue, max_abs_scalar(columnValues + k, count - k, 1, 0));
+    }
+
+    float maxLanes[4];
+    _mm_storeu_ps(maxLanes, maxVec);
+    return fmaxf(maxValue, fmaxf(fmaxf(maxLanes[0], maxLanes[1]), fmaxf(maxLanes[2], maxLanes[3])));
+}
+
+__attribute__((target("sse4.1")))
+static void relax_column_sse4(FluidRelaxColumn* column) {
+    __m128 zero = _mm_setzero_ps();
+    __m128 signBit = _mm_set1_ps(-0.0f);
+    __m128 omega = _mm_set1_ps(column->overRelaxation);
+    __m128 maxVec = zero;
+    __m128d squaresLow = _mm_setzero_pd();
+    __m128d squaresHigh = _mm_setzero_pd();
+
+    // the step is even, so the lanes that get relaxed are the same for every block
+    int j = column->firstRow;
+    __m128 evenLanes = _mm_castsi128_ps(_mm_set_epi32(0, -1, 0, -1));
+    __m128 parityMask = ((j & 1) == column->rowParity) ? evenLanes : _mm_andnot_ps(evenLanes, _mm_castsi128_ps(_mm_set1_epi32(-1)));
+
+    for (; j + 4 <= column->lastRow; j += 4) {
+        __m128 scale = _mm_loadu_ps(column->neighborScale + j);
+
+        __m128 divergence = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_loadu_ps(column->velocityX + j), _mm_loadu_ps(column->velocityXRight + j)),
+                                                  _mm_loadu_ps(column->velocityY + j)),
+                                       _mm_loadu_ps(column->velocityY + j + 1));
+
+        __m128 active = _mm_and_ps(parityMask, _mm_cmpneq_ps(scale, zero));
+        __m128 dp = _mm_mul_ps(_mm_mul_ps(_mm_xor_ps(divergence, signBit), scale), omega);
+        dp = _mm_and_ps(active, dp);
+
+        _mm_storeu_ps(column->pressure + j, _mm_add_ps(_mm_loadu_ps(column->pressure + j), dp));
+        _mm_storeu_ps(column->pressureDelta + j, dp);
+
+        __m128 activeDivergence = _mm_and_ps(active, divergence);
+        maxVec = _mm_max_ps(maxVec, _mm_andnot_ps(signBit, activeDivergence));
+        __m128 squares = _mm_mul_ps(activeDivergence, activeDivergence);
+        squaresLow = _mm_add_pd(squaresLow, _mm_cvtps_pd(squares));
+        squaresHigh = _mm_add_pd(squaresHigh, _mm_cvtps_pd(_mm_movehl_ps(squares, squares)));
+    }
+
+    float maxLanes[4];
+    double squareLanes[4];
+    _mm_storeu_ps(maxLanes, maxVec);
+    _mm_storeu_pd(squareLanes, squaresLow);
+    _mm_storeu_pd(squareLanes + 2, squaresHigh);
+
+    column->residualMax = fmaxf(fmaxf(maxLanes[0], maxLanes[1]), fmaxf(maxLanes[2], maxLanes[3]));
+    column->residualSquares = squareLanes[0] + squareLanes[1] + squareLanes[2] + squareLanes[3];
+    relax_rows_scalar(column, j, column->lastRow);
+}
+
+__attribute__((target("sse4.1")))
+static void apply_column_sse4(float* velocityX, float* velocityY, const float* solid, const float* solidLeft,
+                              const float* pressureDelta, const float* pressureDeltaLeft, int firstRow, int lastRow) {
+    int j = firstRow;
+    for (; j + 4 <= lastRow; j += 4) {
+        __m128 solidVec = _mm_loadu_ps(solid + j);
+        __m128 delta = _mm_loadu_ps(pressureDelta + j);
+
+        __m128 vx = _mm_add_ps(_mm_loadu_ps(velocityX + j), _mm_mul_ps(_mm_loadu_ps(solidLeft + j), delta));
+        vx = _mm_sub_ps(vx, _mm_mul_ps(solidVec, _mm_loadu_ps(pressureDeltaLeft + j)));
+        _mm_storeu_ps(velocityX + j, vx);
+
+        __m128 vy = _mm_add_ps(_mm_loadu_ps(velocityY + j), _mm_mul_ps(_mm_loadu_ps(solid + j - 1), delta));
+        vy = _mm_sub_ps(vy, _mm_mul_ps(solidVec, _mm_loadu_ps(pressureDelta + j - 1)));
+        _mm_storeu_ps(velocityY + j, vy);
+    }
+    apply_rows_scalar(velocityX, velocityY, solid, solidLeft, pressureDelta, pressureDeltaLeft, j, lastRow);
+}
+
+// bf16 is the upper half of an fp32, so it converts with integer shifts; SSE has no fp16 conversion
+__attribute__((target("sse4.1")))
+static inline __m128 bfloat16_to_float_sse4(__m128i halves) {
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_cvtepu16_epi32(halves), 16));
+}
+
+// rounds 4 floats to bf16 (ties to even, NaN stays NaN) in the low 16 bits of each lane
+__attribute__((target("sse4.1")))
+static inline __m128i float_to_bfloat16_sse4(__m128 values) {
+    __m128i bits = _mm_castps_si128(values);
+    __m128i lowestKept = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+    __m128i rounded = _mm_add_epi32(bits, _mm_add_epi32(_mm_set1_epi32(0x7fff), lowestKept));
+    __m128i quietNan = _mm_or_si128(bits, _mm_set1_epi32(0x400000));
+    __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(values, values));
+    return _mm_srli_epi32(_mm_blendv_epi8(rounded, quietNan, isNan), 16);
+}
+
+__attribute__((target("sse4.1")))
+static void decode_half_sse4(const uint16_t* halves, float* values, size_t count, FluidHalfFormat format) {
+    size_t k = 0;
+    if (format == FLUID_HALF_BFLOAT16) {
+        for (; k + 4 <= count; k += 4) {
+            _mm_storeu_ps(values + k, bfloat16_to_float_sse4(_mm_loadl_epi64((const __m128i*)(halves + k))));
+        }
+    }
+    decode_half_scalar(halves + k, values + k, count - k, format);
+}
+
+__attribute__((target("sse4.1")))
+static void encode_half_sse4(const float* values, uint16_t* halves, size_t count, FluidHalfFormat format) {
+    size_t k = 0;
+    if (format == FLUID_HALF_BFLOAT16) {
+        for (; k + 4 <= count; k += 4) {
+            __m128i packed = _mm_packus_epi32(float_to_bfloat16_sse4(_mm_loadu_ps(values + k)), _mm_setzero_si128());
+            _mm_storel_epi64((__m128i*)(halves + k), packed);
+        }
+    }
+    encode_half_scalar(values + k, halves + k, count - k, format);
+}
+
+__attribute__((target("sse4.1")))
+static void scale_half_sse4(uint16_t* halves, size_t count, float factor, FluidHalfFormat format) {
+    __m128 factorVec = _mm_set1_ps(factor);
+    size_t k = 0;
+    if (format == FLUID_HALF_BFLOAT16) {
+        for (; k + 4 <= count; k += 4) {
+            __m128 values = _mm_mul_ps(bfloat16_to_float_sse4(_mm_loadl_epi64((const __m128i*)(halves + k))), factorVec);
+            _mm_storel_epi64((__m128i*)(halves + k), _mm_packus_epi32(float_to_bfloat16_sse4(values), _mm_setzero_si128()));
+        }
+    }
+    scale_half_scalar(halves + k, count - k, factor, format);
+}
+
+static const FluidKernels sse4Kernels = {
+    FLUID_SIMD_SSE4,
+    "sse4",
+    add_where_fluid_sse4,
+    zero_where_solid_sse4,
+    prepare_cells_sse4,
+    max_abs_sse4,
+    relax_column_sse4,
+    apply_column_sse4,
+    decode_half_sse4,
+    encode_half_sse4,
+    scale_half_sse4
+};
+
+// ------------------------------------------------------------------------------------------
+// AVX2 kernels, 8 cells per instruction
+// ------------------------------------------------------------------------------------------
+
+/* Kernels whose scalar tail gcc turns into a tail call clear the upper ymm halves first: gcc leaves them dirty
+   across the jump, and the legacy SSE scalar code then runs several times slower. */
+
+__attribute__((target("avx2")))
+static void add_where_fluid_avx2(float* values, const float* solidFlags, size_t count, float amount) {
+    __m256 amountVec = _mm256_set1_ps(amount);
+    __m256 one = _mm256_set1_ps(1.0f);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 isFluid = _mm256_cmp_ps(_mm256_loadu_ps(solidFlags + k), one, _CMP_EQ_OQ);
+        _mm256_storeu_ps(values + k, _mm256_add_ps(_mm256_loadu_ps(values + k), _mm256_and_ps(isFluid, amountVec)));
+    }
+    add_where_fluid_scalar(values + k, solidFlags + k, count - k, amount);
+}
+
+__attribute__((target("avx2")))
+static void zero_where_solid_avx2(float* valuesX, float* valuesY, const float* solidFlags, size_t count) {
+    __m256 zero = _mm256_setzero_ps();
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 isSolid = _mm256_cmp_ps(_mm256_loadu_ps(solidFlags + k), zero, _CMP_EQ_OQ);
+        _mm256_storeu_ps(valuesX + k, _mm256_andnot_ps(isSolid, _mm256_loadu_ps(valuesX + k)));
+        _mm256_storeu_ps(valuesY + k, _mm256_andnot_ps(isSolid, _mm256_loadu_ps(valuesY + k)));
+    }
+    zero_where_solid_scalar(valuesX + k, valuesY + k, solidFlags + k, count - k);
+}
+
+__attribute__((target("avx2")))
+static void prepare_cells_avx2(float* velocityX, float* velocityY, float* smoke, const float* solidFlags, size_t count,
+                               float dissipation, float smokeDissipation, float gravity) {
+    __m256 dissipationVec = _mm256_set1_ps(dissipation);
+    __m256 smokeDissipationVec = _mm256_set1_ps(smokeDissipation);
+    __m256 gravityVec = _mm256_set1_ps(gravity);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 solid = _mm256_loadu_ps(solidFlags + k);
+        __m256 isSolid = _mm256_cmp_ps(solid, zero, _CMP_EQ_OQ);
+        __m256 isFluid = _mm256_cmp_ps(solid, one, _CMP_EQ_OQ);
+        __m256 u = _mm256_mul_ps(_mm256_loadu_ps(velocityX + k), dissipationVec);
+        __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(velocityY + k), dissipationVec), _mm256_and_ps(isFluid, gravityVec));
+        _mm256_storeu_ps(velocityX + k, _mm256_andnot_ps(isSolid, u));
+        _mm256_storeu_ps(velocityY + k, _mm256_andnot_ps(isSolid, v));
+        if (smoke) _mm256_storeu_ps(smoke + k, _mm256_mul_ps(_mm256_loadu_ps(smoke + k), smokeDissipationVec));
+    }
+    _mm256_zeroupper();
+    prepare_cells_scalar(velocityX + k, velocityY + k, smoke ? smoke + k : NULL, solidFlags + k, count - k, dissipation, smokeDissipation, gravity);
+}
+
+__attribute__((target("avx2")))
+static float max_abs_avx2(const float* values, size_t count, int numColumns, size_t columnStride) {
+    __m256 signBit = _mm256_set1_ps(-0.0f);
+    __m256 maxVec = _mm256_setzero_ps();
+    float maxValue = 0.0f;
+    for (int column = 0; column < numColumns; ++column) {
+        const float* columnValues = values + (size_t)column * columnStride;
+        size_t k = 0;
+        for (; k + 8 <= count; k += 8) {
+            maxVec = _mm256_max_ps(maxVec, _mm256_andnot_ps(signBit, _mm256_loadu_ps(columnValues + k)));
+        }
+        maxValue = fmaxf(maxValue, max_abs_scalar(columnValues + k, count - k, 1, 0));
+    }
+
+    float maxLanes[8];
+    _mm256_storeu_ps(maxLanes, maxVec);
+    for (int lane = 0; lane < 8; ++lane) {
+        maxValue = fmaxf(maxValue, maxLanes[lane]);
+    }
+    return maxValue;
+}
+
+__attribute__((target("avx2")))
+static void relax_column_avx2(FluidRelaxColumn* column) {
+    __m256 zero = _mm256_setzero_ps();
+    __m256 signBit = _mm256_set1_ps(-0.0f);
+    __m256 omega = _mm256_set1_ps(column->overRelaxation);
+    __m256 maxVec = zero;
+    __m256d squaresLow = _mm256_setzero_pd();
+    __m256d squaresHigh = _mm256_setzero_pd();
+
+    // the step is even, so the lanes that get relaxed are the same for every block
+    int j = column->firstRow;
+    __m256 evenLanes = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+    __m256 parityMask = ((j & 1) == column->rowParity) ? evenLanes : _mm256_andnot_ps(evenLanes, _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+
+    for (; j + 8 <= column->lastRow; j += 8) {
+        __m256 scale = _mm256_loadu_ps(column->neighborScale + j);
+
+        __m256 divergence = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_loadu_ps(column->velocityX + j), _mm256_loadu_ps(column->velocityXRight + j)),
+                                                        _mm256_loadu_ps(column->velocityY + j)),
+                                          _mm256_loadu_ps(column->velocityY + j + 1));
+
+        __m256 active = _mm256_and_ps(parityMask, _mm256_cmp_ps(scale, zero, _CMP_NEQ_OQ));
+        __m256 dp = _mm256_mul_ps(_mm256_mul_ps(_mm256_xor_ps(divergence, signBit), scale), omega);
+        dp = _mm256_and_ps(active, dp);
+
+        _mm256_storeu_ps(column->pressure + j, _mm256_add_ps(_mm256_loadu_ps(column->pressure + j), dp));
+        _mm256_storeu_ps(column->pressureDelta + j, dp);
+
+        __m256 activeDivergence = _mm256_and_ps(active, divergence);
+        maxVec = _mm256_max_ps(maxVec, _mm256_andnot_ps(signBit, activeDivergence));
+        __m256 squares = _mm256_mul_ps(activeDivergence, activeDivergence);
+        squaresLow = _mm256_add_pd(squaresLow, _mm256_cvtps_pd(_mm256_castps256_ps128(squares)));
+        squaresHigh = _mm256_add_pd(squaresHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(squares, 1)));
+    }
+
+    float maxLanes[8];
+    double squareLanes[8];
+    _mm256_storeu_ps(maxLanes, maxVec);
+    _mm256_storeu_pd(squareLanes, squaresLow);
+    _mm256_storeu_pd(squareLanes + 4, squaresHigh);
+
+    column->residualMax = 0.0f;
+    column->residualSquares = 0.0;
+    for (int lane = 0; lane < 8; ++lane) {
+        column->residualMax = fmaxf(column->residualMax, maxLanes[lane]);
+        column->residualSquares += squareLanes[lane];
+    }
+    relax_rows_scalar(column, j, column->lastRow);
+}
+
+__attribute__((target("avx2")))
+static void apply_column_avx2(float* velocityX, float* velocityY, const float* solid, const float* solidLeft,
+                              const float* pressureDelta, const float* pressureDeltaLeft, int firstRow, int lastRow) {
+    int j = firstRow;
+    for (; j + 8 <= lastRow; j += 8) {
+        __m256 solidVec = _mm256_loadu_ps(solid + j);
+        __m256 delta = _mm256_loadu_ps(pressureDelta + j);
+
+        __m256 vx = _mm256_add_ps(_mm256_loadu_ps(velocityX + j), _mm256_mul_ps(_mm256_loadu_ps(solidLeft + j), delta));
+        vx = _mm256_sub_ps(vx, _mm256_mul_ps(solidVec, _mm256_loadu_ps(pressureDeltaLeft + j)));
+        _mm256_storeu_ps(velocityX + j, vx);
+
+        __m256 vy = _mm256_add_ps(_mm256_loadu_ps(velocityY + j), _mm256_mul_ps(_mm256_loadu_ps(solid + j - 1), delta));
+        vy = _mm256_sub_ps(vy, _mm256_mul_ps(solidVec, _mm256_loadu_ps(pressureDelta + j - 1)));
+        _mm256_storeu_ps(velocityY + j, vy);
+    }
+    _mm256_zeroupper();
+    apply_rows_scalar(velocityX, velocityY, solid, solidLeft, pressureDelta, pressureDeltaLeft, j, lastRow);
+}
+
+// fp16 converts with F16C, which every AVX2 CPU has; bf16 with integer shifts like the SSE4.1 kernels
+__attribute__((target("avx2,f16c")))
+static inline __m256 half_to_float_avx2(const uint16_t* halves, FluidHalfFormat format) {
+    __m128i packed = _mm_loadu_si128((const __m128i*)halves);
+    if (format == FLUID_HALF_BFLOAT16) return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(packed), 16));
+    return _mm256_cvtph_ps(packed);
+}
+
+__attribute__((target("avx2,f16c")))
+static inline void float_to_half_avx2(__m256 values, uint16_t* halves, FluidHalfFormat format) {
+    __m128i packed;
+    if (format == FLUID_HALF_BFLOAT16) {
+        __m256i bits = _mm256_castps_si256(values);
+        __m256i lowestKept = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+        __m256i rounded = _mm256_add_epi32(bits, _mm256_add_epi32(_mm256_set1_epi32(0x7fff), lowestKept));
+        __m256i quietNan = _mm256_or_si256(bits, _mm256_set1_epi32(0x400000));
+        __m256i isNan = _mm256_castps_si256(_mm256_cmp_ps(values, values, _CMP_UNORD_Q));
+        __m256i upper = _mm256_srli_epi32(_mm256_blendv_epi8(rounded, quietNan, isNan), 16);
+        packed = _mm_packus_epi32(_mm256_castsi256_si128(upper), _mm256_extracti128_si256(upper, 1));
+    } else {
+        packed = _mm256_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT);
+    }
+    _mm_storeu_si128((__m128i*)halves, packed);
+}
+
+__attribute__((target("avx2,f16c")))
+static void decode_half_avx2(const uint16_t* halves, float* values, size_t count, FluidHalfFormat format) {
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        _mm256_storeu_ps(values + k, half_to_float_avx2(halves + k, format));
+    }
+    _mm256_zeroupper();
+    decode_half_scalar(halves + k, values + k, count - k, format);
+}
+
+__attribute__((target("avx2,f16c")))
+static void encode_half_avx2(const float* values, uint16_t* halves, size_t count, FluidHalfFormat format) {
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        float_to_half_avx2(_mm256_loadu_ps(values + k), halves + k, format);
+    }
+    _mm256_zeroupper();
+    encode_half_scalar(values + k, halves + k, count - k, format);
+}
+
+__attribute__((target("avx2,f16c")))
+static void scale_half_avx2(uint16_t* halves, size_t count, float factor, FluidHalfFormat format) {
+    __m256 factorVec = _mm256_set1_ps(factor);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        float_to_half_avx2(_mm256_mul_ps(half_to_float_avx2(halves + k, format), factorVec), halves + k, format);
+    }
+    _mm256_zeroupper();
+    scale_half_scalar(halves + k, count - k, factor, format);
+}
+
+static const FluidKernels avx2Kernels = {
+    FLUID_SIMD_AVX2,
+    "avx2",
+    add_where_fluid_avx2,
+    zero_where_solid_avx2,
+    prepare_cells_avx2,
+    max_abs_avx2,
+    relax_column_avx2,
+    apply_column_avx2,
+    decode_half_avx2,
+    encode_half_avx2,
+    scale_half_avx2
+};
+
+#endif
+
+#ifdef FLUID_HAVE_NEON_KERNELS
+
+// ------------------------------------------------------------------------------------------
+// NEON kernels, 4 cells per instruction
+// ------------------------------------------------------------------------------------------
+
+static void add_where_fluid_neon(float* values, const float* solidFlags, size_t count, float amount) {
+    uint32x4_t amountBits = vreinterpretq_u32_f32(vdupq_n_f32(amount));
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        uint32x4_t isFluid = vceqq_f32(vld1q_f32(solidFlags + k), vdupq_n_f32(1.0f));
+        float32x4_t addend = vreinterpretq_f32_u32(vandq_u32(isFluid, amountBits));
+        vst1q_f32(values + k, vaddq_f32(vld1q_f32(values + k), addend));
+    }
+    add_where_fluid_scalar(values + k, solidFlags + k, count - k, amount);
+}
+
+static void zero_where_solid_neon(float* valuesX, float* valuesY, const float* solidFlags, size_t count) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        uint32x4_t isSolid = vceqq_f32(vld1q_f32(solidFlags + k), vdupq_n_f32(0.0f));
+        vst1q_f32(valuesX + k, vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(vld1q_f32(valuesX + k)), isSolid)));
+        vst1q_f32(valuesY + k, vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(vld1q_f32(valuesY + k)), isSolid)));
+    }
+    zero_where_solid_scalar(valuesX + k, valuesY + k, solidFlags + k, count - k);
+}
+
+static void prepare_cells_neon(float* velocityX, float* velocityY, float* smoke, const float* solidFlags, size_t count,
+                               float dissipation, float smokeDissipation, float gravity) {
+    uint32x4_t gravityBits = vreinterpretq_u32_f32(vdupq_n_f32(gravity));
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        float32x4_t solid = vld1q_f32(solidFlags + k);
+        uint32x4_t isSolid = vceqq_f32(solid, vdupq_n_f32(0.0f));
+        uint32x4_t isFluid = vceqq_f32(solid, vdupq_n_f32(1.0f));
+        float32x4_t u = vmulq_n_f32(vld1q_f32(velocityX + k), dissipation);
+        float32x4_t v = vaddq_f32(vmulq_n_f32(vld1q_f32(velocityY + k), dissipation), vreinterpretq_f32_u32(vandq_u32(isFluid, gravityBits)));
+        vst1q_f32(velocityX + k, vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(u), isSolid)));
+        vst1q_f32(velocityY + k, vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(v), isSolid)));
+        if (smoke) vst1q_f32(smoke + k, vmulq_n_f32(vld1q_f32(smoke + k), smokeDissipation));
+    }
+    prepare_cells_scalar(velocityX + k, velocityY + k, smoke ? smoke + k : NULL, solidFlags + k, count - k, dissipation, smokeDissipation, gravity);
+}
+
+static float max_abs_neon(const float* values, size_t count, int numColumns, size_t columnStride) {
+    float32x4_t maxVec = vdupq_n_f32(0.0f);
+    float maxValue = 0.0f;
+    for (int column = 0; column < numColumns; ++column) {
+        const float* columnValues = values + (size_t)column * columnStride;
+        size_t k = 0;
+        for (; k + 4 <= count; k += 4) {
+            maxVec = vmaxq_f32(maxVec, vabsq_f32(vld1q_f32(columnValues + k)));
+        }
+        maxValue = fmaxf(maxValue, max_abs_scalar(columnValues + k, count - k, 1, 0));
+    }
+    return fmaxf(maxValue, vmaxvq_f32(maxVec));
+}
+
+static void relax_column_neon(FluidRelaxColumn* column) {
+    float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t omega = vdupq_n_f32(column->overRelaxation);
+    float32x4_t maxVec = zero;
+    float64x2_t squaresLow = vdupq_n_f64(0.0);
+    float64x2_t squaresHigh = vdupq_n_f64(0.0);
+
+    // the step is even, so the lanes that get relaxed are the same for every block
+    int j = column->firstRow;
+    static const uint32_t evenLaneBits[4] = { 0xFFFFFFFFu, 0u, 0xFFFFFFFFu, 0u };
+    uint32x4_t evenLanes = vld1q_u32(evenLaneBits);
+    uint32x4_t parityMask = ((j & 1) == column->rowParity) ? evenLanes : vmvnq_u32(evenLanes);
+
+    for (; j + 4 <= column->lastRow; j += 4) {
+        float32x4_t scale = vld1q_f32(column->neighborScale + j);
+
+        float32x4_t divergence = vsubq_f32(vaddq_f32(vsubq_f32(vld1q_f32(column->velocityX + j), vld1q_f32(column->velocityXRight + j)),
+                                                     vld1q_f32(column->velocityY + j)),
+                                           vld1q_f32(column->velocityY + j + 1));
+
+        uint32x4_t active = vandq_u32(parityMask, vmvnq_u32(vceqq_f32(scale, zero)));
+        float32x4_t dp = vmulq_f32(vmulq_f32(vnegq_f32(divergence), scale), omega);
+        dp = vreinterpretq_f32_u32(vandq_u32(active, vreinterpretq_u32_f32(dp)));
+
+        vst1q_f32(column->pressure + j, vaddq_f32(vld1q_f32(column->pressure + j), dp));
+        vst1q_f32(column->pressureDelta + j, dp);
+
+        float32x4_t activeDivergence = vreinterpretq_f32_u32(vandq_u32(active, vreinterpretq_u32_f32(divergence)));
+        maxVec = vmaxq_f32(maxVec, vabsq_f32(activeDivergence));
+        float32x4_t squares = vmulq_f32(activeDivergence, activeDivergence);
+        squaresLow = vaddq_f64(squaresLow, vcvt_f64_f32(vget_low_f32(squares)));
+        squaresHigh = vaddq_f64(squaresHigh, vcvt_high_f64_f32(squares));
+    }
+
+    column->residualMax = vmaxvq_f32(maxVec);
+    column->residualSquares = vaddvq_f64(squaresLow) + vaddvq_f64(squaresHigh);
+    relax_rows_scalar(column, j, column->lastRow);
+}
+
+static void apply_column_neon(float* velocityX, float* velocityY, const float* solid, const float* solidLeft,
+                              const float* pressureDelta, const float* pressureDeltaLeft, int firstRow, int lastRow) {
+    int j = firstRow;
+    for (; j + 4 <= lastRow; j += 4) {
+        float32x4_t solidVec = vld1q_f32(solid + j);
+        float32x4_t delta = vld1q_f32(pressureDelta + j);
+
+        float32x4_t vx = vaddq_f32(vld1q_f32(velocityX + j), vmulq_f32(vld1q_f32(solidLeft + j), delta));
+        vx = vsubq_f32(vx, vmulq_f32(solidVec, vld1q_f32(pressureDeltaLeft + j)));
+        vst1q_f32(velocityX + j, vx);
+
+        float32x4_t vy = vaddq_f32(vld1q_f32(velocityY + j), vmulq_f32(vld1q_f32(solid + j - 1), delta));
+        vy = vsubq_f32(vy, vmulq_f32(solidVec, vld1q_f32(pressureDelta + j - 1)));
+        vst1q_f32(velocityY + j, vy);
+    }
+    apply_rows_scalar(velocityX, velocityY, solid, solidLeft, pressureDelta, pressureDeltaLeft, j, lastRow);
+}
+
+// fp16 converts with the NEON conversion instructions (round to nearest even), bf16 with integer shifts
+static inline float32x4_t half_to_float_neon(const uint16_t* halves, FluidHalfFormat format) {
+    uint16x4_t packed = vld1_u16(halves);
+    if (format == FLUID_HALF_BFLOAT16) return vreinterpretq_f32_u32(vshll_n_u16(packed, 16));
+    return vcvt_f32_f16(vreinterpret_f16_u16(packed));
+}
+
+static inline void float_to_half_neon(float32x4_t values, uint16_t* halves, FluidHalfFormat format) {
+    if (format == FLUID_HALF_BFLOAT16) {
+        uint32x4_t bits = vreinterpretq_u32_f32(values);
+        uint32x4_t lowestKept = vandq_u32(vshrq_n_u32(bits, 16), vdupq_n_u32(1));
+        uint32x4_t rounded = vaddq_u32(bits, vaddq_u32(vdupq_n_u32(0x7fff), lowestKept));
+        uint32x4_t quietNan = vorrq_u32(bits, vdupq_n_u32(0x400000));
+        uint32x4_t isNumber = vceqq_f32(values, values);
+        vst1_u16(halves, vshrn_n_u32(vbslq_u32(isNumber, rounded, quietNan), 16));
+    } else {
+        vst1_u16(halves, vreinterpret_u16_f16(vcvt_f16_f32(values)));
+    }
+}
+
+static void decode_half_neon(const uint16_t* halves, float* values, size_t count, FluidHalfFormat format) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        vst1q_f32(values + k, half_to_float_neon(halves + k, format));
+    }
+    decode_half_scalar(halves + k, values + k, count - k, format);
+}
+
+static void encode_half_neon(const float* values, uint16_t* halves, size_t count, FluidHalfFormat format) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        float_to_half_neon(vld1q_f32(values + k), halves + k, format);
+    }
+    encode_half_scalar(values + k, halves + k, count - k, format);
+}
+
+static void scale_half_neon(uint16_t* halves, size_t count, float factor, FluidHalfFormat format) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        float_to_half_neon(vmulq_n_f32(half_to_float_neon(halves + k, format), factor), halves + k, format);
+    }
+    scale_half_scalar(halves + k, count - k, factor, format);
+}
+
+static const FluidKernels neonKernels = {
+    FLUID_SIMD_NEON,
+    "neon",
+    add_where_fluid_neon,
+    zero_where_solid_neon,
+    prepare_cells_neon,
+    max_abs_neon,
+    relax_column_neon,
+    apply_column_neon,
+    decode_half_neon,
+    encode_half_neon,
+    scale_half_neon
+};
+
+#endif
+
+const FluidKernels* fluid_kernels_get(FluidSimdLevel level) {
+    switch (level) {
+        case FLUID_SIMD_SCALAR:
+            return &scalarKernels;
+#ifdef FLUID_HAVE_X86_KERNELS
+        case FLUID_SIMD_SSE4:
+            return __builtin_cpu_supports("sse4.1") ? &sse4Kernels : NULL;
+        case FLUID_SIMD_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c") ? &avx2Kernels : NULL;
+#endif
+#ifdef FLUID_HAVE_NEON_KERNELS
+        case FLUID_SIMD_NEON:
+            return &neonKernels;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+const FluidKernels* fluid_kernels_best(void) {
+    static const FluidSimdLevel preferred[] = { FLUID_SIMD_AVX2, FLUID_SIMD_NEON, FLUID_SIMD_SSE4 };
+
+    for (size_t k = 0; k < sizeof(preferred) / sizeof(preferred[0]); ++k) {
+        const FluidKernels* kernels = fluid_kernels_get(preferred[k]);
+        if (kernels) return kernels;
+    }
+    return &scalarKernels;
+}
@@ -0,0 +1,623 @@
+#include "fluid_slabs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#ifndef _WIN32
+
+#include <stdatomic.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// polls of the barrier before a waiting process starts yielding its core
+#define BARRIER_SPIN_COUNT 4000
+
+/**
+ * Fields exchanged between neighbor slabs, combined as bit flags in exchange_halos.
+ */
+typedef enum {
+    HALO_VELOCITY_X,
+    HALO_VELOCITY_Y,
+    HALO_PRESSURE,
+    HALO_SMOKE,
+    HALO_PRESSURE_DELTA,
+    NUM_HALO_FIELDS
+} HaloField;
+
+#define HALO_VELOCITIES ((1 << HALO_VELOCITY_X) | (1 << HALO_VELOCITY_Y))
+#define HALO_STATE (HALO_VELOCITIES | (1 << HALO_PRESSURE) | (1 << HALO_SMOKE))
+
+// edges of a slab in its outbox
+enum { EDGE_LEFT, EDGE_RIGHT };
+
+/**
+ * Barrier of the worker processes. The last process to arrive starts the next generation.
+ */
+typedef struct {
+    atomic_int arrived;
+    atomic_int generation;
+} SlabBarrier;
+
+/**
+ * Settings of the next step, written by the creating process while the workers wait for a command.
+ */
+typedef struct {
+    int numIterations;
+    float deltaTime;
+    float gravityForce;
+    float overRelaxation;
+    float dissipation;
+    float smokeDissipation;
+    float solverTolerance;
+    int warmStartPressure;
+    SlabBarrier barrier;
+} SlabControl;
+
+/**
+ * State of one slab visible to every process. Pointers are valid in all of them, the workers are forked
+ * after the shared memory is mapped.
+ */
+typedef struct {
+    // front fields after the last step (advection swaps the buffers)
+    float* velocityX;
+    float* velocityY;
+    float* smokeDensity;
+
+    // set by fluid_slabs_set_obstacle when a solid flag of the slab changed
+    int obstaclesDirty;
+
+    // residual of the slab in the current solve, by iteration parity so the next iteration doesn't overwrite it early
+    float residualMax[2];
+    double residualSquares[2];
+
+    // statistics of the last solve over all slabs
+    int lastSolverIterations;
+    float lastResidualMax;
+    float lastResidualL2;
+
+    // edge columns published to the neighbors: [slot][edge][HaloField] columns of numCellsY values
+    float* outbox;
+} SlabShared;
+
+struct FluidSlabs {
+    int numCellsX;
+    int numCellsY;
+    int numSlabs;
+    int* firstColumn;           // column of the whole grid that is column 1 of the slab
+
+    // the slabs' Fluids as they were when the workers were forked, this process only uses their solid flags
+    // and the front fields, which slab_view refreshes from SlabShared
+    Fluid** fluids;
+
+    void* shared;
+    size_t sharedSize;
+    SlabControl* control;
+    SlabShared* slabShared;
+
+    pid_t* workers;
+    int* commandPipes;          // per slab its read and write end, a byte starts a step and closing ends the worker
+    int* resultPipes;           // per slab its read and write end, a byte reports a finished step
+    struct pollfd* pollFds;
+    int failed;
+};
+
+/**
+ * Data of the slab a worker process simulates.
+ */
+typedef struct {
+    FluidSlabs* slabs;
+    int slab;
+    Fluid* fluid;
+    int numExchanges;
+} SlabWorker;
+
+static inline size_t align_size(size_t numBytes) {
+    return (numBytes + FLUID_ARENA_ALIGNMENT - 1) & ~(size_t)(FLUID_ARENA_ALIGNMENT - 1);
+}
+
+static void barrier_wait(SlabBarrier* barrier, int numProcesses) {
+    int generation = atomic_load(&barrier->generation);
+
+    if (atomic_fetch_add(&barrier->arrived, 1) == numProcesses - 1) {
+        atomic_store(&barrier->arrived, 0);
+        atomic_fetch_add(&barrier->generation, 1);
+        return;
+    }
+
+    // the others arrive within one pass, spin before giving up the core
+    for (int spin = 0; atomic_load(&barrier->generation) == generation; ++spin) {
+        if (spin >= BARRIER_SPIN_COUNT) sched_yield();
+    }
+}
+
+static float* halo_field(Fluid* fluidPtr, int field) {
+    switch (field) {
+        case HALO_VELOCITY_X: return fluidPtr->velocityX;
+        case HALO_VELOCITY_Y: return fluidPtr->velocityY;
+        case HALO_PRESSURE: return fluidPtr->pressure;
+        case HALO_SMOKE: return fluidPtr->smokeDensity;
+        default: return fluidPtr->pressureDelta;
+    }
+}
+
+static inline float* outbox_column(const FluidSlabs* slabs, int slab, int slot, int edge, int field) {
+    return slabs->slabShared[slab].outbox + ((size_t)(slot * 2 + edge) * NUM_HALO_FIELDS + field) * slabs->numCellsY;
+}
+
+/**
+ * Publishes the edge columns of the given fields, waits for every slab to do the same and copies the
+ * neighbors' edges into the halo columns. Outboxes alternate between two slots: a slot is only written again
+ * two exchanges later, after the barrier of the next exchange, which no neighbor passes before it read the slot.
+ */
+static void exchange_halos(SlabWorker* worker, int fields) {
+    FluidSlabs* slabs = worker->slabs;
+    Fluid* fluidPtr = worker->fluid;
+    int slot = worker->numExchanges++ & 1;
+    size_t columnBytes = (size_t)fluidPtr->numCellsY * sizeof(float);
+    size_t lastColumn = (size_t)(fluidPtr->numCellsX - 2) * fluidPtr->rowStride;
+    size_t rightHalo = (size_t)(fluidPtr->numCellsX - 1) * fluidPtr->rowStride;
+    int hasLeft = worker->slab > 0;
+    int hasRight = worker->slab < slabs->numSlabs - 1;
+
+    for (int field = 0; field < NUM_HALO_FIELDS; ++field) {
+        if (!(fields & (1 << field))) continue;
+        const float* values = halo_field(fluidPtr, field);
+        if (hasLeft) memcpy(outbox_column(slabs, worker->slab, slot, EDGE_LEFT, field), values + fluidPtr->rowStride, columnBytes);
+        if (hasRight) memcpy(outbox_column(slabs, worker->slab, slot, EDGE_RIGHT, field), values + lastColumn, columnBytes);
+    }
+
+    barrier_wait(&slabs->control->barrier, slabs->numSlabs);
+
+    for (int field = 0; field < NUM_HALO_FIELDS; ++field) {
+        if (!(fields & (1 << field))) continue;
+        float* values = halo_field(fluidPtr, field);
+        if (hasLeft) memcpy(values, outbox_column(slabs, worker->slab - 1, slot, EDGE_RIGHT, field), columnBytes);
+        if (hasRight) memcpy(values + rightHalo, outbox_column(slabs, worker->slab + 1, slot, EDGE_LEFT, field), columnBytes);
+    }
+}
+
+/**
+ * Red-black solve of the slab together with the others. The apply pass of the first column and of the right halo
+ * column reads the pressure change of the neighbor's edge column, so it's exchanged after every relax pass.
+ * With the halo column's faces updated the same way in both slabs, the shared faces stay equal on both sides.
+ */
+static void solve_slab(SlabWorker* worker) {
+    const SlabControl* control = worker->slabs->control;
+    const SlabShared* slabShared = worker->slabs->slabShared;
+    SlabShared* shared = &worker->slabs->slabShared[worker->slab];
+    Fluid* fluidPtr = worker->fluid;
+
+    fluid_begin_pressure_solve(fluidPtr);
+
+    float residualMax = 0.0f;
+    double residualSquares = 0.0;
+    int iter = 0;
+
+    while (iter < control->numIterations) {
+        int parity = iter++ & 1;
+
+        for (int color = 0; color < 2; ++color) {
+            fluid_relax_color(fluidPtr, color, control->overRelaxation);
+
+            // published before the barrier of the exchange, so every slab can read it after
+            if (color == 1) {
+                double squares = 0.0;
+                shared->residualMax[parity] = fluid_sweep_residual(fluidPtr, &squares);
+                shared->residualSquares[parity] = squares;
+            }
+
+            exchange_halos(worker, 1 << HALO_PRESSURE_DELTA);
+            fluid_apply_pressure_delta(fluidPtr);
+        }
+
+        // reduced in slab order in every process, so all of them stop at the same iteration
+        residualMax = 0.0f;
+        residualSquares = 0.0;
+        for (int slab = 0; slab < worker->slabs->numSlabs; ++slab) {
+            residualMax = fmaxf(residualMax, slabShared[slab].residualMax[parity]);
+            residualSquares += slabShared[slab].residualSquares[parity];
+        }
+        if (residualMax <= fluidPtr->solverTolerance) break;
+    }
+
+    fluidPtr->lastSolverIterations = iter;
+    fluidPtr->lastResidualMax = residualMax;
+    fluidPtr->lastResidualL2 = (float)sqrt(residualSquares);
+    shared->lastSolverIterations = iter;
+    shared->lastResidualMax = residualMax;
+    shared->lastResidualL2 = fluidPtr->lastResidualL2;
+}
+
+/**
+ * One step of the slab, the same passes as fluid_simulate_step with the halos exchanged in between.
+ */
+static void step_slab(SlabWorker* worker) {
+    const SlabControl* control = worker->slabs->control;
+    SlabShared* shared = &worker->slabs->slabShared[worker->slab];
+    Fluid* fluidPtr = worker->fluid;
+
+    fluidPtr->solverTolerance = control->solverTolerance;
+    fluidPtr->warmStartPressure = control->warmStartPressure;
+    if (shared->obstaclesDirty) {
+        fluidPtr->obstaclesDirty = 1;
+        shared->obstaclesDirty = 0;
+    }
+
+    // picks up changes made between steps and the pressure of the neighbors for the warm start
+    exchange_halos(worker, HALO_STATE);
+
+    fluid_prepare_projection(fluidPtr, control->deltaTime, control->gravityForce, control->dissipation, control->smokeDissipation);
+    solve_slab(worker);
+
+    // advection samples the neighbors' velocities, smoke advection the faces velocity advection computed there
+    exchange_halos(worker, HALO_VELOCITIES);
+    fluid_advect_velocity(fluidPtr, control->deltaTime);
+    exchange_halos(worker, HALO_VELOCITIES);
+    fluid_advect_smoke(fluidPtr, control->deltaTime);
+
+    shared->velocityX = fluidPtr->velocityX;
+    shared->velocityY = fluidPtr->velocityY;
+    shared->smokeDensity = fluidPtr->smokeDensity;
+}
+
+/**
+ * Main loop of a worker process: one step per command byte until the command pipe is closed.
+ */
+static void run_worker(FluidSlabs* slabs, int slab) {
+
+    // only this slab's pipe ends stay open, so a closed pipe means the other side is gone
+    for (int other = 0; other < slabs->numSlabs; ++other) {
+        close(slabs->commandPipes[2 * other + 1]);
+        close(slabs->resultPipes[2 * other]);
+        if (other != slab) {
+            close(slabs->commandPipes[2 * other]);
+            close(slabs->resultPipes[2 * other + 1]);
+        }
+    }
+
+    SlabWorker worker = { slabs, slab, slabs->fluids[slab], 0 };
+    char command;
+    while (read(slabs->commandPipes[2 * slab], &command, 1) == 1) {
+        step_slab(&worker);
+        if (write(slabs->resultPipes[2 * slab + 1], &command, 1) != 1) break;
+    }
+    _exit(0);
+}
+
+static void stop_workers(FluidSlabs* slabs, int killWorkers) {
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        if (slabs->commandPipes[2 * slab + 1] >= 0) close(slabs->commandPipes[2 * slab + 1]);
+        slabs->commandPipes[2 * slab + 1] = -1;
+        if (killWorkers && slabs->workers[slab] > 0) kill(slabs->workers[slab], SIGKILL);
+    }
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        if (slabs->workers[slab] > 0) waitpid(slabs->workers[slab], NULL, 0);
+        slabs->workers[slab] = 0;
+    }
+}
+
+/**
+ * Refreshes the front fields of a slab's Fluid in this process. Its back buffers are stale.
+ */
+static Fluid* slab_view(FluidSlabs* slabs, int slab) {
+    Fluid* fluidPtr = slabs->fluids[slab];
+    fluidPtr->velocityX = slabs->slabShared[slab].velocityX;
+    fluidPtr->velocityY = slabs->slabShared[slab].velocityY;
+    fluidPtr->smokeDensity = slabs->slabShared[slab].smokeDensity;
+    return fluidPtr;
+}
+
+static int owner_slab(const FluidSlabs* slabs, int x) {
+    int slab = 0;
+    while (slab < slabs->numSlabs - 1 && x >= slabs->firstColumn[slab + 1]) ++slab;
+    return slab;
+}
+
+/**
+ * Lays out the shared memory: control block, slab states, outboxes and the slab arenas, each 64-byte aligned.
+ */
+static int map_shared(FluidSlabs* slabs) {
+    size_t outboxBytes = align_size((size_t)2 * 2 * NUM_HALO_FIELDS * slabs->numCellsY * sizeof(float));
+    size_t sharedSize = align_size(sizeof(SlabControl)) + align_size((size_t)slabs->numSlabs * sizeof(SlabShared));
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        sharedSize += outboxBytes + align_size(slabs->fluids[slab]->arenaSize);
+    }
+
+    void* shared = mmap(NULL, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) return 0;
+    slabs->shared = shared;
+    slabs->sharedSize = sharedSize;
+
+    unsigned char* next = (unsigned char*)shared;
+    slabs->control = (SlabControl*)next;
+    next += align_size(sizeof(SlabControl));
+    slabs->slabShared = (SlabShared*)next;
+    next += align_size((size_t)slabs->numSlabs * sizeof(SlabShared));
+
+    atomic_init(&slabs->control->barrier.arrived, 0);
+    atomic_init(&slabs->control->barrier.generation, 0);
+
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        Fluid* fluidPtr = slabs->fluids[slab];
+        SlabShared* slabShared = &slabs->slabShared[slab];
+
+        slabShared->outbox = (float*)next;
+        next += outboxBytes;
+
+        fluid_move_arena(fluidPtr, next);
+        next += align_size(fluidPtr->arenaSize);
+
+        slabShared->velocityX = fluidPtr->velocityX;
+        slabShared->velocityY = fluidPtr->velocityY;
+        slabShared->smokeDensity = fluidPtr->smokeDensity;
+    }
+    return 1;
+}
+
+static int start_workers(FluidSlabs* slabs) {
+
+    // a worker that died must show up as a failed write, not end this process
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        if (pipe(&slabs->commandPipes[2 * slab]) != 0) return 0;
+        if (pipe(&slabs->resultPipes[2 * slab]) != 0) return 0;
+    }
+
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        pid_t pid = fork();
+        if (pid < 0) return 0;
+        if (pid == 0) run_worker(slabs, slab);
+        slabs->workers[slab] = pid;
+    }
+
+    // keep the command write and result read ends
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        close(slabs->commandPipes[2 * slab]);
+        close(slabs->resultPipes[2 * slab + 1]);
+        slabs->commandPipes[2 * slab] = -1;
+        slabs->resultPipes[2 * slab + 1] = -1;
+        slabs->pollFds[slab].fd = slabs->resultPipes[2 * slab];
+        slabs->pollFds[slab].events = POLLIN;
+    }
+    return 1;
+}
+
+FluidSlabs* fluid_slabs_create(float density, int numX, int numY, float cellSize, int numSlabs) {
+
+    if (numSlabs < 1 || numX < 2 * numSlabs || numY < 1) {
+        printf("ERROR: fluid_slabs_create needs at least 2 columns per slab\n");
+        return NULL;
+    }
+
+    FluidSlabs* slabs = (FluidSlabs*)calloc(1, sizeof(FluidSlabs));
+    if (slabs == NULL) {
+        printf("ERROR: fluid_slabs_create failed to allocate slabs\n");
+        return NULL;
+    }
+    slabs->numCellsX = numX + 2;
+    slabs->numCellsY = numY + 2;
+    slabs->numSlabs = numSlabs;
+    slabs->firstColumn = (int*)calloc((size_t)numSlabs, sizeof(int));
+    slabs->fluids = (Fluid**)calloc((size_t)numSlabs, sizeof(Fluid*));
+    slabs->workers = (pid_t*)calloc((size_t)numSlabs, sizeof(pid_t));
+    slabs->commandPipes = (int*)malloc((size_t)numSlabs * 2 * sizeof(int));
+    slabs->resultPipes = (int*)malloc((size_t)numSlabs * 2 * sizeof(int));
+    slabs->pollFds = (struct pollfd*)calloc((size_t)numSlabs, sizeof(struct pollfd));
+    if (!slabs->firstColumn || !slabs->fluids || !slabs->workers || !slabs->commandPipes || !slabs->resultPipes || !slabs->pollFds) {
+        fluid_slabs_free(slabs);
+        printf("ERROR: fluid_slabs_create failed to allocate slabs\n");
+        return NULL;
+    }
+    for (int end = 0; end < numSlabs * 2; ++end) {
+        slabs->commandPipes[end] = -1;
+        slabs->resultPipes[end] = -1;
+    }
+
+    // slabs of whole column pairs so each starts on an odd column and keeps the red-black colors of the whole grid
+    int numPairs = numX / 2;
+    for (int slab = 0; slab < numSlabs; ++slab) {
+        int firstPair = (int)((long long)numPairs * slab / numSlabs);
+        int endPair = (int)((long long)numPairs * (slab + 1) / numSlabs);
+        int width = 2 * (endPair - firstPair) + (slab == numSlabs - 1 ? numX % 2 : 0);
+
+        slabs->firstColumn[slab] = 1 + 2 * firstPair;
+        slabs->fluids[slab] = fluid_init(density, width, numY, cellSize, PRESSURE_SOLVER_RED_BLACK_SOR);
+        if (slabs->fluids[slab] == NULL) {
+            fluid_slabs_free(slabs);
+            return NULL;
+        }
+    }
+
+    if (!map_shared(slabs)) {
+        fluid_slabs_free(slabs);
+        printf("ERROR: fluid_slabs_create failed to map shared memory\n");
+        return NULL;
+    }
+
+    if (!start_workers(slabs)) {
+        fluid_slabs_free(slabs);
+        printf("ERROR: fluid_slabs_create failed to start the worker processes\n");
+        return NULL;
+    }
+
+    return slabs;
+}
+
+void fluid_slabs_free(FluidSlabs* slabs) {
+    if (slabs) {
+        if (slabs->workers && slabs->commandPipes) stop_workers(slabs, slabs->failed);
+        for (int end = 0; slabs->commandPipes && slabs->resultPipes && end < slabs->numSlabs * 2; ++end) {
+            if (slabs->commandPipes[end] >= 0) close(slabs->commandPipes[end]);
+            if (slabs->resultPipes[end] >= 0) close(slabs->resultPipes[end]);
+        }
+        for (int slab = 0; slabs->fluids && slab < slabs->numSlabs; ++slab) {
+            fluid_free(slabs->fluids[slab]);
+        }
+        if (slabs->shared) munmap(slabs->shared, slabs->sharedSize);
+        free(slabs->firstColumn);
+        free(slabs->fluids);
+        free(slabs->workers);
+        free(slabs->commandPipes);
+        free(slabs->resultPipes);
+        free(slabs->pollFds);
+        free(slabs);
+    }
+}
+
+void fluid_slabs_set_solver_tolerance(FluidSlabs* slabs, float tolerance, int warmStartPressure) {
+    slabs->control->solverTolerance = tolerance;
+    slabs->control->warmStartPressure = warmStartPressure;
+}
+
+void fluid_slabs_set_obstacle(FluidSlabs* slabs, int x, int y, float isSolidFlag) {
+
+    // the owning slab and the neighbor whose halo holds the cell
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        Fluid* fluidPtr = slab_view(slabs, slab);
+        int localX = x - slabs->firstColumn[slab] + 1;
+        if (localX < 0 || localX >= fluidPtr->numCellsX) continue;
+
+        fluidPtr->obstaclesDirty = 0;
+        fluid_set_obstacle(fluidPtr, localX, y, isSolidFlag);
+        if (fluidPtr->obstaclesDirty) slabs->slabShared[slab].obstaclesDirty = 1;
+    }
+}
+
+float* fluid_slabs_cell(FluidSlabs* slabs, FieldType field, int x, int y) {
+    if (x < 0 || x >= slabs->numCellsX || y < 0 || y >= slabs->numCellsY) return NULL;
+
+    int slab = owner_slab(slabs, x);
+    Fluid* fluidPtr = slab_view(slabs, slab);
+    size_t cellIndex = (size_t)(x - slabs->firstColumn[slab] + 1) * fluidPtr->rowStride + y;
+
+    switch (field) {
+        case U_FIELD: return fluidPtr->velocityX + cellIndex;
+        case V_FIELD: return fluidPtr->velocityY + cellIndex;
+        case SMOKE_FIELD: return fluidPtr->smokeDensity + cellIndex;
+        default: return NULL;
+    }
+}
+
+void fluid_slabs_gather(FluidSlabs* slabs, FieldType field, float* values) {
+    for (int x = 0; x < slabs->numCellsX; ++x) {
+        const float* column = fluid_slabs_cell(slabs, field, x, 0);
+        if (column) memcpy(values + (size_t)x * slabs->numCellsY, column, (size_t)slabs->numCellsY * sizeof(float));
+    }
+}
+
+/**
+ * Waits until every worker reported the step. Returns 0 when one of them exited instead.
+ */
+static int wait_for_workers(FluidSlabs* slabs) {
+    int numPending = slabs->numSlabs;
+    for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+        slabs->pollFds[slab].fd = slabs->resultPipes[2 * slab];
+    }
+
+    while (numPending > 0) {
+        if (poll(slabs->pollFds, (nfds_t)slabs->numSlabs, -1) < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+
+        for (int slab = 0; slab < slabs->numSlabs; ++slab) {
+            if (slabs->pollFds[slab].fd < 0 || slabs->pollFds[slab].revents == 0) continue;
+
+            char reply;
+            if (read(slabs->pollFds[slab].fd, &reply, 1) != 1) return 0;
+
+            // a negative descriptor is skipped by poll
+            slabs->pollFds[slab].fd = -1;
+            --numPending;
+        }
+    }
+    return 1;
+}
+
+int fluid_slabs_simulate_step(FluidSlabs* slabs, int numIterations, float deltaTime, float gravityForce,
+                              float overRelaxation, float dissipation, float smokeDissipation) {
+    if (slabs->failed) return 0;
+
+    SlabControl* control = slabs->control;
+    control->numIterations = numIterations;
+    control->deltaTime = deltaTime;
+    control->gravityForce = gravityForce;
+    control->overRelaxation = overRelaxation;
+    control->dissipation = dissipation;
+    control->smokeDissipation = smokeDissipation;
+
+    int ok = 1;
+    for (int slab = 0; slab < slabs->numSlabs && ok; ++slab) {
+        ok = write(slabs->commandPipes[2 * slab + 1], "s", 1) == 1;
+    }
+
+    if (!ok || !wait_for_workers(slabs)) {
+        // the others wait for the lost slab in the barrier forever
+        slabs->failed = 1;
+        stop_workers(slabs, 1);
+        printf("ERROR: fluid_slabs_simulate_step lost a worker process\n");
+        return 0;
+    }
+    return 1;
+}
+
+void fluid_slabs_solver_statistics(const FluidSlabs* slabs, int* iterations, float* residualMax, float* residualL2) {
+    *iterations = slabs->slabShared[0].lastSolverIterations;
+    *residualMax = slabs->slabShared[0].lastResidualMax;
+    *residualL2 = slabs->slabShared[0].lastResidualL2;
+}
+
+#else
+
+// no fork on Windows
+
+FluidSlabs* fluid_slabs_create(float density, int numX, int numY, float cellSize, int numSlabs) {
+    (void)density; (void)numX; (void)numY; (void)cellSize; (void)numSlabs;
+    printf("ERROR: fluid_slabs_create needs fork, which this platform doesn't have\n");
+    return NULL;
+}
+
+void fluid_slabs_free(FluidSlabs* slabs) { (void)slabs; }
+
+void fluid_slabs_set_solver_tolerance(FluidSlabs* slabs, float tolerance, int warmStartPressure) {
+    (void)slabs; (void)tolerance; (void)warmStartPressure;
+}
+
+void fluid_slabs_set_obstacle(FluidSlabs* slabs, int x, int y, float isSolidFlag) {
+    (void)slabs; (void)x; (void)y; (void)isSolidFlag;
+}
+
+float* fluid_slabs_cell(FluidSlabs* slabs, FieldType field, int x, int y) {
+    (void)slabs; (void)field; (void)x; (void)y;
+    return NULL;
+}
+
+void fluid_slabs_gather(FluidSlabs* slabs, FieldType field, float* values) { (void)slabs; (void)field; (void)values; }
+
+int fluid_slabs_simulate_step(FluidSlabs* slabs, int numIterations, float deltaTime, float gravityForce,
+                              float overRelaxation, float dissipation, float smokeDissipation) {
+    (void)slabs; (void)numIterations; (void)deltaTime; (void)gravityForce;
+    (void)overRelaxation; (void)dissipation; (void)smokeDissipation;
+    return 0;
+}
+
+void fluid_slabs_solver_statistics(const FluidSlabs* slabs, int* iterations, float* residualMax, float* residualL2) {
+    (void)slabs;
+    *iterations = 0;
+    *residualMax = 0.0f;
+    *residualL2 = 0.0f;
+}
+
+#endif
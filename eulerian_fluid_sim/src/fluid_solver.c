@@ -0,0 +1,584 @@
+#include "fluid_solver.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+// without a user tolerance, stop once the max residual drops below this fraction of the initial one
+#define SOLVER_RELATIVE_TOLERANCE 1e-4f
+
+// MIC(0) tuning constant and safety factor (see Bridson, "Fluid Simulation for Computer Graphics")
+#define MIC_TUNING 0.97f
+#define MIC_SAFETY 0.25f
+
+#define MULTIGRID_MAX_LEVELS 16
+#define MULTIGRID_MIN_INTERIOR_CELLS 4
+#define MULTIGRID_SMOOTHING_SWEEPS 2
+#define MULTIGRID_COARSE_SWEEPS 40
+
+
+/**
+ * One level of the multigrid hierarchy. Level 0 is the simulation grid.
+ * faceX[i][j] is the weight of the face between cells (i - 1, j) and (i, j),
+ * faceY[i][j] is the weight of the face between cells (i, j - 1) and (i, j).
+ * Cells with diag == 0 are not unknowns and keep a solution of 0.
+ */
+typedef struct {
+    int numCellsX;
+    int numCellsY;
+    int rowStride;
+    size_t totalNumCells;
+
+    float* faceX;
+    float* faceY;
+    float* diag;
+
+    float* solution;
+    float* rhs;
+    float* residual;
+} MultigridLevel;
+
+struct FluidPressureSystem {
+    PressureSolverType solverType;
+
+    MultigridLevel levels[MULTIGRID_MAX_LEVELS];
+    int numLevels;
+
+    // PCG only
+    float* plusX;
+    float* plusY;
+    float* precon;
+    float* auxiliary;
+    float* search;
+    float* product;
+};
+
+static int level_alloc(MultigridLevel* level, int numCellsX, int numCellsY, int rowStride) {
+    level->numCellsX = numCellsX;
+    level->numCellsY = numCellsY;
+    level->rowStride = rowStride;
+    level->totalNumCells = (size_t)numCellsX * rowStride;
+
+    level->faceX = (float*)calloc(level->totalNumCells, sizeof(float));
+    level->faceY = (float*)calloc(level->totalNumCells, sizeof(float));
+    level->diag = (float*)calloc(level->totalNumCells, sizeof(float));
+    level->solution = (float*)calloc(level->totalNumCells, sizeof(float));
+    level->rhs = (float*)calloc(level->totalNumCells, sizeof(float));
+    level->residual = (float*)calloc(level->totalNumCells, sizeof(float));
+
+    return level->faceX && level->faceY && level->diag && level->solution && level->rhs && level->residual;
+}
+
+static void level_free(MultigridLevel* level) {
+    free(level->faceX);
+    free(level->faceY);
+    free(level->diag);
+    free(level->solution);
+    free(level->rhs);
+    free(level->residual);
+}
+
+FluidPressureSystem* fluid_pressure_system_create(int numCellsX, int numCellsY, int rowStride, PressureSolverType solverType) {
+
+    FluidPressureSystem* system = (FluidPressureSystem*)calloc(1, sizeof(FluidPressureSystem));
+    if (system == NULL) {
+        printf("ERROR: fluid_pressure_system_create failed to allocate system\n");
+        return NULL;
+    }
+    system->solverType = solverType;
+
+    // the fine level shares the layout of the fluid fields
+    int ok = level_alloc(&system->levels[0], numCellsX, numCellsY, rowStride);
+    system->numLevels = 1;
+
+    if (solverType == PRESSURE_SOLVER_MULTIGRID) {
+        int interiorX = numCellsX - 2;
+        int interiorY = numCellsY - 2;
+
+        // halve the interior until the coarsest level is a few cells wide
+        while (ok && system->numLevels < MULTIGRID_MAX_LEVELS &&
+               interiorX > MULTIGRID_MIN_INTERIOR_CELLS && interiorY > MULTIGRID_MIN_INTERIOR_CELLS) {
+            interiorX = (interiorX + 1) / 2;
+            interiorY = (interiorY + 1) / 2;
+            ok = level_alloc(&system->levels[system->numLevels], interiorX + 2, interiorY + 2, interiorY + 2);
+            system->numLevels++;
+        }
+    } else {
+        size_t totalNumCells = system->levels[0].totalNumCells;
+        system->plusX = (float*)calloc(totalNumCells, sizeof(float));
+        system->plusY = (float*)calloc(totalNumCells, sizeof(float));
+        system->precon = (float*)calloc(totalNumCells, sizeof(float));
+        system->auxiliary = (float*)calloc(totalNumCells, sizeof(float));
+        system->search = (float*)calloc(totalNumCells, sizeof(float));
+        system->product = (float*)calloc(totalNumCells, sizeof(float));
+        ok = ok && system->plusX && system->plusY && system->precon && system->auxiliary && system->search && system->product;
+    }
+
+    if (!ok) {
+        fluid_pressure_system_free(system);
+        printf("ERROR: fluid_pressure_system_create failed to allocate solver arrays\n");
+        return NULL;
+    }
+
+    return system;
+}
+
+void fluid_pressure_system_free(FluidPressureSystem* system) {
+    if (system) {
+        for (int l = 0; l < system->numLevels; ++l) {
+            level_free(&system->levels[l]);
+        }
+        free(system->plusX);
+        free(system->plusY);
+        free(system->precon);
+        free(system->auxiliary);
+        free(system->search);
+        free(system->product);
+        free(system);
+    }
+}
+
+/**
+ * Builds the face weights and right hand side of the fine level.
+ * The matrix matches the SOR solver: a face is open when the cells on both sides are fluid,
+ * and open faces to fluid cells on the border ring act as p = 0 boundaries.
+ */
+static void assemble_fine_level(MultigridLevel* level, const Fluid* fluidPtr) {
+    int numRows = level->rowStride;
+    const float* solidFlags = fluidPtr->solidFlags;
+
+    memset(level->faceX, 0, level->totalNumCells * sizeof(float));
+    memset(level->faceY, 0, level->totalNumCells * sizeof(float));
+    memset(level->diag, 0, level->totalNumCells * sizeof(float));
+    memset(level->rhs, 0, level->totalNumCells * sizeof(float));
+
+    for (int i = 1; i < level->numCellsX; ++i) {
+        for (int j = 1; j < level->numCellsY; ++j) {
+            size_t currentCellIndex = (size_t)i * numRows + j;
+            if (j < level->numCellsY - 1) {
+                level->faceX[currentCellIndex] = solidFlags[currentCellIndex] * solidFlags[currentCellIndex - numRows];
+            }
+            if (i < level->numCellsX - 1) {
+                level->faceY[currentCellIndex] = solidFlags[currentCellIndex] * solidFlags[currentCellIndex - 1];
+            }
+        }
+    }
+
+    int hasFixedBoundary = 0;
+    double rhsSum = 0.0;
+    size_t numUnknowns = 0;
+
+    for (int i = 1; i < level->numCellsX - 1; ++i) {
+        for (int j = 1; j < level->numCellsY - 1; ++j) {
+            size_t currentCellIndex = (size_t)i * numRows + j;
+            if (solidFlags[currentCellIndex] == 0.0f) continue;
+
+            float diag = level->faceX[currentCellIndex] + level->faceX[currentCellIndex + numRows] +
+                         level->faceY[currentCellIndex] + level->faceY[currentCellIndex + 1];
+            if (diag == 0.0f) continue;
+
+            level->diag[currentCellIndex] = diag;
+
+            // net outflow of the cell
+            float divergence = fluidPtr->velocityX[currentCellIndex + numRows] - fluidPtr->velocityX[currentCellIndex] +
+                               fluidPtr->velocityY[currentCellIndex + 1] - fluidPtr->velocityY[currentCellIndex];
+            level->rhs[currentCellIndex] = divergence;
+            rhsSum += divergence;
+            numUnknowns++;
+
+            if ((i == 1 && solidFlags[currentCellIndex - numRows] != 0.0f) ||
+                (i == level->numCellsX - 2 && solidFlags[currentCellIndex + numRows] != 0.0f) ||
+                (j == 1 && solidFlags[currentCellIndex - 1] != 0.0f) ||
+                (j == level->numCellsY - 2 && solidFlags[currentCellIndex + 1] != 0.0f)) {
+                hasFixedBoundary = 1;
+            }
+        }
+    }
+
+    // a closed domain only has a solution when the net outflow is zero
+    if (!hasFixedBoundary && numUnknowns > 0) {
+        float mean = (float)(rhsSum / (double)numUnknowns);
+        for (size_t c = 0; c < level->totalNumCells; ++c) {
+            if (level->diag[c] != 0.0f) level->rhs[c] -= mean;
+        }
+    }
+}
+
+/**
+ * Adds the pressure gradient of the solution to the velocities and accumulates the pressure.
+ */
+static void apply_solution(const MultigridLevel* level, Fluid* fluidPtr) {
+    int numRows = level->rowStride;
+    const float* p = level->solution;
+
+    for (int i = 1; i < level->numCellsX; ++i) {
+        for (int j = 1; j < level->numCellsY; ++j) {
+            size_t currentCellIndex = (size_t)i * numRows + j;
+            fluidPtr->velocityX[currentCellIndex] += level->faceX[currentCellIndex] * (p[currentCellIndex] - p[currentCellIndex - numRows]);
+            fluidPtr->velocityY[currentCellIndex] += level->faceY[currentCellIndex] * (p[currentCellIndex] - p[currentCellIndex - 1]);
+            fluidPtr->pressure[currentCellIndex] += p[currentCellIndex];
+        }
+    }
+}
+
+static void level_multiply(const MultigridLevel* level, const float* x, float* result) {
+    int numRows = level->rowStride;
+
+    for (int i = 1; i < level->numCellsX - 1; ++i) {
+        for (int j = 1; j < level->numCellsY - 1; ++j) {
+            size_t c = (size_t)i * numRows + j;
+            if (level->diag[c] == 0.0f) {
+                result[c] = 0.0f;
+                continue;
+            }
+            result[c] = level->diag[c] * x[c] -
+                        level->faceX[c] * x[c - numRows] - level->faceX[c + numRows] * x[c + numRows] -
+                        level->faceY[c] * x[c - 1] - level->faceY[c + 1] * x[c + 1];
+        }
+    }
+}
+
+static float level_compute_residual(MultigridLevel* level) {
+    level_multiply(level, level->solution, level->residual);
+
+    float maxResidual = 0.0f;
+    for (size_t c = 0; c < level->totalNumCells; ++c) {
+        level->residual[c] = (level->diag[c] != 0.0f) ? level->rhs[c] - level->residual[c] : 0.0f;
+        maxResidual = fmaxf(maxResidual, fabsf(level->residual[c]));
+    }
+    return maxResidual;
+}
+
+static float max_abs(const float* values, size_t count) {
+    float maxValue = 0.0f;
+    for (size_t c = 0; c < count; ++c) {
+        maxValue = fmaxf(maxValue, fabsf(values[c]));
+    }
+    return maxValue;
+}
+
+static float stopping_tolerance(const float* initialResidual, size_t count, float tolerance) {
+    if (tolerance > 0.0f) return tolerance;
+    return max_abs(initialResidual, count) * SOLVER_RELATIVE_TOLERANCE;
+}
+
+static double dot(const float* a, const float* b, size_t count) {
+    double result = 0.0;
+    for (size_t c = 0; c < count; ++c) {
+        result += (double)a[c] * b[c];
+    }
+    return result;
+}
+
+// ------------------------------------------------------------------------------------------
+// MIC(0) preconditioned conjugate gradient
+// ------------------------------------------------------------------------------------------
+
+static void build_mic_preconditioner(FluidPressureSystem* system) {
+    MultigridLevel* level = &system->levels[0];
+    int numRows = level->rowStride;
+
+    memset(system->plusX, 0, level->totalNumCells * sizeof(float));
+    memset(system->plusY, 0, level->totalNumCells * sizeof(float));
+    memset(system->precon, 0, level->totalNumCells * sizeof(float));
+
+    // off-diagonal entries between unknowns only
+    for (int i = 1; i < level->numCellsX - 1; ++i) {
+        for (int j = 1; j < level->numCellsY - 1; ++j) {
+            size_t c = (size_t)i * numRows + j;
+            if (level->diag[c] == 0.0f) continue;
+            if (level->diag[c + numRows] != 0.0f) system->plusX[c] = -level->faceX[c + numRows];
+            if (level->diag[c + 1] != 0.0f) system->plusY[c] = -level->faceY[c + 1];
+        }
+    }
+
+    for (int i = 1; i < level->numCellsX - 1; ++i) {
+        for (int j = 1; j < level->numCellsY - 1; ++j) {
+            size_t c = (size_t)i * numRows + j;
+            float diag = level->diag[c];
+            if (diag == 0.0f) continue;
+
+            size_t left = c - numRows;
+            size_t below = c - 1;
+            float leftTerm = system->plusX[left] * system->precon[left];
+            float belowTerm = system->plusY[below] * system->precon[below];
+
+            float e = diag - leftTerm * leftTerm - belowTerm * belowTerm -
+                      MIC_TUNING * (system->plusX[left] * system->plusY[left] * system->precon[left] * system->precon[left] +
+                                    system->plusY[below] * system->plusX[below] * system->precon[below] * system->precon[below]);
+
+            if (e < MIC_SAFETY * diag) e = diag;
+            system->precon[c] = 1.0f / sqrtf(e);
+        }
+    }
+}
+
+/**
+ * Solves (L L^T) z = r with the incomplete Cholesky factor.
+ */
+static void apply_mic_preconditioner(FluidPressureSystem* system, const float* r, float* z) {
+    MultigridLevel* level = &system->levels[0];
+    int numRows = level->rowStride;
+    float* q = system->product;
+
+    for (int i = 1; i < level->numCellsX - 1; ++i) {
+        for (int j = 1; j < level->numCellsY - 1; ++j) {
+            size_t c = (size_t)i * numRows + j;
+            if (level->diag[c] == 0.0f) {
+                q[c] = 0.0f;
+                continue;
+            }
+            size_t left = c - numRows;
+            size_t below = c - 1;
+            float t = r[c] - system->plusX[left] * system->precon[left] * q[left] -
+                      system->plusY[below] * system->precon[below] * q[below];
+            q[c] = t * system->precon[c];
+        }
+    }
+
+    for (int i = level->numCellsX - 2; i >= 1; --i) {
+        for (int j = level->numCellsY - 2; j >= 1; --j) {
+            size_t c = (size_t)i * numRows + j;
+            if (level->diag[c] == 0.0f) {
+                z[c] = 0.0f;
+                continue;
+            }
+            float t = q[c] - system->plusX[c] * system->precon[c] * z[c + numRows] -
+                      system->plusY[c] * system->precon[c] * z[c + 1];
+            z[c] = t * system->precon[c];
+        }
+    }
+}
+
+static int solve_pcg(FluidPressureSystem* system, int maxIterations, float tolerance) {
+    MultigridLevel* level = &system->levels[0];
+    size_t totalNumCells = level->totalNumCells;
+    float* x = level->solution;
+    float* r = level->residual;
+    float* z = system->auxiliary;
+    float* s = system->search;
+    float* q = system->product;
+
+    memset(x, 0, totalNumCells * sizeof(float));
+    memcpy(r, level->rhs, totalNumCells * sizeof(float));
+
+    float stopTolerance = stopping_tolerance(r, totalNumCells, tolerance);
+    if (max_abs(r, totalNumCells) <= stopTolerance) return 0;
+
+    build_mic_preconditioner(system);
+    apply_mic_preconditioner(system, r, z);
+    memcpy(s, z, totalNumCells * sizeof(float));
+    double sigma = dot(z, r, totalNumCells);
+
+    int iter = 0;
+    while (iter < maxIterations) {
+        ++iter;
+
+        // the preconditioner reuses the product buffer, so multiply after applying it
+        level_multiply(level, s, q);
+        double sq = dot(s, q, totalNumCells);
+        if (sq == 0.0) break;
+        float alpha = (float)(sigma / sq);
+
+        for (size_t c = 0; c < totalNumCells; ++c) {
+            x[c] += alpha * s[c];
+            r[c] -= alpha * q[c];
+        }
+
+        if (max_abs(r, totalNumCells) <= stopTolerance) break;
+
+        apply_mic_preconditioner(system, r, z);
+        double sigmaNew = dot(z, r, totalNumCells);
+        float beta = (float)(sigmaNew / sigma);
+        for (size_t c = 0; c < totalNumCells; ++c) {
+            s[c] = z[c] + beta * s[c];
+        }
+        sigma = sigmaNew;
+    }
+
+    return iter;
+}
+
+// ------------------------------------------------------------------------------------------
+// Geometric multigrid V-cycle
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Returns the index of the fine cell that starts the children of coarse index coarse,
+ * clamped to the fine border for the coarse border.
+ */
+static inline int fine_index(int coarse, int fineInterior) {
+    int fine = 2 * coarse - 1;
+    if (coarse == 0) return 0;
+    return fine < fineInterior + 1 ? fine : fineInterior + 1;
+}
+
+static void coarsen_level(const MultigridLevel* fine, MultigridLevel* coarse) {
+    int fineRows = fine->rowStride;
+    int coarseRows = coarse->rowStride;
+    int fineInteriorX = fine->numCellsX - 2;
+    int fineInteriorY = fine->numCellsY - 2;
+
+    memset(coarse->faceX, 0, coarse->totalNumCells * sizeof(float));
+    memset(coarse->faceY, 0, coarse->totalNumCells * sizeof(float));
+    memset(coarse->diag, 0, coarse->totalNumCells * sizeof(float));
+
+    // a coarse face averages the two fine faces it covers
+    for (int ci = 1; ci < coarse->numCellsX; ++ci) {
+        for (int cj = 1; cj < coarse->numCellsY; ++cj) {
+            size_t c = (size_t)ci * coarseRows + cj;
+            int fi = fine_index(ci, fineInteriorX);
+            int fj = fine_index(cj, fineInteriorY);
+
+            if (cj < coarse->numCellsY - 1) {
+                float sum = fine->faceX[(size_t)fi * fineRows + fj];
+                if (fj + 1 <= fineInteriorY) sum += fine->faceX[(size_t)fi * fineRows + fj + 1];
+                coarse->faceX[c] = 0.5f * sum;
+            }
+            if (ci < coarse->numCellsX - 1) {
+                float sum = fine->faceY[(size_t)fi * fineRows + fj];
+                if (fi + 1 <= fineInteriorX) sum += fine->faceY[(size_t)(fi + 1) * fineRows + fj];
+                coarse->faceY[c] = 0.5f * sum;
+            }
+        }
+    }
+
+    for (int ci = 1; ci < coarse->numCellsX - 1; ++ci) {
+        for (int cj = 1; cj < coarse->numCellsY - 1; ++cj) {
+            size_t c = (size_t)ci * coarseRows + cj;
+            int fi = 2 * ci - 1;
+            int fj = 2 * cj - 1;
+
+            // the coarse cell is an unknown when any of its children is
+            int hasUnknown = 0;
+            for (int di = 0; di < 2 && fi + di <= fineInteriorX; ++di) {
+                for (int dj = 0; dj < 2 && fj + dj <= fineInteriorY; ++dj) {
+                    if (fine->diag[(size_t)(fi + di) * fineRows + fj + dj] != 0.0f) hasUnknown = 1;
+                }
+            }
+            if (!hasUnknown) continue;
+
+            coarse->diag[c] = coarse->faceX[c] + coarse->faceX[c + coarseRows] + coarse->faceY[c] + coarse->faceY[c + 1];
+        }
+    }
+}
+
+static void level_smooth(MultigridLevel* level, int numSweeps) {
+    int numRows = level->rowStride;
+    float* x = level->solution;
+
+    for (int sweep = 0; sweep < numSweeps; ++sweep) {
+        for (int color = 0; color < 2; ++color) {
+            for (int i = 1; i < level->numCellsX - 1; ++i) {
+                for (int j = 1 + ((i + 1 + color) & 1); j < level->numCellsY - 1; j += 2) {
+                    size_t c = (size_t)i * numRows + j;
+                    if (level->diag[c] == 0.0f) continue;
+
+                    float neighbors = level->faceX[c] * x[c - numRows] + level->faceX[c + numRows] * x[c + numRows] +
+                                      level->faceY[c] * x[c - 1] + level->faceY[c + 1] * x[c + 1];
+                    x[c] = (level->rhs[c] + neighbors) / level->diag[c];
+                }
+            }
+        }
+    }
+}
+
+static void restrict_residual(const MultigridLevel* fine, MultigridLevel* coarse) {
+    int fineRows = fine->rowStride;
+    int coarseRows = coarse->rowStride;
+    int fineInteriorX = fine->numCellsX - 2;
+    int fineInteriorY = fine->numCellsY - 2;
+
+    memset(coarse->rhs, 0, coarse->totalNumCells * sizeof(float));
+    memset(coarse->solution, 0, coarse->totalNumCells * sizeof(float));
+
+    for (int ci = 1; ci < coarse->numCellsX - 1; ++ci) {
+        for (int cj = 1; cj < coarse->numCellsY - 1; ++cj) {
+            size_t c = (size_t)ci * coarseRows + cj;
+            if (coarse->diag[c] == 0.0f) continue;
+
+            float sum = 0.0f;
+            for (int fi = 2 * ci - 1; fi <= 2 * ci && fi <= fineInteriorX; ++fi) {
+                for (int fj = 2 * cj - 1; fj <= 2 * cj && fj <= fineInteriorY; ++fj) {
+                    sum += fine->residual[(size_t)fi * fineRows + fj];
+                }
+            }
+            coarse->rhs[c] = sum;
+        }
+    }
+}
+
+static void prolong_correction(const MultigridLevel* coarse, MultigridLevel* fine) {
+    int fineRows = fine->rowStride;
+    int coarseRows = coarse->rowStride;
+
+    for (int i = 1; i < fine->numCellsX - 1; ++i) {
+        for (int j = 1; j < fine->numCellsY - 1; ++j) {
+            size_t c = (size_t)i * fineRows + j;
+            if (fine->diag[c] == 0.0f) continue;
+            fine->solution[c] += coarse->solution[(size_t)((i + 1) / 2) * coarseRows + (j + 1) / 2];
+        }
+    }
+}
+
+static void v_cycle(FluidPressureSystem* system, int levelIndex) {
+    MultigridLevel* level = &system->levels[levelIndex];
+
+    if (levelIndex == system->numLevels - 1) {
+        level_smooth(level, MULTIGRID_COARSE_SWEEPS);
+        return;
+    }
+
+    MultigridLevel* coarse = &system->levels[levelIndex + 1];
+
+    level_smooth(level, MULTIGRID_SMOOTHING_SWEEPS);
+    level_compute_residual(level);
+    restrict_residual(level, coarse);
+    v_cycle(system, levelIndex + 1);
+    prolong_correction(coarse, level);
+    level_smooth(level, MULTIGRID_SMOOTHING_SWEEPS);
+}
+
+static int solve_multigrid(FluidPressureSystem* system, int maxIterations, float tolerance) {
+    MultigridLevel* level = &system->levels[0];
+
+    memset(level->solution, 0, level->totalNumCells * sizeof(float));
+
+    float stopTolerance = stopping_tolerance(level->rhs, level->totalNumCells, tolerance);
+    memcpy(level->residual, level->rhs, level->totalNumCells * sizeof(float));
+    if (max_abs(level->rhs, level->totalNumCells) <= stopTolerance) return 0;
+
+    for (int l = 1; l < system->numLevels; ++l) {
+        coarsen_level(&system->levels[l - 1], &system->levels[l]);
+    }
+
+    int cycle = 0;
+    while (cycle < maxIterations) {
+        ++cycle;
+        v_cycle(system, 0);
+        if (level_compute_residual(level) <= stopTolerance) break;
+    }
+
+    return cycle;
+}
+
+int fluid_pressure_system_solve(FluidPressureSystem* system, Fluid* fluidPtr, int maxIterations, float tolerance,
+                                float* residualMax, float* residualL2) {
+    MultigridLevel* level = &system->levels[0];
+
+    assemble_fine_level(level, fluidPtr);
+
+    int iterations;
+    if (system->solverType == PRESSURE_SOLVER_MULTIGRID) {
+        iterations = solve_multigrid(system, maxIterations, tolerance);
+    } else {
+        iterations = solve_pcg(system, maxIterations, tolerance);
+    }
+
+    // both solvers leave the final residual in the fine level
+    *residualMax = max_abs(level->residual, level->totalNumCells);
+    *residualL2 = (float)sqrt(dot(level->residual, level->residual, level->totalNumCells));
+
+    apply_solution(level, fluidPtr);
+    return iterations;
+}
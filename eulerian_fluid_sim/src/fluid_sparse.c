@@ -0,0 +1,581 @@
+#include "fluid_sparse.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define TILE_MASK (FLUID_SPARSE_TILE_SIZE - 1)
+
+// sides of FluidSparseTile.neighbors, side ^ 1 is the opposite side
+enum { NEIGHBOR_LEFT, NEIGHBOR_RIGHT, NEIGHBOR_BOTTOM, NEIGHBOR_TOP };
+
+
+static inline FluidSparseTile* table_tile(const FluidSparse* sparse, int tileX, int tileY) {
+    if (tileX < 0 || tileX >= sparse->numTilesX || tileY < 0 || tileY >= sparse->numTilesY) return NULL;
+    return sparse->tileTable[(size_t)tileX * sparse->numTilesY + tileY];
+}
+
+static inline int cell_offset(int i, int j) {
+    return ((i & TILE_MASK) << FLUID_SPARSE_TILE_SHIFT) + (j & TILE_MASK);
+}
+
+/**
+ * Value of any cell of the domain, 0 for cells outside the allocated tiles.
+ */
+static inline float cell_value(const FluidSparse* sparse, int field, int i, int j) {
+    if (i < 0 || j < 0) return 0.0f;
+    const FluidSparseTile* tile = table_tile(sparse, i >> FLUID_SPARSE_TILE_SHIFT, j >> FLUID_SPARSE_TILE_SHIFT);
+    return tile ? tile->fields[field][cell_offset(i, j)] : 0.0f;
+}
+
+// ------------------------------------------------------------------------------------------
+// Tile pool
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Points the tile and its four neighbors at each other, or unlinks the tile when linked is 0.
+ */
+static void link_neighbors(FluidSparse* sparse, FluidSparseTile* tile, int linked) {
+    static const int offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+    for (int side = 0; side < 4; ++side) {
+        FluidSparseTile* neighbor = table_tile(sparse, tile->tileX + offsets[side][0], tile->tileY + offsets[side][1]);
+        tile->neighbors[side] = linked ? neighbor : NULL;
+        if (neighbor) neighbor->neighbors[side ^ 1] = linked ? tile : NULL;
+    }
+}
+
+/**
+ * Takes a tile from the pool, filling the pool with a new chunk when it is empty.
+ */
+static FluidSparseTile* pool_take(FluidSparse* sparse) {
+    if (sparse->freeTiles == NULL) {
+        if (sparse->numChunks == sparse->chunkCapacity) {
+            int capacity = sparse->chunkCapacity > 0 ? sparse->chunkCapacity * 2 : 16;
+            FluidSparseTile** chunks = (FluidSparseTile**)realloc(sparse->chunks, (size_t)capacity * sizeof(FluidSparseTile*));
+            if (chunks == NULL) return NULL;
+            sparse->chunks = chunks;
+            sparse->chunkCapacity = capacity;
+        }
+
+        FluidSparseTile* chunk = (FluidSparseTile*)calloc(FLUID_SPARSE_TILES_PER_CHUNK, sizeof(FluidSparseTile));
+        if (chunk == NULL) return NULL;
+        sparse->chunks[sparse->numChunks++] = chunk;
+
+        for (int k = FLUID_SPARSE_TILES_PER_CHUNK - 1; k >= 0; --k) {
+            chunk[k].nextFree = sparse->freeTiles;
+            sparse->freeTiles = &chunk[k];
+        }
+    }
+
+    FluidSparseTile* tile = sparse->freeTiles;
+    sparse->freeTiles = tile->nextFree;
+    return tile;
+}
+
+/**
+ * Returns the tile at the given tile coordinates, allocating a zeroed one when there is none.
+ * Returns NULL when maxTiles is reached or memory runs out.
+ */
+static FluidSparseTile* allocate_tile(FluidSparse* sparse, int tileX, int tileY) {
+    size_t tableIndex = (size_t)tileX * sparse->numTilesY + tileY;
+    if (sparse->tileTable[tableIndex]) return sparse->tileTable[tableIndex];
+
+    if (sparse->numTiles == sparse->tileCapacity) {
+        int capacity = sparse->tileCapacity > 0 ? sparse->tileCapacity * 2 : FLUID_SPARSE_TILES_PER_CHUNK;
+        FluidSparseTile** tiles = (FluidSparseTile**)realloc(sparse->tiles, (size_t)capacity * sizeof(FluidSparseTile*));
+        if (tiles == NULL) return NULL;
+        sparse->tiles = tiles;
+        sparse->tileCapacity = capacity;
+    }
+
+    FluidSparseTile* tile = sparse->numTiles < sparse->maxTiles ? pool_take(sparse) : NULL;
+    if (tile == NULL) {
+        if (!sparse->poolExhausted) printf("ERROR: fluid_sparse ran out of tiles, the plume is clipped\n");
+        sparse->poolExhausted = 1;
+        return NULL;
+    }
+
+    memset(tile->storage, 0, sizeof(tile->storage));
+    for (int field = 0; field < SPARSE_NUM_FIELDS; ++field) {
+        tile->fields[field] = tile->storage + field * FLUID_SPARSE_TILE_CELLS;
+    }
+    tile->tileX = tileX;
+    tile->tileY = tileY;
+    tile->occupied = 0;
+    tile->residualMax = 0.0f;
+    tile->nextFree = NULL;
+
+    tile->listIndex = sparse->numTiles;
+    sparse->tiles[sparse->numTiles++] = tile;
+    sparse->tileTable[tableIndex] = tile;
+    link_neighbors(sparse, tile, 1);
+    return tile;
+}
+
+/**
+ * Returns a tile to the pool.
+ */
+static void release_tile(FluidSparse* sparse, FluidSparseTile* tile) {
+    sparse->tileTable[(size_t)tile->tileX * sparse->numTilesY + tile->tileY] = NULL;
+    link_neighbors(sparse, tile, 0);
+
+    FluidSparseTile* last = sparse->tiles[--sparse->numTiles];
+    sparse->tiles[tile->listIndex] = last;
+    last->listIndex = tile->listIndex;
+
+    tile->nextFree = sparse->freeTiles;
+    sparse->freeTiles = tile;
+}
+
+FluidSparse* fluid_sparse_create(int numX, int numY, float cellSize, int maxTiles, float activityThreshold) {
+
+    if (numX <= 0 || numY <= 0) {
+        printf("ERROR: fluid_sparse_create needs a positive domain size\n");
+        return NULL;
+    }
+
+    FluidSparse* sparse = (FluidSparse*)calloc(1, sizeof(FluidSparse));
+    if (sparse == NULL) {
+        printf("ERROR: fluid_sparse_create failed to allocate sparse grid\n");
+        return NULL;
+    }
+
+    // round the domain up to whole tiles
+    sparse->numTilesX = (numX + FLUID_SPARSE_TILE_SIZE - 1) >> FLUID_SPARSE_TILE_SHIFT;
+    sparse->numTilesY = (numY + FLUID_SPARSE_TILE_SIZE - 1) >> FLUID_SPARSE_TILE_SHIFT;
+    sparse->numCellsX = sparse->numTilesX << FLUID_SPARSE_TILE_SHIFT;
+    sparse->numCellsY = sparse->numTilesY << FLUID_SPARSE_TILE_SHIFT;
+    sparse->cellSize = cellSize;
+    sparse->activityThreshold = activityThreshold;
+
+    size_t numTableEntries = (size_t)sparse->numTilesX * sparse->numTilesY;
+    sparse->maxTiles = (maxTiles <= 0 || (size_t)maxTiles > numTableEntries) ? (int)numTableEntries : maxTiles;
+
+    sparse->tileTable = (FluidSparseTile**)calloc(numTableEntries, sizeof(FluidSparseTile*));
+    if (sparse->tileTable == NULL) {
+        fluid_sparse_free(sparse);
+        printf("ERROR: fluid_sparse_create failed to allocate tile table\n");
+        return NULL;
+    }
+
+    return sparse;
+}
+
+void fluid_sparse_free(FluidSparse* sparse) {
+    if (sparse) {
+        for (int chunk = 0; chunk < sparse->numChunks; ++chunk) {
+            free(sparse->chunks[chunk]);
+        }
+        free(sparse->chunks);
+        free(sparse->tiles);
+        free(sparse->tileTable);
+        fluid_pool_free(sparse->workerPool);
+        free(sparse);
+    }
+}
+
+void fluid_sparse_set_num_threads(FluidSparse* sparse, int numThreads) {
+
+    fluid_pool_free(sparse->workerPool);
+    sparse->workerPool = NULL;
+
+    // a single thread runs the passes inline
+    if (numThreads > 1) {
+        sparse->workerPool = fluid_pool_create(numThreads);
+    }
+}
+
+size_t fluid_sparse_memory_bytes(const FluidSparse* sparse) {
+    return sizeof(FluidSparse) +
+           (size_t)sparse->numTilesX * sparse->numTilesY * sizeof(FluidSparseTile*) +
+           (size_t)sparse->tileCapacity * sizeof(FluidSparseTile*) +
+           (size_t)sparse->chunkCapacity * sizeof(FluidSparseTile*) +
+           (size_t)sparse->numChunks * FLUID_SPARSE_TILES_PER_CHUNK * sizeof(FluidSparseTile);
+}
+
+// ------------------------------------------------------------------------------------------
+// Cell access
+// ------------------------------------------------------------------------------------------
+
+static FluidSparseTile* clamped_cell_tile(FluidSparse* sparse, int* x, int* y) {
+    *x = *x < 0 ? 0 : (*x >= sparse->numCellsX ? sparse->numCellsX - 1 : *x);
+    *y = *y < 0 ? 0 : (*y >= sparse->numCellsY ? sparse->numCellsY - 1 : *y);
+    return allocate_tile(sparse, *x >> FLUID_SPARSE_TILE_SHIFT, *y >> FLUID_SPARSE_TILE_SHIFT);
+}
+
+void fluid_sparse_add_smoke(FluidSparse* sparse, int x, int y, float amount) {
+    FluidSparseTile* tile = clamped_cell_tile(sparse, &x, &y);
+    if (tile == NULL) return;
+
+    float* smoke = &tile->fields[SPARSE_SMOKE][cell_offset(x, y)];
+    *smoke = fminf(*smoke + amount, 1.0f);
+}
+
+void fluid_sparse_add_velocity(FluidSparse* sparse, int x, int y, float velocityX, float velocityY) {
+    FluidSparseTile* tile = clamped_cell_tile(sparse, &x, &y);
+    if (tile == NULL) return;
+
+    tile->fields[SPARSE_VELOCITY_X][cell_offset(x, y)] += velocityX;
+    tile->fields[SPARSE_VELOCITY_Y][cell_offset(x, y)] += velocityY;
+}
+
+float fluid_sparse_value(const FluidSparse* sparse, FluidSparseField field, int x, int y) {
+    if (field < 0 || field >= SPARSE_NUM_FIELDS) return 0.0f;
+    return cell_value(sparse, field, x, y);
+}
+
+/**
+ * Bilinear sample of a field at a world position, like the dense sampler. Missing tiles read as 0.
+ * The field value of cell (i, j) lives at ((i + offsetX) * cellSize, (j + offsetY) * cellSize).
+ */
+static float sample(const FluidSparse* sparse, int field, float xPos, float yPos, float offsetX, float offsetY) {
+    float invCellSize = 1.0f / sparse->cellSize;
+    float gridX = fminf(fmaxf(xPos * invCellSize - offsetX, 0.0f), (float)(sparse->numCellsX - 1));
+    float gridY = fminf(fmaxf(yPos * invCellSize - offsetY, 0.0f), (float)(sparse->numCellsY - 1));
+
+    int i = (int)gridX;
+    int j = (int)gridY;
+    i = i < sparse->numCellsX - 2 ? i : sparse->numCellsX - 2;
+    j = j < sparse->numCellsY - 2 ? j : sparse->numCellsY - 2;
+
+    float fx = gridX - (float)i;
+    float fy = gridY - (float)j;
+
+    float val00, val01, val10, val11;
+    if ((i & TILE_MASK) != TILE_MASK && (j & TILE_MASK) != TILE_MASK) {
+        // all four corners are in one tile
+        const FluidSparseTile* tile = table_tile(sparse, i >> FLUID_SPARSE_TILE_SHIFT, j >> FLUID_SPARSE_TILE_SHIFT);
+        if (tile == NULL) return 0.0f;
+
+        const float* corner = tile->fields[field] + cell_offset(i, j);
+        val00 = corner[0];
+        val01 = corner[1];
+        val10 = corner[FLUID_SPARSE_TILE_SIZE];
+        val11 = corner[FLUID_SPARSE_TILE_SIZE + 1];
+    } else {
+        val00 = cell_value(sparse, field, i, j);
+        val01 = cell_value(sparse, field, i, j + 1);
+        val10 = cell_value(sparse, field, i + 1, j);
+        val11 = cell_value(sparse, field, i + 1, j + 1);
+    }
+
+    // bilinear interpolation
+    return (val00 * (1 - fx) * (1 - fy)) +
+           (val10 * fx * (1 - fy)) +
+           (val01 * (1 - fx) * fy) +
+           (val11 * fx * fy);
+}
+
+// ------------------------------------------------------------------------------------------
+// Passes, each split across the worker pool by tile
+// ------------------------------------------------------------------------------------------
+
+/**
+ * Data shared by the workers of one pass over the tile list.
+ */
+typedef struct {
+    FluidSparse* sparse;
+    float deltaTime;
+    float overRelaxation;
+    float dissipation;
+    float smokeDissipation;
+    int color;
+} SparsePass;
+
+static void dissipate_task(void* taskData, int rangeStart, int rangeEnd) {
+    SparsePass* pass = (SparsePass*)taskData;
+
+    for (int t = rangeStart; t < rangeEnd; ++t) {
+        FluidSparseTile* tile = pass->sparse->tiles[t];
+        float* velocityX = tile->fields[SPARSE_VELOCITY_X];
+        float* velocityY = tile->fields[SPARSE_VELOCITY_Y];
+        float* smoke = tile->fields[SPARSE_SMOKE];
+
+        for (int k = 0; k < FLUID_SPARSE_TILE_CELLS; ++k) {
+            velocityX[k] *= pass->dissipation;
+            velocityY[k] *= pass->dissipation;
+            smoke[k] *= pass->smokeDissipation;
+        }
+    }
+}
+
+/**
+ * Relaxes a cell on the edge of its tile, whose faces and neighbors may be in the next tile or missing.
+ * Returns the divergence of the cell before the update.
+ */
+static float relax_edge_cell(FluidSparseTile* tile, int x, int y, float overRelaxation) {
+    FluidSparseTile* right = tile->neighbors[NEIGHBOR_RIGHT];
+    FluidSparseTile* top = tile->neighbors[NEIGHBOR_TOP];
+    int isLastColumn = x == FLUID_SPARSE_TILE_SIZE - 1;
+    int isLastRow = y == FLUID_SPARSE_TILE_SIZE - 1;
+    int k = (x << FLUID_SPARSE_TILE_SHIFT) + y;
+
+    // neighbors inside the tile always exist, the ones across its edge when that tile is allocated
+    float sx0 = x > 0 || tile->neighbors[NEIGHBOR_LEFT] ? 1.0f : 0.0f;
+    float sx1 = !isLastColumn || right ? 1.0f : 0.0f;
+    float sy0 = y > 0 || tile->neighbors[NEIGHBOR_BOTTOM] ? 1.0f : 0.0f;
+    float sy1 = !isLastRow || top ? 1.0f : 0.0f;
+    float s = sx0 + sx1 + sy0 + sy1;
+
+    float* velocityX = tile->fields[SPARSE_VELOCITY_X];
+    float* velocityY = tile->fields[SPARSE_VELOCITY_Y];
+    float* rightFace = isLastColumn ? (right ? &right->fields[SPARSE_VELOCITY_X][y] : NULL) : &velocityX[k + FLUID_SPARSE_TILE_SIZE];
+    float* topFace = isLastRow ? (top ? &top->fields[SPARSE_VELOCITY_Y][x << FLUID_SPARSE_TILE_SHIFT] : NULL) : &velocityY[k + 1];
+
+    float divergence = (rightFace ? *rightFace : 0.0f) - velocityX[k] + (topFace ? *topFace : 0.0f) - velocityY[k];
+    float dp = -divergence / s * overRelaxation;
+    velocityX[k] -= sx0 * dp;
+    velocityY[k] -= sy0 * dp;
+    if (rightFace) *rightFace += dp;
+    if (topFace) *topFace += dp;
+    return divergence;
+}
+
+/**
+ * One red-black half-sweep: relaxes the cells with (i + j) & 1 == color. Cells of one color share no faces,
+ * so tiles can be relaxed in parallel even though edge cells push into the faces of the next tile.
+ */
+static void relax_task(void* taskData, int rangeStart, int rangeEnd) {
+    SparsePass* pass = (SparsePass*)taskData;
+    float omega = pass->overRelaxation;
+    float interiorScale = 0.25f * omega;
+
+    for (int t = rangeStart; t < rangeEnd; ++t) {
+        FluidSparseTile* tile = pass->sparse->tiles[t];
+        float* velocityX = tile->fields[SPARSE_VELOCITY_X];
+        float* velocityY = tile->fields[SPARSE_VELOCITY_Y];
+        float residualMax = 0.0f;
+
+        // tiles start at even cells, so the color pattern is the same in every tile
+        for (int x = 0; x < FLUID_SPARSE_TILE_SIZE; ++x) {
+            int firstY = (pass->color + x) & 1;
+
+            if (x == 0 || x == FLUID_SPARSE_TILE_SIZE - 1) {
+                for (int y = firstY; y < FLUID_SPARSE_TILE_SIZE; y += 2) {
+                    residualMax = fmaxf(residualMax, fabsf(relax_edge_cell(tile, x, y, omega)));
+                }
+                continue;
+            }
+
+            if (firstY == 0) residualMax = fmaxf(residualMax, fabsf(relax_edge_cell(tile, x, 0, omega)));
+
+            // all four faces and neighbors of the inner cells are in the tile
+            for (int y = firstY == 0 ? 2 : 1; y < FLUID_SPARSE_TILE_SIZE - 1; y += 2) {
+                int k = (x << FLUID_SPARSE_TILE_SHIFT) + y;
+                float divergence = velocityX[k + FLUID_SPARSE_TILE_SIZE] - velocityX[k] + velocityY[k + 1] - velocityY[k];
+                residualMax = fmaxf(residualMax, fabsf(divergence));
+
+                float dp = -divergence * interiorScale;
+                velocityX[k] -= dp;
+                velocityX[k + FLUID_SPARSE_TILE_SIZE] += dp;
+                velocityY[k] -= dp;
+                velocityY[k + 1] += dp;
+            }
+
+            if (firstY == 1) residualMax = fmaxf(residualMax, fabsf(relax_edge_cell(tile, x, FLUID_SPARSE_TILE_SIZE - 1, omega)));
+        }
+        tile->residualMax = residualMax;
+    }
+}
+
+// zeroes the faces on the edge of the allocated region, which are walls
+static void close_walls_task(void* taskData, int rangeStart, int rangeEnd) {
+    SparsePass* pass = (SparsePass*)taskData;
+
+    for (int t = rangeStart; t < rangeEnd; ++t) {
+        FluidSparseTile* tile = pass->sparse->tiles[t];
+        if (tile->neighbors[NEIGHBOR_LEFT] == NULL) {
+            memset(tile->fields[SPARSE_VELOCITY_X], 0, FLUID_SPARSE_TILE_SIZE * sizeof(float));
+        }
+        if (tile->neighbors[NEIGHBOR_BOTTOM] == NULL) {
+            for (int x = 0; x < FLUID_SPARSE_TILE_SIZE; ++x) {
+                tile->fields[SPARSE_VELOCITY_Y][x << FLUID_SPARSE_TILE_SHIFT] = 0.0f;
+            }
+        }
+    }
+}
+
+static void find_occupied_task(void* taskData, int rangeStart, int rangeEnd) {
+    SparsePass* pass = (SparsePass*)taskData;
+    float threshold = pass->sparse->activityThreshold;
+
+    for (int t = rangeStart; t < rangeEnd; ++t) {
+        FluidSparseTile* tile = pass->sparse->tiles[t];
+        const float* velocityX = tile->fields[SPARSE_VELOCITY_X];
+        const float* velocityY = tile->fields[SPARSE_VELOCITY_Y];
+        const float* smoke = tile->fields[SPARSE_SMOKE];
+
+        float maxValue = 0.0f;
+        for (int k = 0; k < FLUID_SPARSE_TILE_CELLS; ++k) {
+            maxValue = fmaxf(maxValue, fmaxf(fabsf(smoke[k]), fmaxf(fabsf(velocityX[k]), fabsf(velocityY[k]))));
+        }
+        tile->occupied = maxValue > threshold;
+    }
+}
+
+static int has_occupied_neighbor(const FluidSparse* sparse, const FluidSparseTile* tile) {
+    for (int x = tile->tileX - 1; x <= tile->tileX + 1; ++x) {
+        for (int y = tile->tileY - 1; y <= tile->tileY + 1; ++y) {
+            const FluidSparseTile* neighbor = table_tile(sparse, x, y);
+            if (neighbor && neighbor->occupied) return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Allocates the ring of tiles around every occupied tile and releases tiles that are neither occupied
+ * nor next to an occupied tile. Whatever those held is below the threshold and is dropped.
+ */
+static void update_tiles(FluidSparse* sparse, SparsePass* pass) {
+    fluid_pool_run(sparse->workerPool, find_occupied_task, pass, 0, sparse->numTiles);
+
+    // new tiles are appended unoccupied, so only the tiles that were there are grown
+    int numScannedTiles = sparse->numTiles;
+    for (int t = 0; t < numScannedTiles; ++t) {
+        FluidSparseTile* tile = sparse->tiles[t];
+        if (!tile->occupied) continue;
+
+        for (int x = tile->tileX - 1; x <= tile->tileX + 1; ++x) {
+            for (int y = tile->tileY - 1; y <= tile->tileY + 1; ++y) {
+                if (x >= 0 && x < sparse->numTilesX && y >= 0 && y < sparse->numTilesY) allocate_tile(sparse, x, y);
+            }
+        }
+    }
+
+    // releasing moves the last tile into the freed slot, which was visited already
+    for (int t = sparse->numTiles - 1; t >= 0; --t) {
+        FluidSparseTile* tile = sparse->tiles[t];
+        if (!has_occupied_neighbor(sparse, tile)) release_tile(sparse, tile);
+    }
+}
+
+static void advect_velocity_task(void* taskData, int rangeStart, int rangeEnd) {
+    SparsePass* pass = (SparsePass*)taskData;
+    const FluidSparse* sparse = pass->sparse;
+    float deltaTime = pass->deltaTime;
+    float cellSize = sparse->cellSize;
+    float halfCellSize = cellSize * 0.5f;
+
+    for (int t = rangeStart; t < rangeEnd; ++t) {
+        FluidSparseTile* tile = sparse->tiles[t];
+        const float* velocityX = tile->fields[SPARSE_VELOCITY_X];
+        const float* velocityY = tile->fields[SPARSE_VELOCITY_Y];
+        float* newVelocityX = tile->fields[SPARSE_NEW_VELOCITY_X];
+        float* newVelocityY = tile->fields[SPARSE_NEW_VELOCITY_Y];
+
+        for (int x = 0; x < FLUID_SPARSE_TILE_SIZE; ++x) {
+            int i = (tile->tileX << FLUID_SPARSE_TILE_SHIFT) + x;
+            int hasLeft = x > 0 || tile->neighbors[NEIGHBOR_LEFT] != NULL;
+
+            for (int y = 0; y < FLUID_SPARSE_TILE_SIZE; ++y) {
+                int j = (tile->tileY << FLUID_SPARSE_TILE_SHIFT) + y;
+                int hasBottom = y > 0 || tile->neighbors[NEIGHBOR_BOTTOM] != NULL;
+                int k = (x << FLUID_SPARSE_TILE_SHIFT) + y;
+
+                // faces on a wall stay at rest
+                newVelocityX[k] = 0.0f;
+                newVelocityY[k] = 0.0f;
+
+                if (hasLeft) {
+                    float uAtX = velocityX[k];
+                    float vAtX = 0.25f * (cell_value(sparse, SPARSE_VELOCITY_Y, i - 1, j) + velocityY[k] +
+                                          cell_value(sparse, SPARSE_VELOCITY_Y, i - 1, j + 1) + cell_value(sparse, SPARSE_VELOCITY_Y, i, j + 1));
+                    float xCurrent = (float)i * cellSize;
+                    float yCurrent = (float)j * cellSize + halfCellSize;
+                    newVelocityX[k] = sample(sparse, SPARSE_VELOCITY_X, xCurrent - deltaTime * uAtX, yCurrent - deltaTime * vAtX, 0.0f, 0.5f);
+                }
+
+                if (hasBottom) {
+                    float uAtY = 0.25f * (cell_value(sparse, SPARSE_VELOCITY_X, i, j - 1) + velocityX[k] +
+                                          cell_value(sparse, SPARSE_VELOCITY_X, i + 1, j - 1) + cell_value(sparse, SPARSE_VELOCITY_X, i + 1, j));
+                    float vAtY = velocityY[k];
+                    float xCurrent = (float)i * cellSize + halfCellSize;
+                    float yCurrent = (float)j * cellSize;
+                    newVelocityY[k] = sample(sparse, SPARSE_VELOCITY_Y, xCurrent - deltaTime * uAtY, yCurrent - deltaTime * vAtY, 0.5f, 0.0f);
+                }
+            }
+        }
+    }
+}
+
+static void advect_smoke_task(void* taskData, int rangeStart, int rangeEnd) {
+    SparsePass* pass = (SparsePass*)taskData;
+    const FluidSparse* sparse = pass->sparse;
+    float deltaTime = pass->deltaTime;
+    float cellSize = sparse->cellSize;
+    float halfCellSize = cellSize * 0.5f;
+
+    for (int t = rangeStart; t < rangeEnd; ++t) {
+        FluidSparseTile* tile = sparse->tiles[t];
+        const float* velocityX = tile->fields[SPARSE_VELOCITY_X];
+        const float* velocityY = tile->fields[SPARSE_VELOCITY_Y];
+        float* newSmoke = tile->fields[SPARSE_NEW_SMOKE];
+
+        for (int x = 0; x < FLUID_SPARSE_TILE_SIZE; ++x) {
+            int i = (tile->tileX << FLUID_SPARSE_TILE_SHIFT) + x;
+
+            for (int y = 0; y < FLUID_SPARSE_TILE_SIZE; ++y) {
+                int j = (tile->tileY << FLUID_SPARSE_TILE_SHIFT) + y;
+                int k = (x << FLUID_SPARSE_TILE_SHIFT) + y;
+
+                // cell center coordinates and the velocity there (average of the cell's faces)
+                float xCurrent = (float)i * cellSize + halfCellSize;
+                float yCurrent = (float)j * cellSize + halfCellSize;
+                float uAvg = 0.5f * (velocityX[k] + cell_value(sparse, SPARSE_VELOCITY_X, i + 1, j));
+                float vAvg = 0.5f * (velocityY[k] + cell_value(sparse, SPARSE_VELOCITY_Y, i, j + 1));
+
+                newSmoke[k] = sample(sparse, SPARSE_SMOKE, xCurrent - deltaTime * uAvg, yCurrent - deltaTime * vAvg, 0.5f, 0.5f);
+            }
+        }
+    }
+}
+
+static void swap_tile_fields(FluidSparse* sparse, int front, int back) {
+    for (int t = 0; t < sparse->numTiles; ++t) {
+        FluidSparseTile* tile = sparse->tiles[t];
+        float* temp = tile->fields[front];
+        tile->fields[front] = tile->fields[back];
+        tile->fields[back] = temp;
+    }
+}
+
+void fluid_sparse_simulate_step(FluidSparse* sparse, int numIterations, float deltaTime, float overRelaxation,
+                                float dissipation, float smokeDissipation) {
+    SparsePass pass;
+    pass.sparse = sparse;
+    pass.deltaTime = deltaTime;
+    pass.overRelaxation = overRelaxation;
+    pass.dissipation = dissipation;
+    pass.smokeDissipation = smokeDissipation;
+    pass.color = 0;
+
+    fluid_pool_run(sparse->workerPool, dissipate_task, &pass, 0, sparse->numTiles);
+
+    float residualMax = 0.0f;
+    for (int iter = 0; iter < numIterations; ++iter) {
+        residualMax = 0.0f;
+        for (int color = 0; color < 2; ++color) {
+            pass.color = color;
+            fluid_pool_run(sparse->workerPool, relax_task, &pass, 0, sparse->numTiles);
+            for (int t = 0; t < sparse->numTiles; ++t) {
+                residualMax = fmaxf(residualMax, sparse->tiles[t]->residualMax);
+            }
+        }
+    }
+    sparse->lastSolverIterations = numIterations;
+    sparse->lastResidualMax = residualMax;
+
+    fluid_pool_run(sparse->workerPool, close_walls_task, &pass, 0, sparse->numTiles);
+
+    // grow and shrink the allocated region before advection reads across tile edges
+    update_tiles(sparse, &pass);
+
+    fluid_pool_run(sparse->workerPool, advect_velocity_task, &pass, 0, sparse->numTiles);
+    swap_tile_fields(sparse, SPARSE_VELOCITY_X, SPARSE_NEW_VELOCITY_X);
+    swap_tile_fields(sparse, SPARSE_VELOCITY_Y, SPARSE_NEW_VELOCITY_Y);
+
+    fluid_pool_run(sparse->workerPool, advect_smoke_task, &pass, 0, sparse->numTiles);
+    swap_tile_fields(sparse, SPARSE_SMOKE, SPARSE_NEW_SMOKE);
+}
@@ -0,0 +1,215 @@
+#include "fluid_threads.h"
+#include <SDL.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+// number of polls before a waiting thread goes to sleep on its condition variable
+#define POOL_SPIN_COUNT 256
+
+typedef struct {
+    FluidWorkerPool* pool;
+    int workerIndex;
+} FluidWorkerArgs;
+
+struct FluidWorkerPool {
+    int numThreads;
+    int spinCount;
+    SDL_Thread** threads;
+    FluidWorkerArgs* workerArgs;
+
+    SDL_mutex* lock;
+    SDL_cond* wakeCondition;
+    SDL_cond* doneCondition;
+
+    atomic_int generation;
+    atomic_int pendingWorkers;
+    atomic_int shuttingDown;
+
+    FluidTaskFunction task;
+    void* taskData;
+    int rangeStart;
+    int rangeEnd;
+};
+
+/**
+ * Tells the core that this thread is spinning, so a sibling hyperthread gets the pipeline meanwhile.
+ */
+static inline void cpu_relax(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    _mm_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void run_chunk(FluidWorkerPool* pool, int workerIndex) {
+    long long rangeLength = (long long)pool->rangeEnd - pool->rangeStart;
+
+    // contiguous chunks so each thread works on its own strip of memory
+    int chunkStart = pool->rangeStart + (int)(rangeLength * workerIndex / pool->numThreads);
+    int chunkEnd = pool->rangeStart + (int)(rangeLength * (workerIndex + 1) / pool->numThreads);
+
+    if (chunkStart < chunkEnd) {
+        pool->task(pool->taskData, chunkStart, chunkEnd);
+    }
+}
+
+static int wait_for_work(FluidWorkerPool* pool, int seenGeneration) {
+
+    // spin first, passes are often dispatched back to back
+    for (int spin = 0; spin < pool->spinCount; ++spin) {
+        int generation = atomic_load(&pool->generation);
+        if (generation != seenGeneration || atomic_load(&pool->shuttingDown)) {
+            return generation;
+        }
+        cpu_relax();
+    }
+
+    SDL_LockMutex(pool->lock);
+    while (atomic_load(&pool->generation) == seenGeneration && !atomic_load(&pool->shuttingDown)) {
+        SDL_CondWait(pool->wakeCondition, pool->lock);
+    }
+    SDL_UnlockMutex(pool->lock);
+
+    return atomic_load(&pool->generation);
+}
+
+static int fluid_worker_thread(void* arg) {
+    FluidWorkerArgs* args = (FluidWorkerArgs*)arg;
+    FluidWorkerPool* pool = args->pool;
+    int seenGeneration = 0;
+
+    while (1) {
+        seenGeneration = wait_for_work(pool, seenGeneration);
+        if (atomic_load(&pool->shuttingDown)) break;
+
+        run_chunk(pool, args->workerIndex);
+
+        // the last worker wakes the caller in case it stopped spinning
+        if (atomic_fetch_sub(&pool->pendingWorkers, 1) == 1) {
+            SDL_LockMutex(pool->lock);
+            SDL_CondSignal(pool->doneCondition);
+            SDL_UnlockMutex(pool->lock);
+        }
+    }
+    return 0;
+}
+
+FluidWorkerPool* fluid_pool_create(int numThreads) {
+
+    if (numThreads < 1) numThreads = 1;
+
+    FluidWorkerPool* pool = (FluidWorkerPool*)calloc(1, sizeof(FluidWorkerPool));
+    if (pool == NULL) {
+        printf("ERROR: fluid_pool_create failed to allocate pool\n");
+        return NULL;
+    }
+
+    pool->numThreads = numThreads;
+
+    // when threads outnumber cores, a spinning thread holds the core the thread it waits for needs
+    pool->spinCount = numThreads <= SDL_GetCPUCount() ? POOL_SPIN_COUNT : 0;
+
+    atomic_init(&pool->generation, 0);
+    atomic_init(&pool->pendingWorkers, 0);
+    atomic_init(&pool->shuttingDown, 0);
+
+    pool->threads = (SDL_Thread**)calloc(numThreads, sizeof(SDL_Thread*));
+    pool->workerArgs = (FluidWorkerArgs*)calloc(numThreads, sizeof(FluidWorkerArgs));
+    pool->lock = SDL_CreateMutex();
+    pool->wakeCondition = SDL_CreateCond();
+    pool->doneCondition = SDL_CreateCond();
+
+    if (!pool->threads || !pool->workerArgs || !pool->lock || !pool->wakeCondition || !pool->doneCondition) {
+        printf("ERROR: fluid_pool_create failed to allocate pool resources\n");
+        pool->numThreads = 0;
+        fluid_pool_free(pool);
+        return NULL;
+    }
+
+    // worker 0 is the calling thread
+    for (int i = 1; i < numThreads; ++i) {
+        char nameBuf[32];
+        snprintf(nameBuf, sizeof(nameBuf), "fluidWorker_%d", i);
+
+        pool->workerArgs[i].pool = pool;
+        pool->workerArgs[i].workerIndex = i;
+        pool->threads[i] = SDL_CreateThread(fluid_worker_thread, nameBuf, &pool->workerArgs[i]);
+        if (pool->threads[i] == NULL) {
+            printf("ERROR: SDL_CreateThread failed: %s\n", SDL_GetError());
+            pool->numThreads = i;
+            break;
+        }
+    }
+
+    return pool;
+}
+
+void fluid_pool_free(FluidWorkerPool* pool) {
+    if (pool == NULL) return;
+
+    if (pool->lock && pool->wakeCondition) {
+        SDL_LockMutex(pool->lock);
+        atomic_store(&pool->shuttingDown, 1);
+        SDL_CondBroadcast(pool->wakeCondition);
+        SDL_UnlockMutex(pool->lock);
+    }
+
+    for (int i = 1; i < pool->numThreads; ++i) {
+        int threadReturnValue;
+        SDL_WaitThread(pool->threads[i], &threadReturnValue);
+        (void)threadReturnValue;
+    }
+
+    if (pool->doneCondition) SDL_DestroyCond(pool->doneCondition);
+    if (pool->wakeCondition) SDL_DestroyCond(pool->wakeCondition);
+    if (pool->lock) SDL_DestroyMutex(pool->lock);
+    free(pool->threads);
+    free(pool->workerArgs);
+    free(pool);
+}
+
+int fluid_pool_num_threads(const FluidWorkerPool* pool) {
+    return pool ? pool->numThreads : 1;
+}
+
+void fluid_pool_run(FluidWorkerPool* pool, FluidTaskFunction task, void* taskData, int rangeStart, int rangeEnd) {
+
+    if (rangeStart >= rangeEnd) return;
+
+    if (pool == NULL || pool->numThreads == 1) {
+        task(taskData, rangeStart, rangeEnd);
+        return;
+    }
+
+    pool->task = task;
+    pool->taskData = taskData;
+    pool->rangeStart = rangeStart;
+    pool->rangeEnd = rangeEnd;
+    atomic_store(&pool->pendingWorkers, pool->numThreads - 1);
+
+    // publish the task and wake sleeping workers
+    SDL_LockMutex(pool->lock);
+    atomic_fetch_add(&pool->generation, 1);
+    SDL_CondBroadcast(pool->wakeCondition);
+    SDL_UnlockMutex(pool->lock);
+
+    run_chunk(pool, 0);
+
+    // the workers usually finish their chunks around the same time as this one
+    for (int spin = 0; spin < pool->spinCount; ++spin) {
+        if (atomic_load(&pool->pendingWorkers) == 0) return;
+        cpu_relax();
+    }
+
+    SDL_LockMutex(pool->lock);
+    while (atomic_load(&pool->pendingWorkers) > 0) {
+        SDL_CondWait(pool->doneCondition, pool->lock);
+    }
+    SDL_UnlockMutex(pool->lock);
+}
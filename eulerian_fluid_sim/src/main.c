@@ -1,8 +1,13 @@
 #include <SDL.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h> 
 
 #include "fluid_logic.h" 
+#include "fluid_profile.h"
+#include "fluid_runner.h"
 
 
 const int WINDOW_WIDTH = 800;
@@ -12,53 +17,252 @@ static int mouseIsDown = 0;
 static int prevMouseX = 0;
 static int prevMouseY = 0;
 
-void render_fluid(SDL_Renderer* renderer, const Fluid* fluid) {
+void render_fluid(SDL_Renderer* renderer, SDL_Texture* texture, const FluidSnapshot* snapshot) {
+
+    // one pixel per cell, the GPU scales the texture to the window
+    SDL_UpdateTexture(texture, NULL, snapshot->pixels, snapshot->width * sizeof(uint32_t));
 
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); 
     SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+int screen_to_fluid_x(int screenX, int numCellsX, int windowWidth) {
+    return (int)((float)screenX / windowWidth * (numCellsX - 2)) + 1;
+}
+
+int screen_to_fluid_y(int screenY, int numCellsY, int windowHeight) {
+    return (int)((float)(windowHeight - screenY) / windowHeight * (numCellsY - 2)) + 1;
+}
+
+/**
+ * Command line of the app:
+ *   [recording]              records the smoke of every step to the file (see fluid_recorder.h)
+ *   --record-events <file>   saves the mouse input with the step it was applied at when the app quits
+ *   --replay <file>          takes the input from a saved event log instead of the mouse
+ *   --checksums <file>       writes the smoke checksum of every step
+ *   --threads <n>            threads of the fluid passes (default: the CPU count), results don't depend on it
+ *   --headless <steps>       runs the steps as fast as possible without a window and prints the final checksum
+ */
+typedef struct {
+    const char* recordingPath;
+    const char* recordEventsPath;
+    const char* replayPath;
+    const char* checksumPath;
+    int numThreads;
+    long long headlessSteps;
+} AppOptions;
+
+static int parse_options(int argc, char* argv[], AppOptions* options) {
+    memset(options, 0, sizeof(AppOptions));
+    options->numThreads = SDL_GetCPUCount();
+    if (options->numThreads < 1) options->numThreads = 1;
+
+    for (int arg = 1; arg < argc; ++arg) {
+        const char* option = argv[arg];
+        const char* value = (arg + 1 < argc) ? argv[arg + 1] : NULL;
+
+        if (option[0] != '-' && options->recordingPath == NULL) {
+            options->recordingPath = option;
+            continue;
+        }
+
+        int ok = value != NULL;
+        if (ok && strcmp(option, "--record-events") == 0) options->recordEventsPath = value;
+        else if (ok && strcmp(option, "--replay") == 0) options->replayPath = value;
+        else if (ok && strcmp(option, "--checksums") == 0) options->checksumPath = value;
+        else if (ok && strcmp(option, "--threads") == 0) ok = (options->numThreads = atoi(value)) > 0;
+        else if (ok && strcmp(option, "--headless") == 0) ok = (options->headlessSteps = atoll(value)) > 0;
+        else ok = 0;
+
+        if (!ok) {
+            printf("Invalid option %s\n", option);
+            printf("usage: eulerian_fluid_sim_app [recording] [--record-events file] [--replay file] [--checksums file] [--threads n] [--headless steps]\n");
+            return 0;
+        }
+        ++arg;
+    }
+    return 1;
+}
+
+/**
+ * Builds the closed box the app simulates.
+ */
+static Fluid* create_fluid(int numThreads) {
+
+    float density = 1.0f;
+
+    /* increase the value to change the 'resolution' of the smoke (WARNING: EXPENSIVE) 
+       recommended value is 100
+    */
+    int numX = 100; 
+    int numY = 100; 
 
-    float cellWidth = (float)WINDOW_WIDTH / (fluid->numCellsX - 2);
-    float cellHeight = (float)WINDOW_HEIGHT / (fluid->numCellsY - 2);
+    float cellSize = 1.0f / numY; 
 
-    for (int i = 1; i < fluid->numCellsX - 1; ++i) {
-        for (int j = 1; j < fluid->numCellsY - 1; ++j) {
+    Fluid* fluid = fluid_init(density, numX, numY, cellSize, PRESSURE_SOLVER_RED_BLACK_SOR);
+    if (fluid == NULL) return NULL;
 
-            size_t index = (size_t)i * fluid->numCellsY + j;
-            float smoke = fluid->smokeDensity[index];
+    // spread the pressure solve across the cores
+    fluid_set_num_threads(fluid, numThreads);
 
-            // uncomment the following code if you want gray smoke on a white background.
-            // Uint8 color = (Uint8)((1.0f - fminf(smoke * 1.5f, 1.0f)) * 255.0f);
-            Uint8 color = (Uint8)(fminf(smoke * 255.0f, 255.0f));
+    // stop the pressure solve once the max divergence is below the tolerance
+    float solverTolerance = 1e-3f;
+    fluid_set_solver_tolerance(fluid, solverTolerance, 1);
 
-            SDL_SetRenderDrawColor(renderer, color, color, color, 255);
+    // skip the parts of the box without smoke or motion
+    fluid_set_active_tiles(fluid, 1, 1e-4f);
 
-            SDL_Rect cellRect = {
-                (int)((i - 1) * cellWidth),
-                (int)(WINDOW_HEIGHT - ((j - 1) * cellHeight) - cellHeight), 
-                (int)(cellWidth + 1),
-                (int)(cellHeight + 1)
-            };
-            SDL_RenderFillRect(renderer, &cellRect);
+    // initialize solid flags and smoke density for cells
+    for (int i = 0; i < fluid->numCellsX; ++i) {
+        for (int j = 0; j < fluid->numCellsY; ++j) {
+            // make boundaries obstacles
+            if (i == 0 || i == fluid->numCellsX - 1 || j == 0 || j == fluid->numCellsY - 1) {
+                fluid_set_obstacle(fluid, i, j, 0.0f); 
+            } else {
+                fluid_set_obstacle(fluid, i, j, 1.0f); 
+                fluid_set_smoke(fluid, i, j, 0.0f);
+            }
         }
     }
-    SDL_RenderPresent(renderer);
+    return fluid;
 }
 
-int screen_to_fluid_x(int screenX, int numCellsX, int windowWidth) {
-    return (int)((float)screenX / windowWidth * (numCellsX - 2)) + 1;
+/**
+ * The fluid, the settings it runs with and the files they read and write.
+ */
+typedef struct {
+    Fluid* fluid;
+    FluidRunnerSettings settings;
+    FluidEventLog* replayEvents;
+    FluidEventLog* recordEvents;
+} AppSession;
+
+static int open_session(const AppOptions* options, AppSession* session) {
+    memset(session, 0, sizeof(AppSession));
+
+    session->fluid = create_fluid(options->numThreads);
+    if (session->fluid == NULL) {
+        printf("Failed to initialize fluid simulation.\n");
+        return 0;
+    }
+
+    // simulation parameters (numIterations is the cap when the solver has not converged)
+    FluidRunnerSettings* settings = &session->settings;
+    settings->stepsPerSecond = 60.0f;
+    settings->maxCflNumber = 1.0f;
+    settings->maxSubsteps = 4;
+    settings->maxCatchUpSteps = 3;
+    settings->numIterations = 100;
+    settings->gravityForce = 0.0f;
+    settings->overRelaxation = 1.9f;
+    settings->dissipation = 0.99f;
+    settings->smokeDissipation = 0.999f;
+
+    if (options->recordingPath) {
+        FluidRecorderSettings recorderSettings;
+        recorderSettings.fields = FLUID_RECORD_SMOKE;
+        recorderSettings.precision = FLUID_RECORD_FLOAT16;
+        recorderSettings.keyframeInterval = 60;
+        recorderSettings.numBuffers = FLUID_RECORDER_DEFAULT_BUFFERS;
+
+        settings->recorder = fluid_recorder_create(options->recordingPath, session->fluid, &recorderSettings);
+        if (settings->recorder == NULL) {
+            printf("Failed to start recording.\n");
+            return 0;
+        }
+    }
+
+    if (options->replayPath) {
+        session->replayEvents = fluid_event_log_load(options->replayPath);
+        if (session->replayEvents == NULL) return 0;
+        settings->replayEvents = session->replayEvents;
+    }
+
+    if (options->recordEventsPath) {
+        session->recordEvents = fluid_event_log_create();
+        if (session->recordEvents == NULL) return 0;
+        settings->recordEvents = session->recordEvents;
+    }
+
+    if (options->checksumPath) {
+        settings->checksumFile = fopen(options->checksumPath, "w");
+        if (settings->checksumFile == NULL) {
+            printf("Failed to open %s.\n", options->checksumPath);
+            return 0;
+        }
+    }
+    return 1;
 }
 
-int screen_to_fluid_y(int screenY, int numCellsY, int windowHeight) {
-    return (int)((float)(windowHeight - screenY) / windowHeight * (numCellsY - 2)) + 1;
+/**
+ * Closes the files and frees the fluid once the simulation stopped. After a run (finished) the recorded
+ * input is saved and the statistics are printed. Returns 0 when an output could not be written.
+ */
+static int close_session(const AppOptions* options, AppSession* session, int finished) {
+    int ok = 1;
+    FluidRunnerSettings* settings = &session->settings;
+
+    if (settings->recorder) {
+        FluidRecorderStats recorderStats;
+        fluid_recorder_stats(settings->recorder, &recorderStats);
+        if (!fluid_recorder_close(settings->recorder)) {
+            printf("The recording is incomplete.\n");
+            ok = 0;
+        }
+        if (finished) {
+            printf("Recorded %lld steps to %s (%lld dropped)\n", recorderStats.framesCaptured, options->recordingPath,
+                   recorderStats.framesDropped);
+        }
+    }
+
+    if (session->recordEvents && finished) {
+        if (fluid_event_log_save(session->recordEvents, options->recordEventsPath)) {
+            printf("Saved %d input events to %s\n", fluid_event_log_num_events(session->recordEvents), options->recordEventsPath);
+        } else {
+            ok = 0;
+        }
+    }
+    fluid_event_log_free(session->recordEvents);
+    fluid_event_log_free(session->replayEvents);
+
+    if (settings->checksumFile && fclose(settings->checksumFile) != 0) {
+        printf("Failed to write %s.\n", options->checksumPath);
+        ok = 0;
+    }
+
+#ifdef FLUID_ENABLE_PROFILING
+    // phase timings of the whole session
+    if (finished) fluid_profile_write_json(session->fluid, "fluid_profile.json");
+#endif
+
+    fluid_free(session->fluid);
+    return ok;
 }
 
 int main(int argc, char* argv[]) {
 
-    (void)argc;
-    (void)argv;
+    AppOptions options;
+    if (!parse_options(argc, argv, &options)) return 1;
+
+    AppSession session;
+    if (!open_session(&options, &session)) {
+        close_session(&options, &session, 0);
+        return 1;
+    }
+    Fluid* fluid = session.fluid;
+
+    // regression runs replay their input without a window or the clock
+    if (options.headlessSteps > 0) {
+        long long numSteps = fluid_runner_run_steps(fluid, &session.settings, options.headlessSteps);
+        printf("Ran %lld steps, smoke checksum %016llx\n", numSteps, (unsigned long long)fluid_smoke_checksum(fluid));
+        int ok = close_session(&options, &session, 1);
+        return ok && numSteps == options.headlessSteps ? 0 : 1;
+    }
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        close_session(&options, &session, 0);
         return 1;
     }
 
@@ -72,6 +276,7 @@ int main(int argc, char* argv[]) {
     );
     if (window == NULL) {
         printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+        close_session(&options, &session, 0);
         SDL_Quit();
         return 1;
     }
@@ -79,50 +284,49 @@ int main(int argc, char* argv[]) {
     SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (renderer == NULL) {
         printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+        close_session(&options, &session, 0);
         SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
 
-
-    float density = 1.0f;
-
-    /* increase the value to change the 'resolution' of the smoke (WARNING: EXPENSIVE) 
-       recommended value is 100
-    */
-    int numX = 100; 
-    int numY = 100; 
-
-    float cellSize = 1.0f / numY; 
-
-    Fluid* fluid = fluid_init(density, numX, numY, cellSize);
-    if (fluid == NULL) {
-        printf("Failed to initialize fluid simulation.\n");
+    SDL_Texture* texture = SDL_CreateTexture(renderer,
+                                             SDL_PIXELFORMAT_RGB888,
+                                             SDL_TEXTUREACCESS_STREAMING,
+                                             fluid->numCellsX - 2, fluid->numCellsY - 2);
+    if (texture == NULL) {
+        printf("Smoke texture could not be created! SDL_Error: %s\n", SDL_GetError());
+        close_session(&options, &session, 0);
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
 
-    // initialize solid flags and smoke density for cells
-    for (int i = 0; i < fluid->numCellsX; ++i) {
-        for (int j = 0; j < fluid->numCellsY; ++j) {
-            size_t index = (size_t)i * fluid->numCellsY + j;
-            // make boundaries obstacles
-            if (i == 0 || i == fluid->numCellsX - 1 || j == 0 || j == fluid->numCellsY - 1) {
-                fluid_set_obstacle(fluid, i, j, 0.0f); 
-            } else {
-                fluid_set_obstacle(fluid, i, j, 1.0f); 
-                fluid->smokeDensity[index] = 0.0f;
-            }
-        }
+    // the simulation steps on its own thread from here on, input reaches it as commands
+    FluidRunner* runner = fluid_runner_create(fluid, &session.settings);
+    if (runner == NULL) {
+        printf("Failed to start the simulation thread.\n");
+        close_session(&options, &session, 0);
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
     }
-    
+
     SDL_Event e;
     int quit = 0;
-    Uint64 lastTick = SDL_GetPerformanceCounter();
+    FluidCommand command;
 
-    // main simulation loop
+    // solver statistics shown in the window title
+    long long lastStatsStep = 0;
+    long long lastStatsSubsteps = 0;
+    long long lastStatsIterations = 0;
+    Uint32 lastStatsTick = SDL_GetTicks();
+    char title[224];
+
+    // main render loop
     while (!quit) {
         // event handling
         while (SDL_PollEvent(&e) != 0) {
@@ -134,18 +338,12 @@ int main(int argc, char* argv[]) {
                     prevMouseX = e.button.x;
                     prevMouseY = e.button.y;
 
-                    int fluidGridX = screen_to_fluid_x(e.button.x, fluid->numCellsX, WINDOW_WIDTH);
-                    int fluidGridY = screen_to_fluid_y(e.button.y, fluid->numCellsY, WINDOW_HEIGHT);
-
-                    fluidGridX = fmaxf(1, fminf(fluidGridX, fluid->numCellsX - 2));
-                    fluidGridY = fmaxf(1, fminf(fluidGridY, fluid->numCellsY - 2));
-
-                    size_t fluidIndex = (size_t)fluidGridX * fluid->numCellsY + fluidGridY;
-
                     // add smoke at mouse click location
-                    if (fluid->solidFlags[fluidIndex] == 1.0f) {
-                        fluid->smokeDensity[fluidIndex] = fminf(fluid->smokeDensity[fluidIndex] + 0.8f, 1.0f);
-                    }
+                    command.type = FLUID_COMMAND_ADD_SMOKE;
+                    command.cellX = screen_to_fluid_x(e.button.x, fluid->numCellsX, WINDOW_WIDTH);
+                    command.cellY = screen_to_fluid_y(e.button.y, fluid->numCellsY, WINDOW_HEIGHT);
+                    command.amount = 0.8f;
+                    fluid_runner_push_command(runner, &command);
                 }
             } else if (e.type == SDL_MOUSEBUTTONUP) {
                 if (e.button.button == SDL_BUTTON_LEFT) {
@@ -159,26 +357,21 @@ int main(int argc, char* argv[]) {
                     float deltaX = (float)(currentMouseX - prevMouseX);
                     float deltaY = (float)(currentMouseY - prevMouseY); 
 
-                    int fluidGridX = screen_to_fluid_x(currentMouseX, fluid->numCellsX, WINDOW_WIDTH);
-                    int fluidGridY = screen_to_fluid_y(currentMouseY, fluid->numCellsY, WINDOW_HEIGHT);
-
-                    fluidGridX = fmaxf(1, fminf(fluidGridX, fluid->numCellsX - 2));
-                    fluidGridY = fmaxf(1, fminf(fluidGridY, fluid->numCellsY - 2));
-
-                    size_t fluidIndex = (size_t)fluidGridX * fluid->numCellsY + fluidGridY;
+                    command.cellX = screen_to_fluid_x(currentMouseX, fluid->numCellsX, WINDOW_WIDTH);
+                    command.cellY = screen_to_fluid_y(currentMouseY, fluid->numCellsY, WINDOW_HEIGHT);
 
                     // add smoke at mouse drag location
-                    if (fluid->solidFlags[fluidIndex] == 1.0f) {
-                        fluid->smokeDensity[fluidIndex] = fminf(fluid->smokeDensity[fluidIndex] + 0.8f, 1.0f);
-                    }
+                    command.type = FLUID_COMMAND_ADD_SMOKE;
+                    command.amount = 0.8f;
+                    fluid_runner_push_command(runner, &command);
 
                     float forceScale = 0.5f; 
 
                     // apply force to fluid based on mouse movement
-                    if (fluid->solidFlags[fluidIndex] == 1.0f) {
-                        fluid->velocityX[fluidIndex] += deltaX * forceScale;
-                        fluid->velocityY[fluidIndex] += -deltaY * forceScale;
-                    }
+                    command.type = FLUID_COMMAND_ADD_FORCE;
+                    command.forceX = deltaX * forceScale;
+                    command.forceY = -deltaY * forceScale;
+                    fluid_runner_push_command(runner, &command);
                     
                     prevMouseX = currentMouseX;
                     prevMouseY = currentMouseY;
@@ -188,42 +381,41 @@ int main(int argc, char* argv[]) {
 
         // add smoke if mouse is held down
         if (mouseIsDown) {
-
-            int fluidGridX = screen_to_fluid_x(prevMouseX, fluid->numCellsX, WINDOW_WIDTH);
-            int fluidGridY = screen_to_fluid_y(prevMouseY, fluid->numCellsY, WINDOW_HEIGHT);
-
-            fluidGridX = fmaxf(1, fminf(fluidGridX, fluid->numCellsX - 2));
-            fluidGridY = fmaxf(1, fminf(fluidGridY, fluid->numCellsY - 2));
-
-            size_t fluidIndex = (size_t)fluidGridX * fluid->numCellsY + fluidGridY;
-
-            if (fluid->solidFlags[fluidIndex] == 1.0f) {
-                fluid->smokeDensity[fluidIndex] = fminf(fluid->smokeDensity[fluidIndex] + 0.3f, 1.0f);
-            }
+            command.type = FLUID_COMMAND_ADD_SMOKE;
+            command.cellX = screen_to_fluid_x(prevMouseX, fluid->numCellsX, WINDOW_WIDTH);
+            command.cellY = screen_to_fluid_y(prevMouseY, fluid->numCellsY, WINDOW_HEIGHT);
+            command.amount = 0.3f;
+            fluid_runner_push_command(runner, &command);
         }
 
-        // calculate delta time for simulation step
-        Uint64 currentTick = SDL_GetPerformanceCounter();
-        float deltaTime = (float)(currentTick - lastTick) / (float)SDL_GetPerformanceFrequency();
-        lastTick = currentTick;
-
-        // simulation parameters
-        int numIterations = 100;
-        float gravityForce = 0.0f;
-        float overRelaxation = 1.9f;
-        float velocityDissipation = 0.99f;
-        float smokeDensityDissipation = 0.999f;
-
-        fluid_simulate_step(fluid, numIterations, deltaTime, gravityForce, overRelaxation, velocityDissipation, smokeDensityDissipation);
-
-        render_fluid(renderer, fluid);
+        // draw the newest finished step, the simulation keeps running meanwhile
+        const FluidSnapshot* snapshot = fluid_runner_latest_snapshot(runner);
+        render_fluid(renderer, texture, snapshot);
+
+        Uint32 now = SDL_GetTicks();
+        if (now - lastStatsTick >= 1000) {
+            long long numSteps = snapshot->step - lastStatsStep;
+            double substepsPerStep = numSteps > 0 ? (double)(snapshot->totalSubsteps - lastStatsSubsteps) / numSteps : 0.0;
+            double iterationsPerStep = numSteps > 0 ? (double)(snapshot->totalSolverIterations - lastStatsIterations) / numSteps : 0.0;
+            snprintf(title, sizeof(title), "Eulerian Fluid Simulation - steps/s: %lld, substeps/step: %.2f, solver iterations/step: %.1f, residual: %.2e, dropped: %lld",
+                     numSteps * 1000 / (now - lastStatsTick), substepsPerStep, iterationsPerStep, snapshot->residualMax, snapshot->droppedSteps);
+            SDL_SetWindowTitle(window, title);
+            lastStatsStep = snapshot->step;
+            lastStatsSubsteps = snapshot->totalSubsteps;
+            lastStatsIterations = snapshot->totalSolverIterations;
+            lastStatsTick = now;
+        }
     }
 
+    // stop the simulation before touching the fluid again
+    fluid_runner_free(runner);
+    int ok = close_session(&options, &session, 1);
+
     // clean up resources
-    fluid_free(fluid);
+    SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
-    return 0;
+    return ok ? 0 : 1;
 }
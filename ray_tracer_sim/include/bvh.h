@@ -0,0 +1,45 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <stdint.h>
+#include "ray_logic.h"
+
+#define BVH_MAX_DEPTH 64
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_NUM_BINS 12
+
+/**
+ * Flattened bounding volume hierarchy node (32 bytes, two per cache line).
+ * Interior nodes (count == 0) have their children at firstIndex and firstIndex + 1,
+ * leaves hold spheres [firstIndex, firstIndex + count) of the hierarchy's sphere array.
+ */
+typedef struct {
+    float boundsMin[3];
+    int32_t firstIndex;
+    float boundsMax[3];
+    int32_t count;
+} BvhNode;
+
+/**
+ * Hierarchy over a copy of the scene's spheres, reordered so every leaf's spheres are contiguous.
+ * Node 0 is the root.
+ */
+struct Bvh {
+    BvhNode* nodes;
+    int numNodes;
+    Sphere* spheres;
+    int numSpheres;
+};
+
+// builds the hierarchy with the surface area heuristic over binned sphere centers (NULL when out of memory)
+Bvh* bvh_build(const Sphere* spheres, int numSpheres);
+
+void bvh_free(Bvh* bvh);
+
+// closest sphere hit by the ray, visiting nodes front to back (integer representation of a boolean)
+int bvh_intersect_closest(const Bvh* bvh, Ray ray, float* intersectionDistance, const Sphere** hitSphere);
+
+// whether any sphere is hit closer than maxDistance, stops at the first one
+int bvh_intersect_any(const Bvh* bvh, Ray ray, float maxDistance);
+
+#endif
@@ -47,6 +47,9 @@ typedef struct {
     float fov;
 } Camera;
 
+// bounding volume hierarchy over the scene's spheres (see bvh.h)
+typedef struct Bvh Bvh;
+
 /**
  * Vec3 math functions
  */
@@ -70,8 +73,7 @@ int ray_intersect_sphere(Ray ray, Sphere sphere, float* intersectionDistance);
 // function containing the main ray tracing logic for a single ray
 Color trace_ray(
     Ray ray,
-    Sphere* spheres,
-    int numSpheres,
+    const Bvh* bvh,
     Vec3 lightPosition,
     Color lightColor,
     Color ambientLight,
@@ -86,8 +88,7 @@ Color trace_ray(
 // wrapper used by the multithread helper
 Color trace_ray_with_rng(
     Ray ray,
-    Sphere *spheres,
-    int numSpheres,
+    const Bvh* bvh,
     Vec3 lightPos,
     int shadow_samples,
     unsigned int *rng_state
@@ -0,0 +1,336 @@
+#include "bvh.h"
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+// cost of visiting a node relative to one ray-sphere test
+#define BVH_TRAVERSAL_COST 1.0f
+
+typedef struct {
+    float min[3];
+    float max[3];
+} Aabb;
+
+typedef struct {
+    Aabb bounds;
+    int count;
+} BvhBin;
+
+// node waiting on the traversal stack with the distance at which the ray enters its box
+typedef struct {
+    int nodeIndex;
+    float entryDistance;
+} BvhStackEntry;
+
+// plain compares compile to single min/max instructions, unlike fminf and fmaxf. A NaN in a returns b.
+static inline float min_float(float a, float b) {
+    return a < b ? a : b;
+}
+
+static inline float max_float(float a, float b) {
+    return a > b ? a : b;
+}
+
+static inline void aabb_reset(Aabb* box) {
+    for (int axis = 0; axis < 3; ++axis) {
+        box->min[axis] = FLT_MAX;
+        box->max[axis] = -FLT_MAX;
+    }
+}
+
+static inline void aabb_grow_box(Aabb* box, const Aabb* other) {
+    for (int axis = 0; axis < 3; ++axis) {
+        box->min[axis] = min_float(box->min[axis], other->min[axis]);
+        box->max[axis] = max_float(box->max[axis], other->max[axis]);
+    }
+}
+
+static inline void aabb_of_sphere(const Sphere* sphere, Aabb* box) {
+    float center[3] = {sphere->center.x, sphere->center.y, sphere->center.z};
+    for (int axis = 0; axis < 3; ++axis) {
+        box->min[axis] = center[axis] - sphere->radius;
+        box->max[axis] = center[axis] + sphere->radius;
+    }
+}
+
+// half the surface area, the heuristic only compares ratios
+static inline float aabb_area(const Aabb* box) {
+    float dx = box->max[0] - box->min[0];
+    float dy = box->max[1] - box->min[1];
+    float dz = box->max[2] - box->min[2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f) return 0.0f;
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static inline float sphere_center_axis(const Sphere* sphere, int axis) {
+    return axis == 0 ? sphere->center.x : (axis == 1 ? sphere->center.y : sphere->center.z);
+}
+
+static inline int bin_of_sphere(const Sphere* sphere, int axis, float centerMin, float binScale) {
+    int bin = (int)((sphere_center_axis(sphere, axis) - centerMin) * binScale);
+    return bin < 0 ? 0 : (bin >= BVH_NUM_BINS ? BVH_NUM_BINS - 1 : bin);
+}
+
+static void make_leaf(BvhNode* node, int first, int count) {
+    node->firstIndex = first;
+    node->count = count;
+}
+
+// splits spheres [first, first + count) of a node into two children, recursively
+static void build_node(Bvh* bvh, int nodeIndex, int first, int count, int depth) {
+    BvhNode* node = &bvh->nodes[nodeIndex];
+    Sphere* spheres = bvh->spheres;
+
+    Aabb bounds;
+    Aabb centerBounds;
+    aabb_reset(&bounds);
+    aabb_reset(&centerBounds);
+    for (int i = first; i < first + count; ++i) {
+        Aabb sphereBox;
+        aabb_of_sphere(&spheres[i], &sphereBox);
+        aabb_grow_box(&bounds, &sphereBox);
+        for (int axis = 0; axis < 3; ++axis) {
+            float center = sphere_center_axis(&spheres[i], axis);
+            centerBounds.min[axis] = min_float(centerBounds.min[axis], center);
+            centerBounds.max[axis] = max_float(centerBounds.max[axis], center);
+        }
+    }
+    memcpy(node->boundsMin, bounds.min, sizeof(node->boundsMin));
+    memcpy(node->boundsMax, bounds.max, sizeof(node->boundsMax));
+
+    // the traversal stack holds at most one node per level
+    if (count == 1 || depth >= BVH_MAX_DEPTH - 1) {
+        make_leaf(node, first, count);
+        return;
+    }
+
+    // binned SAH: the cost of a split is the number of spheres on each side weighted by the area of its box
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = centerBounds.max[axis] - centerBounds.min[axis];
+        if (extent <= 0.0f) continue;
+        float binScale = (float)BVH_NUM_BINS / extent;
+
+        BvhBin bins[BVH_NUM_BINS];
+        for (int b = 0; b < BVH_NUM_BINS; ++b) {
+            aabb_reset(&bins[b].bounds);
+            bins[b].count = 0;
+        }
+        for (int i = first; i < first + count; ++i) {
+            BvhBin* bin = &bins[bin_of_sphere(&spheres[i], axis, centerBounds.min[axis], binScale)];
+            Aabb sphereBox;
+            aabb_of_sphere(&spheres[i], &sphereBox);
+            aabb_grow_box(&bin->bounds, &sphereBox);
+            bin->count++;
+        }
+
+        // sweep from the right first, split s puts bins [0, s] on the left
+        float rightCost[BVH_NUM_BINS - 1];
+        Aabb rightBox;
+        aabb_reset(&rightBox);
+        int rightCount = 0;
+        for (int split = BVH_NUM_BINS - 2; split >= 0; --split) {
+            aabb_grow_box(&rightBox, &bins[split + 1].bounds);
+            rightCount += bins[split + 1].count;
+            rightCost[split] = rightCount ? aabb_area(&rightBox) * (float)rightCount : FLT_MAX;
+        }
+
+        Aabb leftBox;
+        aabb_reset(&leftBox);
+        int leftCount = 0;
+        for (int split = 0; split < BVH_NUM_BINS - 1; ++split) {
+            aabb_grow_box(&leftBox, &bins[split].bounds);
+            leftCount += bins[split].count;
+            if (leftCount == 0 || rightCost[split] == FLT_MAX) continue;
+
+            float cost = aabb_area(&leftBox) * (float)leftCount + rightCost[split];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    int leftCount = 0;
+    if (bestAxis >= 0) {
+        float area = aabb_area(&bounds);
+        float splitCost = BVH_TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+        if (splitCost >= (float)count && count <= BVH_MAX_LEAF_SIZE) {
+            make_leaf(node, first, count);
+            return;
+        }
+
+        float extent = centerBounds.max[bestAxis] - centerBounds.min[bestAxis];
+        float binScale = (float)BVH_NUM_BINS / extent;
+        int i = first;
+        int j = first + count - 1;
+        while (i <= j) {
+            if (bin_of_sphere(&spheres[i], bestAxis, centerBounds.min[bestAxis], binScale) <= bestSplit) {
+                ++i;
+            } else {
+                Sphere swap = spheres[i];
+                spheres[i] = spheres[j];
+                spheres[j] = swap;
+                --j;
+            }
+        }
+        leftCount = i - first;
+    } else if (count <= BVH_MAX_LEAF_SIZE) {
+        make_leaf(node, first, count);
+        return;
+    }
+
+    // every center in one point: any halves are as good as others
+    if (leftCount == 0 || leftCount == count) leftCount = count / 2;
+
+    int leftChild = bvh->numNodes;
+    bvh->numNodes += 2;
+    node->firstIndex = leftChild;
+    node->count = 0;
+
+    build_node(bvh, leftChild, first, leftCount, depth + 1);
+    build_node(bvh, leftChild + 1, first + leftCount, count - leftCount, depth + 1);
+}
+
+Bvh* bvh_build(const Sphere* spheres, int numSpheres) {
+    Bvh* bvh = (Bvh*)calloc(1, sizeof(Bvh));
+    if (!bvh) return NULL;
+
+    if (numSpheres > 0) {
+        // a binary tree with one sphere per leaf at most has 2n - 1 nodes
+        bvh->nodes = (BvhNode*)malloc(sizeof(BvhNode) * (2 * (size_t)numSpheres - 1));
+        bvh->spheres = (Sphere*)malloc(sizeof(Sphere) * (size_t)numSpheres);
+        if (!bvh->nodes || !bvh->spheres) {
+            bvh_free(bvh);
+            return NULL;
+        }
+
+        memcpy(bvh->spheres, spheres, sizeof(Sphere) * (size_t)numSpheres);
+        bvh->numSpheres = numSpheres;
+        bvh->numNodes = 1;
+        build_node(bvh, 0, 0, numSpheres, 0);
+    }
+    return bvh;
+}
+
+void bvh_free(Bvh* bvh) {
+    if (bvh) {
+        free(bvh->nodes);
+        free(bvh->spheres);
+        free(bvh);
+    }
+}
+
+/* distance at which the ray enters the node's box within [0, maxDistance], FLT_MAX when it misses.
+   A ray parallel to an axis and starting on a face of the box gives 0 * inf = NaN for that face. min_float and max_float
+   return their second argument on NaN, so the slab is skipped when the origin is on the max face, while on the min face
+   the other bound (+inf or -inf) wins and the box is rejected. Only rays grazing the box along a face are lost that way */
+static inline float ray_box_entry(const BvhNode* node, const float origin[3], const float inverseDirection[3], float maxDistance) {
+    float entry = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; ++axis) {
+        float t0 = (node->boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+        float t1 = (node->boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+        entry = max_float(min_float(t0, t1), entry);
+        exit = min_float(max_float(t0, t1), exit);
+    }
+    return entry <= exit ? entry : FLT_MAX;
+}
+
+static inline void ray_setup(Ray ray, float origin[3], float inverseDirection[3]) {
+    origin[0] = ray.origin.x;
+    origin[1] = ray.origin.y;
+    origin[2] = ray.origin.z;
+    inverseDirection[0] = 1.0f / ray.direction.x;
+    inverseDirection[1] = 1.0f / ray.direction.y;
+    inverseDirection[2] = 1.0f / ray.direction.z;
+}
+
+int bvh_intersect_closest(const Bvh* bvh, Ray ray, float* intersectionDistance, const Sphere** hitSphere) {
+    if (bvh->numNodes == 0) return 0;
+
+    float origin[3];
+    float inverseDirection[3];
+    ray_setup(ray, origin, inverseDirection);
+
+    float closestDistance = FLT_MAX;
+    const Sphere* closestSphere = NULL;
+    BvhStackEntry stack[BVH_MAX_DEPTH];
+    int stackSize = 0;
+
+    if (ray_box_entry(&bvh->nodes[0], origin, inverseDirection, FLT_MAX) == FLT_MAX) return 0;
+    stack[stackSize++] = (BvhStackEntry){0, 0.0f};
+
+    while (stackSize > 0) {
+        BvhStackEntry entry = stack[--stackSize];
+
+        // a closer hit was found after the node was pushed
+        if (entry.entryDistance >= closestDistance) continue;
+
+        const BvhNode* node = &bvh->nodes[entry.nodeIndex];
+        while (node->count == 0) {
+            int nearChild = node->firstIndex;
+            int farChild = node->firstIndex + 1;
+            float nearDistance = ray_box_entry(&bvh->nodes[nearChild], origin, inverseDirection, closestDistance);
+            float farDistance = ray_box_entry(&bvh->nodes[farChild], origin, inverseDirection, closestDistance);
+
+            // front to back: descend into the nearer child, the other one waits on the stack
+            if (farDistance < nearDistance) {
+                int swapChild = nearChild;
+                nearChild = farChild;
+                farChild = swapChild;
+                float swapDistance = nearDistance;
+                nearDistance = farDistance;
+                farDistance = swapDistance;
+            }
+            if (nearDistance == FLT_MAX) break;
+            if (farDistance != FLT_MAX) stack[stackSize++] = (BvhStackEntry){farChild, farDistance};
+            node = &bvh->nodes[nearChild];
+        }
+
+        for (int i = node->firstIndex; i < node->firstIndex + node->count; ++i) {
+            float distance;
+            if (ray_intersect_sphere(ray, bvh->spheres[i], &distance) && distance < closestDistance) {
+                closestDistance = distance;
+                closestSphere = &bvh->spheres[i];
+            }
+        }
+    }
+
+    if (closestSphere == NULL) return 0;
+    *intersectionDistance = closestDistance;
+    *hitSphere = closestSphere;
+    return 1;
+}
+
+int bvh_intersect_any(const Bvh* bvh, Ray ray, float maxDistance) {
+    if (bvh->numNodes == 0) return 0;
+
+    float origin[3];
+    float inverseDirection[3];
+    ray_setup(ray, origin, inverseDirection);
+
+    int stack[BVH_MAX_DEPTH];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BvhNode* node = &bvh->nodes[stack[--stackSize]];
+        if (ray_box_entry(node, origin, inverseDirection, maxDistance) == FLT_MAX) continue;
+
+        if (node->count == 0) {
+            stack[stackSize++] = node->firstIndex + 1;
+            stack[stackSize++] = node->firstIndex;
+            continue;
+        }
+
+        for (int i = node->firstIndex; i < node->firstIndex + node->count; ++i) {
+            float distance;
+            if (ray_intersect_sphere(ray, bvh->spheres[i], &distance) && distance < maxDistance) return 1;
+        }
+    }
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <time.h>
 #include <stdatomic.h>
 #include "ray_logic.h"
+#include "bvh.h"
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
@@ -16,8 +17,7 @@ const int WINDOW_HEIGHT = 800;
 
 typedef struct {
     Camera camera;
-    Sphere *spheres;
-    int numSpheres;
+    const Bvh *bvh;
     Vec3 *precompRays;
     int width;
     int height;
@@ -43,8 +43,7 @@ static int sdlRenderWorker(void *arg) {
             Ray primary = { job->camera.position, dir };
             Color col = trace_ray(
                 primary,
-                job->spheres,
-                job->numSpheres,
+                job->bvh,
                 job->lightPos,
                 (Color){1.0f, 1.0f, 1.0f},
                 (Color){0.1f, 0.1f, 0.1f},
@@ -67,8 +66,11 @@ static int sdlRenderWorker(void *arg) {
     return 0;
 }
 
+// ray_tracer_sim_app <n> adds n small random spheres behind the three big ones
 int main(int argc, char* argv[]) {
-    (void)argc; (void)argv;
+    int numRandomSpheres = argc > 1 ? atoi(argv[1]) : 0;
+    if (numRandomSpheres < 0) numRandomSpheres = 0;
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         return 1;
     }
@@ -100,8 +102,31 @@ int main(int argc, char* argv[]) {
     Sphere blueSphere = sphere_create((Vec3){1.0f, -0.5f, -3.0f}, 0.8f, (Color){0.0f, 0.0f, 1.0f}, 0.0f);
     Sphere greenSphere = sphere_create((Vec3){-2.0f, 0.5f, -7.0f}, 1.2f, (Color){0.0f, 1.0f, 0.0f}, 0.5f);
 
-    Sphere sceneSpheres[] = {redSphere, blueSphere, greenSphere};
-    int numSpheres = sizeof(sceneSpheres) / sizeof(sceneSpheres[0]);
+    int numSpheres = 3 + numRandomSpheres;
+    Sphere *sceneSpheres = (Sphere*)malloc((size_t)numSpheres * sizeof(Sphere));
+    if (!sceneSpheres) { free(pixels); SDL_DestroyTexture(texture); SDL_DestroyRenderer(renderer); SDL_DestroyWindow(window); SDL_Quit(); return 1; }
+    sceneSpheres[0] = redSphere;
+    sceneSpheres[1] = blueSphere;
+    sceneSpheres[2] = greenSphere;
+
+    // fixed seed so the random scene is the same every run
+    srand(1);
+    for (int i = 3; i < numSpheres; ++i) {
+        float depth = 8.0f + 52.0f * ((float)rand() / (float)RAND_MAX);
+        Vec3 center = {
+            depth * (2.0f * (float)rand() / (float)RAND_MAX - 1.0f),
+            depth * (2.0f * (float)rand() / (float)RAND_MAX - 1.0f),
+            -depth
+        };
+        Color color = {(float)rand() / (float)RAND_MAX, (float)rand() / (float)RAND_MAX, (float)rand() / (float)RAND_MAX};
+        float radius = 0.05f + 0.25f * ((float)rand() / (float)RAND_MAX);
+        sceneSpheres[i] = sphere_create(center, radius, color, (i % 8 == 0) ? 0.5f : 0.0f);
+    }
+
+    // every ray goes through the hierarchy instead of testing each sphere
+    Bvh *sceneBvh = bvh_build(sceneSpheres, numSpheres);
+    free(sceneSpheres);
+    if (!sceneBvh) { free(pixels); SDL_DestroyTexture(texture); SDL_DestroyRenderer(renderer); SDL_DestroyWindow(window); SDL_Quit(); return 1; }
 
     Vec3 lightPosition = {5.0f, 5.0f, 0.0f};
 
@@ -126,8 +151,7 @@ int main(int argc, char* argv[]) {
 
     RenderJob job;
     job.camera = sceneCamera;
-    job.spheres = sceneSpheres;
-    job.numSpheres = numSpheres;
+    job.bvh = sceneBvh;
     job.precompRays = precompRays;
     job.width = WINDOW_WIDTH;
     job.height = WINDOW_HEIGHT;
@@ -193,6 +217,7 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    bvh_free(sceneBvh);
     free(precompRays);
     free(pixels);
     SDL_DestroyTexture(texture);
@@ -6,6 +6,7 @@
 #include <stdatomic.h>
 #include <math.h>
 #include "ray_logic.h"
+#include "bvh.h"
 
 static inline unsigned int xorshift32(unsigned int *state) {
     unsigned int x = *state;
@@ -21,8 +22,7 @@ static inline double xrnd_unit(unsigned int *state) {
 
 typedef struct {
     Camera camera;
-    Sphere *spheres;
-    int numSpheres;
+    const Bvh *bvh;
     Vec3 *precompRays;
     int width, height;
     Vec3 lightPos;
@@ -32,7 +32,7 @@ typedef struct {
 } RenderJob;
 
 extern Color trace_ray_with_rng(Ray r,
-                                Sphere *spheres, int numSpheres,
+                                const Bvh *bvh,
                                 Vec3 lightPos,
                                 int shadow_samples,
                                 unsigned int *rng_state);
@@ -56,7 +56,7 @@ static int sdl_render_thread(void *arg) {
             Ray primary = { job->camera.position, dir };
 
             Color col = trace_ray_with_rng(primary,
-                                           job->spheres, job->numSpheres,
+                                           job->bvh,
                                            job->lightPos,
                                            job->shadow_samples,
                                            &seed);
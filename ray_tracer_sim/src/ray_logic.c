@@ -1,4 +1,5 @@
 #include "ray_logic.h"
+#include "bvh.h"
 #include <math.h>
 #include <stdlib.h>
 #include <float.h>
@@ -86,8 +87,7 @@ Vec3 vec3_normalize(Vec3 v) {
 
 Color trace_ray(
     Ray ray,
-    Sphere* spheres,
-    int numSpheres,
+    const Bvh* bvh,
     Vec3 lightPosition,
     Color lightColor,
     Color ambientLight,
@@ -100,19 +100,9 @@ Color trace_ray(
 ) {
     Color finalColor = {0.0f, 0.0f, 0.0f};
     float closestIntersectionDistance = FLT_MAX;
-    Sphere* hitSphere = NULL;
-
-    for (int i = 0; i < numSpheres; i++) {
-        float currentIntersectionDistance;
-        if (ray_intersect_sphere(ray, spheres[i], &currentIntersectionDistance)) {
-            if (currentIntersectionDistance < closestIntersectionDistance) {
-                closestIntersectionDistance = currentIntersectionDistance;
-                hitSphere = &spheres[i];
-            }
-        }
-    }
+    const Sphere* hitSphere = NULL;
 
-    if (hitSphere == NULL) {
+    if (!bvh_intersect_closest(bvh, ray, &closestIntersectionDistance, &hitSphere)) {
         Color black = {0.0f, 0.0f, 0.0f};
         return black;
     }
@@ -141,17 +131,7 @@ Color trace_ray(
         toLight = vec3_normalize(toLight);
 
         Ray shadowRay = { vec3_add(hitPoint, vec3_scale(normal, EPSILON)), toLight };
-        int blocked = 0;
-        for (int j = 0; j < numSpheres; ++j) {
-            float ttmp;
-            if (ray_intersect_sphere(shadowRay, spheres[j], &ttmp)) {
-                if (ttmp < distToLight) {
-                    blocked = 1;
-                    break;
-                }
-            }
-        }
-        if (!blocked) hits++;
+        if (!bvh_intersect_any(bvh, shadowRay, distToLight)) hits++;
     }
 
     float visibility = (float)hits / (float)numShadowRays;
@@ -177,8 +157,7 @@ Color trace_ray(
         Ray reflRay = { vec3_add(hitPoint, vec3_scale(normal, EPSILON)), reflDir };
         Color reflectedColor = trace_ray(
             reflRay,
-            spheres,
-            numSpheres,
+            bvh,
             lightPosition,
             lightColor,
             ambientLight,
@@ -200,8 +179,7 @@ Color trace_ray(
 
 Color trace_ray_with_rng(
     Ray ray,
-    Sphere *spheres,
-    int numSpheres,
+    const Bvh* bvh,
     Vec3 lightPos,
     int shadow_samples,
     unsigned int *rngState
@@ -214,8 +192,7 @@ Color trace_ray_with_rng(
 
     return trace_ray(
         ray,
-        spheres,
-        numSpheres,
+        bvh,
         lightPos,
         lightColor,
         ambientLight,